@@ -28,6 +28,7 @@ extern "C" {
 #include <rtl-sdr_export.h>
 
 typedef struct rtlsdr_dev rtlsdr_dev_t;
+typedef struct rtlsdr_ctx rtlsdr_ctx_t;
 
 RTLSDR_API uint32_t rtlsdr_get_device_count(void);
 
@@ -60,8 +61,124 @@ RTLSDR_API int rtlsdr_get_device_usb_strings(uint32_t index,
  */
 RTLSDR_API int rtlsdr_get_index_by_serial(const char *serial);
 
+#define RTLSDR_PORT_PATH_MAX	7
+
+typedef struct rtlsdr_device_info {
+	uint32_t index;		/* device index as used by rtlsdr_open() */
+	uint16_t vid;
+	uint16_t pid;
+	const char *name;	/* as returned by rtlsdr_get_device_name() */
+	uint8_t bus;		/* USB bus number */
+	uint8_t address;	/* USB device address on the bus */
+	uint8_t port_depth;	/* number of valid entries in port_path */
+	uint8_t port_path[RTLSDR_PORT_PATH_MAX]; /* port numbers from the
+				   root hub down to the device */
+	int strings_err;	/* 0 if the strings below were read, else
+				   the error of opening the device */
+	char manufact[256];
+	char product[256];
+	char serial[256];
+} rtlsdr_device_info_t;
+
+/*!
+ * Take a snapshot of all supported devices in a single pass over the bus.
+ * The USB strings of a device are read once and remembered by the library
+ * for as long as the device stays at the same bus address, so repeated
+ * calls, rtlsdr_get_device_usb_strings(), rtlsdr_get_index_by_serial() and
+ * rtlsdr_open() do not have to open the devices again.
+ *
+ * \param list set to an array of device descriptions, free it with
+ *	       rtlsdr_free_device_list(), NULL if no device was found
+ * \param count set to the number of entries in the list
+ * \return 0 on success, negative libusb error on failure
+ */
+RTLSDR_API int rtlsdr_get_device_list(rtlsdr_device_info_t **list,
+				      uint32_t *count);
+
+/*!
+ * Free a list returned by rtlsdr_get_device_list().
+ *
+ * \param list the device list, may be NULL
+ */
+RTLSDR_API void rtlsdr_free_device_list(rtlsdr_device_info_t *list);
+
 RTLSDR_API int rtlsdr_open(rtlsdr_dev_t **dev, uint32_t index);
 
+/*!
+ * Open the first device with the given serial number. The device is looked
+ * up and opened in a single enumeration, unlike resolving the serial with
+ * rtlsdr_get_index_by_serial() first, which races with devices coming and
+ * going in between.
+ *
+ * \param dev set to the device handle on success
+ * \param serial serial string of the device
+ * \return 0 on success, -1 if no matching device was found
+ */
+RTLSDR_API int rtlsdr_open_by_serial(rtlsdr_dev_t **dev, const char *serial);
+
+/*!
+ * Open the device plugged into the given USB port, independent of its
+ * serial number and of the order of enumeration.
+ *
+ * \param dev set to the device handle on success
+ * \param path bus number and chain of port numbers from the root hub, in
+ *	  the form <bus>-<port>[.<port>...], e.g. "1-1.4" as in sysfs
+ * \return 0 on success, -1 if the path is malformed or no supported device
+ *	   is plugged into that port
+ */
+RTLSDR_API int rtlsdr_open_by_path(rtlsdr_dev_t **dev, const char *path);
+
+/*!
+ * Remember the tuner type and crystal frequencies of each dongle in a state
+ * file, keyed by serial number. Devices opened afterwards check the known
+ * tuner with a single register read instead of probing for all of them,
+ * and get back the crystal frequencies last set with rtlsdr_set_xtal_freq().
+ * Dongles without a serial number or with blanks in it are not remembered,
+ * those sharing a serial number are told apart by their tuner only.
+ *
+ * \param path the state file, created if needed, NULL to disable (default)
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_state_file(const char *path);
+
+/*!
+ * Open a simulated device, an RTL2832U with an R820T tuner that exists
+ * only in memory. Samples come from a signal generator or a u8 IQ file
+ * and are delivered at the programmed sample rate, which allows testing
+ * the library and applications without hardware.
+ *
+ * \param dev the device handle
+ * \param args comma separated options, NULL for the defaults:
+ *        tone=<Hz> offset of the generated carrier, default 100000
+ *        amp=<0-127> carrier amplitude, default 64
+ *        noise=<0-127> noise amplitude, default 4
+ *        file=<path> replay a u8 IQ file in a loop instead
+ *        pace=0 deliver samples as fast as they are consumed
+ *        serial=<string> serial number to report
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_open_sim(rtlsdr_dev_t **dev, const char *args);
+
+/*!
+ * Open a recorded capture, e.g. from rtl_sdr, as a device. The u8 IQ
+ * samples are streamed through the regular sync and async read functions,
+ * the tuning and gain functions succeed but have no effect. After the last
+ * sample the reads fail as if the device had been unplugged: the read that
+ * hits the end returns the remaining samples, the next rtlsdr_read_sync()
+ * returns LIBUSB_ERROR_NO_DEVICE (-4), rtlsdr_read_async() returns -1 once
+ * the buffers in flight have come back and rtlsdr_stream_acquire() returns
+ * -4 after the last buffer. The end is reported once on stderr.
+ *
+ * \param dev the device handle
+ * \param path file with interleaved 8 bit unsigned I and Q samples
+ * \param realtime 1 to deliver the samples at the sample rate set with
+ *        rtlsdr_set_sample_rate(), 0 to deliver them as fast as they are
+ *        consumed
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_open_file(rtlsdr_dev_t **dev, const char *path,
+				int realtime);
+
 RTLSDR_API int rtlsdr_close(rtlsdr_dev_t *dev);
 
 /* configuration functions */
@@ -144,6 +261,31 @@ RTLSDR_API int rtlsdr_read_eeprom(rtlsdr_dev_t *dev, uint8_t *data,
 
 RTLSDR_API int rtlsdr_set_center_freq(rtlsdr_dev_t *dev, uint32_t freq);
 
+/*!
+ * Set a list of frequencies to be hopped between with rtlsdr_hop().
+ * For R820T/R828D tuners the tuner registers for every frequency are
+ * computed up front, a hop then writes the changed registers at once and
+ * checks the PLL lock a single time. Other tuners tune as with
+ * rtlsdr_set_center_freq(). The plan follows later changes of offset
+ * tuning, bandwidth and frequency correction.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param freqs frequencies in Hz, copied
+ * \param num number of frequencies, 0 to drop the plan
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_freq_plan(rtlsdr_dev_t *dev, const uint32_t *freqs,
+				    uint32_t num);
+
+/*!
+ * Tune to a frequency of the plan set with rtlsdr_set_freq_plan().
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param index position of the frequency in the plan
+ * \return 0 on success, -1 on error or if index is out of range
+ */
+RTLSDR_API int rtlsdr_hop(rtlsdr_dev_t *dev, uint32_t index);
+
 /*!
  * Get actual frequency the device is tuned to.
  *
@@ -252,6 +394,26 @@ RTLSDR_API int rtlsdr_set_tuner_if_gain(rtlsdr_dev_t *dev, int stage, int gain);
  */
 RTLSDR_API int rtlsdr_set_tuner_gain_mode(rtlsdr_dev_t *dev, int manual);
 
+/*!
+ * Start a batch of tuner operations. Every tuner access is normally
+ * bracketed by opening and closing the I2C repeater of the demodulator,
+ * within a batch the repeater is kept open and only closed by the
+ * matching rtlsdr_end_tuner_batch(). Batches may be nested.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_begin_tuner_batch(rtlsdr_dev_t *dev);
+
+/*!
+ * End a batch of tuner operations, closing the I2C repeater when the
+ * outermost batch ends.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \return 0 on success, -1 if no batch was started
+ */
+RTLSDR_API int rtlsdr_end_tuner_batch(rtlsdr_dev_t *dev);
+
 /*!
  * Set the sample rate for the device, also selects the baseband filters
  * according to the requested sample rate for tuners where this is possible.
@@ -337,6 +499,45 @@ RTLSDR_API int rtlsdr_reset_buffer(rtlsdr_dev_t *dev);
 
 RTLSDR_API int rtlsdr_read_sync(rtlsdr_dev_t *dev, void *buf, int len, int *n_read);
 
+/*!
+ * Set a latency target for the asynchronous streaming functions. When the
+ * buffer count or length is left at 0, they are derived from the target
+ * instead of the fixed defaults: every transfer holds about latency_us worth
+ * of samples at the current sample rate, and enough transfers are queued to
+ * bridge about 200 ms of host stalls. The number of transfers is capped at
+ * 200, so targets below 1 ms bridge proportionally shorter stalls. Sample
+ * rate changes while streaming resize the transfers as they get
+ * resubmitted, so short targets cost more wakeups at high rates and long
+ * ones save them.
+ *
+ * Takes effect at the next start of a stream.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param latency_us target latency in microseconds, 0 to disable
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_latency_target(rtlsdr_dev_t *dev,
+					 uint32_t latency_us);
+
+/*!
+ * Enable or disable automatic recovery from a lost device. When the device
+ * disappears while reading asynchronously, e.g. after being unplugged, the
+ * blocking read functions and the stream thread wait for a device with
+ * the same serial number to reappear instead of returning. The device is
+ * then reopened in place, its frequency, sample rate, gain, correction,
+ * bias tee and FIR settings are restored and streaming resumes with the
+ * next buffer flagged RTLSDR_BUF_RECOVERED. rtlsdr_cancel_async() stops
+ * waiting.
+ *
+ * Not available for simulated devices and for devices streaming through
+ * rtlsdr_ctx_read_async().
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param on 1 to enable, 0 to disable
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_auto_recovery(rtlsdr_dev_t *dev, int on);
+
 typedef void(*rtlsdr_read_async_cb_t)(unsigned char *buf, uint32_t len, void *ctx);
 
 /*!
@@ -372,6 +573,114 @@ RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
 				 uint32_t buf_num,
 				 uint32_t buf_len);
 
+/* samples were lost between the previous buffer and this one */
+#define RTLSDR_BUF_GAP		(1 << 0)
+/* center frequency, sample rate or gain changed since the previous buffer,
+ * samples with an index below retune_index still use the old settings */
+#define RTLSDR_BUF_RETUNE	(1 << 1)
+/* the device was lost and has been reopened, with its settings restored,
+ * before this buffer, RTLSDR_BUF_GAP is set as well */
+#define RTLSDR_BUF_RECOVERED	(1 << 2)
+
+/*!
+ * Metadata describing a buffer of samples received asynchronously.
+ */
+typedef struct rtlsdr_buffer_info {
+	uint64_t sample_index;	/* index of the first I/Q sample in the
+				   buffer, counted from the stream start,
+				   samples lost in gaps included */
+	uint64_t timestamp_ns;	/* host arrival time of the buffer,
+				   CLOCK_MONOTONIC in nanoseconds */
+	uint32_t center_freq;	/* center frequency in Hz */
+	uint32_t sample_rate;	/* sample rate in Hz */
+	int gain;		/* tuner gain in tenths of a dB */
+	uint32_t flags;		/* RTLSDR_BUF_* flags */
+	uint64_t retune_index;	/* index of the first sample captured after
+				   the most recent change of frequency,
+				   sample rate or gain, 0 if none */
+} rtlsdr_buffer_info_t;
+
+/*!
+ * Sample buffer handed out by the library in deferred release or streaming
+ * mode. The buffer is owned by the library and stays valid until it is
+ * given back with rtlsdr_buffer_release().
+ */
+typedef struct rtlsdr_buffer {
+	unsigned char *buf;	/* interleaved 8 bit I/Q samples */
+	uint32_t len;		/* number of valid bytes in buf */
+	rtlsdr_buffer_info_t info;
+	void *samples;		/* the samples in the format set with
+				   rtlsdr_set_stream_format(), same as buf
+				   for RTLSDR_FMT_U8 */
+	uint32_t samples_len;	/* number of valid bytes in samples */
+} rtlsdr_buffer_t;
+
+typedef void(*rtlsdr_read_async_buf_cb_t)(rtlsdr_buffer_t *buf, void *ctx);
+
+/*!
+ * Read samples from the device asynchronously, handing the USB buffers to
+ * the callback without copying. The callback may keep a buffer after it
+ * returns and has to give it back with rtlsdr_buffer_release() once done.
+ * Transfers are resubmitted with a spare buffer right away, if no spare
+ * buffer is left they are resubmitted as soon as a buffer is released.
+ * This function will block until it is being canceled using
+ * rtlsdr_cancel_async()
+ *
+ * Buffers not yet released when this function returns stay valid until
+ * the next streaming call or rtlsdr_close().
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param cb callback function to return received sample buffers
+ * \param ctx user specific context to pass via the callback function
+ * \param buf_num optional number of USB transfers kept in flight,
+ *		  set to 0 for default buffer count (15)
+ * \param buf_len optional buffer length, must be multiple of 512,
+ *		  set to 0 for default buffer length (16 * 32 * 512)
+ * \param spare_num optional number of additional buffers the callback may
+ *		    hold on to, set to 0 to use buf_num
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_read_async_deferred(rtlsdr_dev_t *dev,
+					  rtlsdr_read_async_buf_cb_t cb,
+					  void *ctx,
+					  uint32_t buf_num,
+					  uint32_t buf_len,
+					  uint32_t spare_num);
+
+/*!
+ * Give a sample buffer back to the library. May be called from any thread.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param buf the buffer handle
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_buffer_release(rtlsdr_dev_t *dev, rtlsdr_buffer_t *buf);
+
+typedef void(*rtlsdr_read_async_ex_cb_t)(unsigned char *buf, uint32_t len,
+					 const rtlsdr_buffer_info_t *info,
+					 void *ctx);
+
+/*!
+ * Read samples from the device asynchronously, like rtlsdr_read_async(),
+ * but pass metadata about every buffer to the callback. Buffers following
+ * data lost to USB transfer errors are flagged with RTLSDR_BUF_GAP.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param cb callback function to return received samples and metadata
+ * \param ctx user specific context to pass via the callback function
+ * \param buf_num optional buffer count, buf_num * buf_len = overall buffer size
+ *		  set to 0 for default buffer count (15)
+ * \param buf_len optional buffer length, must be multiple of 512,
+ *		  should be a multiple of 16384 (URB size), set to 0
+ *		  for default buffer length (16 * 32 * 512)
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_read_async_ex(rtlsdr_dev_t *dev,
+				    rtlsdr_read_async_ex_cb_t cb,
+				    void *ctx,
+				    uint32_t buf_num,
+				    uint32_t buf_len);
+
 /*!
  * Cancel all pending asynchronous operations on the device.
  *
@@ -380,6 +689,583 @@ RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
  */
 RTLSDR_API int rtlsdr_cancel_async(rtlsdr_dev_t *dev);
 
+/*!
+ * Start streaming into a lock-free ring of sample buffers. USB transfers
+ * are resubmitted by an internal event thread as soon as they complete,
+ * the completed buffers are queued for the consumer without copying.
+ * Use rtlsdr_stream_acquire() and rtlsdr_stream_release() to access them.
+ *
+ * If the consumer falls behind and no free buffer is left, the data of the
+ * completed transfer is dropped and counted as overflow.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param buf_num optional number of USB transfers kept in flight,
+ *		  set to 0 for default buffer count (15)
+ * \param buf_len optional buffer length, must be multiple of 512,
+ *		  set to 0 for default buffer length (16 * 32 * 512)
+ * \param ring_len optional number of additional buffers available to the
+ *		   consumer, set to 0 to use buf_num
+ * \return 0 on success
+ * \return -2 if the device is already streaming
+ * \return -3 if the event thread could not be started
+ */
+RTLSDR_API int rtlsdr_stream_start(rtlsdr_dev_t *dev,
+				   uint32_t buf_num,
+				   uint32_t buf_len,
+				   uint32_t ring_len);
+
+/*!
+ * Take the oldest filled buffer out of the stream ring. The buffer has to
+ * be given back with rtlsdr_stream_release() once it has been processed.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param buf returns the buffer handle
+ * \param timeout_ms time to wait for data, 0 to poll, negative for infinite
+ * \return 0 on success
+ * \return -2 if the device is not streaming
+ * \return -3 if no buffer was available within the timeout
+ * \return -4 if the stream has ended (canceled or device lost)
+ */
+RTLSDR_API int rtlsdr_stream_acquire(rtlsdr_dev_t *dev, rtlsdr_buffer_t **buf,
+				     int timeout_ms);
+
+/*!
+ * Give a buffer obtained from rtlsdr_stream_acquire() back to the library,
+ * same as rtlsdr_buffer_release(). May be called from any thread.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param buf the buffer handle
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_stream_release(rtlsdr_dev_t *dev, rtlsdr_buffer_t *buf);
+
+/*!
+ * Stop streaming and free all stream buffers. Buffers still held by the
+ * consumer become invalid.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \return 0 on success
+ * \return -2 if the device is not streaming
+ */
+RTLSDR_API int rtlsdr_stream_stop(rtlsdr_dev_t *dev);
+
+/*!
+ * Get the number of buffers dropped since rtlsdr_stream_start() because
+ * the consumer did not release buffers fast enough.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \return number of dropped buffers
+ */
+RTLSDR_API uint32_t rtlsdr_stream_get_overflows(rtlsdr_dev_t *dev);
+
+enum rtlsdr_sample_format {
+	RTLSDR_FMT_U8 = 0,	/* unsigned 8 bit as received, centered at 127.5 */
+	RTLSDR_FMT_S16,		/* signed 16 bit, see rtlsdr_convert_s16() */
+	RTLSDR_FMT_F32		/* float, see rtlsdr_convert_f32() */
+};
+
+/*!
+ * Set the format of the samples handed out by rtlsdr_stream_acquire() and
+ * rtlsdr_read_async_deferred() in rtlsdr_buffer_t.samples. Buffers are
+ * converted right before they are handed out, in the thread acquiring
+ * them for the stream. The raw samples stay available in buf.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param format one of enum rtlsdr_sample_format
+ * \return 0 on success
+ * \return -2 if the device is streaming
+ */
+RTLSDR_API int rtlsdr_set_stream_format(rtlsdr_dev_t *dev,
+					enum rtlsdr_sample_format format);
+
+/*!
+ * Correct DC offset and I/Q imbalance of the buffers handed out in the
+ * RTLSDR_FMT_F32 stream format, see rtlsdr_iq_corr_create(). The estimates
+ * carry over from buffer to buffer and start over after a retune.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param flags RTLSDR_CORR_DC and/or RTLSDR_CORR_IQ, 0 to disable
+ * \return 0 on success
+ * \return -2 if the device is streaming
+ */
+RTLSDR_API int rtlsdr_set_iq_correction(rtlsdr_dev_t *dev, uint32_t flags);
+
+/*!
+ * Down-convert the buffers handed out in the RTLSDR_FMT_F32 stream format
+ * to a channel at an offset from the center frequency, see
+ * rtlsdr_ddc_create(). The samples of a buffer then are its decimated
+ * channel, samples_len shrinks accordingly. The stage runs after the I/Q
+ * correction and keeps its state from buffer to buffer.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param offset frequency of the channel relative to the center in Hz
+ * \param decim decimation ratio, 0 to disable
+ * \return 0 on success
+ * \return -1 on invalid arguments or if no sample rate is set
+ * \return -2 if the device is streaming
+ */
+RTLSDR_API int rtlsdr_set_stream_ddc(rtlsdr_dev_t *dev, int32_t offset,
+				     uint32_t decim);
+
+/* number of histogram bins, bin 0 counts durations below 1 us, bin n those
+ * of 2^(n-1) us up to 2^n us, the last bin everything above */
+#define RTLSDR_STATS_HIST_BINS	20
+
+/*!
+ * Statistics of the asynchronous transfers, reset at every stream start.
+ */
+typedef struct rtlsdr_stream_stats {
+	uint64_t xfers_completed;	/* transfers delivered with data */
+	uint64_t xfers_errored;		/* transfers failed, data lost */
+	uint32_t xfer_errors;		/* current run of failed transfers */
+	uint32_t in_flight;		/* transfers currently submitted */
+	uint32_t min_in_flight;		/* lowest number of transfers left
+					   submitted while streaming */
+	uint32_t overflows;		/* buffers dropped in streaming mode */
+	uint32_t cb_time_hist[RTLSDR_STATS_HIST_BINS];	/* time spent in the
+					   completion handler, including the
+					   user callback */
+	uint32_t jitter_hist[RTLSDR_STATS_HIST_BINS];	/* deviation of the
+					   buffer inter-arrival time from the
+					   sample clock */
+} rtlsdr_stream_stats_t;
+
+/*!
+ * Get statistics of the asynchronous transfers. The counters are updated
+ * without locks by the event thread and may be read at any time, also
+ * while streaming, at the expense of a consistent snapshot.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param stats returns the statistics
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_get_stream_stats(rtlsdr_dev_t *dev,
+				       rtlsdr_stream_stats_t *stats);
+
+/*!
+ * Set how long tuning waits for the tuner PLL to lock. The lock bit is
+ * checked at least twice, and then every poll_us until timeout_us has
+ * passed since the first check. A tune that does not lock in time fails.
+ * Currently only supported for R820T/R828D tuners, the default of 0 for
+ * both values does not wait between the two checks.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param timeout_us maximum time to wait for the lock in microseconds
+ * \param poll_us interval between checks in microseconds
+ * \return 0 on success, -1 if not supported by the tuner
+ */
+RTLSDR_API int rtlsdr_set_lock_timeout(rtlsdr_dev_t *dev, uint32_t timeout_us,
+				       uint32_t poll_us);
+
+/*!
+ * Statistics of the tuner PLL lock, counted since the device was opened.
+ */
+typedef struct rtlsdr_lock_stats {
+	uint32_t tunes;			/* tunes that waited for the lock */
+	uint32_t failures;		/* tunes that did not lock in time */
+	uint32_t last_lock_us;		/* time spent waiting by the latest
+					   tune */
+	uint32_t lock_hist[RTLSDR_STATS_HIST_BINS];	/* time until the lock
+					   was detected, see
+					   RTLSDR_STATS_HIST_BINS */
+} rtlsdr_lock_stats_t;
+
+/*!
+ * Get statistics of the time tunes waited for the tuner PLL to lock, to
+ * size the settling time of frequency sweeps. Only R820T/R828D tuners
+ * are measured.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param stats returns the statistics
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_get_lock_stats(rtlsdr_dev_t *dev,
+				     rtlsdr_lock_stats_t *stats);
+
+/*!
+ * Latency of tuner gain changes, counted since the device was opened.
+ */
+typedef struct rtlsdr_gain_latency {
+	uint32_t steps;			/* successful calls of
+					   rtlsdr_set_tuner_gain() that
+					   wrote to the tuner */
+	uint32_t fast_steps;		/* steps written as a precomputed
+					   register image */
+	uint32_t last_us;		/* duration of the latest step */
+	uint32_t hist[RTLSDR_STATS_HIST_BINS];	/* step durations, see
+					   RTLSDR_STATS_HIST_BINS */
+} rtlsdr_gain_latency_t;
+
+/*!
+ * Get statistics of the time rtlsdr_set_tuner_gain() takes, to account
+ * for it in gain control loops. On E4000, FC0012 and FC0013 tuners the
+ * gains listed by rtlsdr_get_tuner_gains() are precomputed register images,
+ * written together with the I2C repeater switching in one batch of control
+ * transfers.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param lat returns the statistics
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_get_gain_step_latency(rtlsdr_dev_t *dev,
+					    rtlsdr_gain_latency_t *lat);
+
+/*!
+ * Measure how many samples are corrupted after tuning steps of the given
+ * sizes. The device hops back and forth between freq and freq + step,
+ * flushes the buffer with rtlsdr_reset_buffer() and looks for the point
+ * where DC offset and power of the signal have settled. The sample rate
+ * should be set beforehand, the device must not be streaming. The
+ * previous frequency is restored afterwards. If the calibration fails,
+ * the results of an earlier one stay in effect.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param freq frequency in Hz to measure at
+ * \param steps tuning steps in Hz, at most 16
+ * \param num number of steps
+ * \return 0 on success, -2 if the device is streaming
+ */
+RTLSDR_API int rtlsdr_calibrate_settling(rtlsdr_dev_t *dev, uint32_t freq,
+					 const uint32_t *steps, uint32_t num);
+
+/*!
+ * Get the number of samples to discard after a tuning step, counted from
+ * rtlsdr_reset_buffer() or from rtlsdr_buffer_info_t.retune_index. Uses
+ * the smallest calibrated step not below the given one, the largest
+ * calibrated step for bigger ones, and a conservative 1 ms before
+ * rtlsdr_calibrate_settling() was run. Scales with the sample rate.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param step size of the tuning step in Hz
+ * \return number of samples
+ */
+RTLSDR_API uint32_t rtlsdr_get_settling_samples(rtlsdr_dev_t *dev,
+						uint32_t step);
+
+/* sample conversion */
+
+/*!
+ * Convert 8 bit I/Q samples to signed 16 bit by subtracting 127, using the
+ * fastest implementation the CPU supports.
+ *
+ * \param in samples as received from the device
+ * \param out converted samples, may not overlap in
+ * \param len number of samples, counting I and Q separately
+ */
+RTLSDR_API void rtlsdr_convert_s16(const unsigned char *in, int16_t *out,
+				   uint32_t len);
+
+/*!
+ * Convert 8 bit I/Q samples to float scaled to -1.0 ... 1.0. The output
+ * is interleaved I/Q and can be used as an array of complex float.
+ *
+ * \param in samples as received from the device
+ * \param out converted samples, may not overlap in
+ * \param len number of samples, counting I and Q separately
+ */
+RTLSDR_API void rtlsdr_convert_f32(const unsigned char *in, float *out,
+				   uint32_t len);
+
+/*!
+ * Get the name of the conversion implementation picked for this CPU.
+ *
+ * \return "avx2", "sse2", "neon" or "scalar"
+ */
+RTLSDR_API const char *rtlsdr_get_convert_impl(void);
+
+/* DC offset and I/Q imbalance correction */
+
+#define RTLSDR_CORR_DC		(1 << 0)	/* remove the DC offset */
+#define RTLSDR_CORR_IQ		(1 << 1)	/* balance I/Q gain and phase,
+						   implies RTLSDR_CORR_DC */
+
+/* default time constant of the estimates in I/Q pairs */
+#define RTLSDR_CORR_TIME_CONST	(1 << 18)
+
+typedef struct rtlsdr_iq_corr rtlsdr_iq_corr_t;
+
+/*!
+ * Create the state of a correction stage. The DC offset, and the gain and
+ * phase of Q relative to I, are estimated from the samples passing through
+ * and averaged over the given time constant, every buffer adds to the
+ * estimates in proportion to its length.
+ *
+ * \param flags RTLSDR_CORR_DC and/or RTLSDR_CORR_IQ
+ * \param time_const time constant in I/Q pairs, 0 for the default
+ * \return the correction state, NULL if out of memory
+ */
+RTLSDR_API rtlsdr_iq_corr_t *rtlsdr_iq_corr_create(uint32_t flags,
+						   uint32_t time_const);
+
+/*!
+ * Free a correction stage.
+ *
+ * \param corr the correction state, may be NULL
+ */
+RTLSDR_API void rtlsdr_iq_corr_destroy(rtlsdr_iq_corr_t *corr);
+
+/*!
+ * Start over with the estimates, e.g. after a retune changed the DC offset.
+ * The next buffer replaces them entirely.
+ *
+ * \param corr the correction state
+ */
+RTLSDR_API void rtlsdr_iq_corr_reset(rtlsdr_iq_corr_t *corr);
+
+/*!
+ * Update the estimates with a buffer of float samples, as produced by
+ * rtlsdr_convert_f32(), and correct it in place.
+ *
+ * \param corr the correction state
+ * \param iq interleaved I/Q samples
+ * \param len number of samples, counting I and Q separately
+ */
+RTLSDR_API void rtlsdr_iq_corr_process(rtlsdr_iq_corr_t *corr, float *iq,
+				       uint32_t len);
+
+/*!
+ * Get the current estimates of a correction stage.
+ *
+ * \param corr the correction state
+ * \param dc_i DC offset of I, may be NULL
+ * \param dc_q DC offset of Q, may be NULL
+ * \param gain gain of Q relative to I, may be NULL
+ * \param phase phase error of Q in radians, may be NULL
+ * \return 0 on success, -1 if no samples have been processed yet, -2 if
+ * the samples allow no I/Q imbalance estimate, e.g. without a signal. Only
+ * the DC offsets are returned then.
+ */
+RTLSDR_API int rtlsdr_iq_corr_get_estimate(rtlsdr_iq_corr_t *corr,
+					   float *dc_i, float *dc_q,
+					   float *gain, float *phase);
+
+/* digital down-converter */
+
+typedef struct rtlsdr_ddc rtlsdr_ddc_t;
+
+/*!
+ * Create the state of a digital down-converter, which selects a channel
+ * from a stream of float samples without retuning: a complex NCO mixes the
+ * channel at the given offset down to zero, a 4 stage CIC filter decimates
+ * and an FIR filter flattens its passband droop and takes the last factor
+ * of two of even ratios. About 80% of the output bandwidth is usable.
+ *
+ * Only even ratios have the FIR cut off what the CIC aliases into the
+ * band, they reject aliases by more than 95 dB. Odd ratios rely on the
+ * CIC alone: aliases of the neighbouring band are down by about 45 dB at
+ * a fifth of the output rate off the center, but only by about 14 dB at
+ * the edge of the usable band.
+ *
+ * \param rate input sample rate in Hz
+ * \param offset frequency of the channel relative to the center in Hz
+ * \param decim decimation ratio, even ratios up to 4096, odd ones up to
+ *	  2047, 1 only shifts the frequency
+ * \return the down-converter state, NULL on invalid arguments or out of
+ *	   memory
+ */
+RTLSDR_API rtlsdr_ddc_t *rtlsdr_ddc_create(uint32_t rate, int32_t offset,
+					  uint32_t decim);
+
+/*!
+ * Free a down-converter.
+ *
+ * \param ddc the down-converter state, may be NULL
+ */
+RTLSDR_API void rtlsdr_ddc_destroy(rtlsdr_ddc_t *ddc);
+
+/*!
+ * Move the channel of a down-converter. The NCO continues from its current
+ * phase and the filters keep their state, so the output stays continuous.
+ *
+ * \param ddc the down-converter state
+ * \param offset frequency of the channel relative to the center in Hz
+ * \return 0 on success, -1 if the offset is beyond half the sample rate
+ */
+RTLSDR_API int rtlsdr_ddc_set_offset(rtlsdr_ddc_t *ddc, int32_t offset);
+
+/*!
+ * Clear the NCO phase and the filter history, e.g. after a gap in the
+ * input.
+ *
+ * \param ddc the down-converter state
+ */
+RTLSDR_API void rtlsdr_ddc_reset(rtlsdr_ddc_t *ddc);
+
+/*!
+ * Down-convert a buffer of float samples, as produced by
+ * rtlsdr_convert_f32(). The state carries over from call to call, so a
+ * stream may be fed in buffers of any length. The output may overwrite the
+ * input.
+ *
+ * \param ddc the down-converter state
+ * \param in interleaved I/Q samples
+ * \param len number of input samples, counting I and Q separately
+ * \param out output buffer, room for 2 * (len / 2 / decim + 1) samples
+ * \return number of output samples, counting I and Q separately
+ */
+RTLSDR_API uint32_t rtlsdr_ddc_process(rtlsdr_ddc_t *ddc, const float *in,
+				       uint32_t len, float *out);
+
+/*!
+ * Get the decimation ratio of a down-converter.
+ *
+ * \param ddc the down-converter state
+ * \return the decimation ratio, 0 if ddc is NULL
+ */
+RTLSDR_API uint32_t rtlsdr_ddc_get_decimation(rtlsdr_ddc_t *ddc);
+
+/* polyphase filter bank channelizer */
+
+typedef struct rtlsdr_pfb rtlsdr_pfb_t;
+
+/*!
+ * Create a polyphase filter bank splitting a stream of float samples into
+ * equally spaced channels in one pass. Channel k is centered at k times
+ * the input rate divided by the number of channels, negative k below the
+ * center, and each comes out decimated to the channel spacing.
+ *
+ * The work is split in two: rtlsdr_pfb_process() filters the input into
+ * the branches of the bank once, rtlsdr_pfb_extract() then computes any
+ * channel from them on its own. Extracting does not change the state, so
+ * different channels can be extracted from the same branches in parallel.
+ *
+ * \param channels number of channels, 2 to 4096
+ * \param taps prototype filter taps per channel, 0 for the default of 16
+ * \return the filter bank state, NULL on invalid arguments or out of memory
+ */
+RTLSDR_API rtlsdr_pfb_t *rtlsdr_pfb_create(uint32_t channels, uint32_t taps);
+
+/*!
+ * Free a filter bank.
+ *
+ * \param pfb the filter bank state, may be NULL
+ */
+RTLSDR_API void rtlsdr_pfb_destroy(rtlsdr_pfb_t *pfb);
+
+/*!
+ * Filter a buffer of float samples, as produced by rtlsdr_convert_f32(),
+ * into the branches of the bank. Every complete block of as many I/Q pairs
+ * as there are channels gives one set of branches, the rest is kept for
+ * the next call.
+ *
+ * \param pfb the filter bank state
+ * \param in interleaved I/Q samples
+ * \param len number of input samples, counting I and Q separately
+ * \param branches output buffer, room for 2 * channels floats per block,
+ *	  that is 2 * channels * (len / 2 / channels + 1) in total
+ * \return number of blocks of branches produced
+ */
+RTLSDR_API uint32_t rtlsdr_pfb_process(rtlsdr_pfb_t *pfb, const float *in,
+				       uint32_t len, float *branches);
+
+/*!
+ * Compute the samples of one channel from the branches, one I/Q pair per
+ * block. Safe to call from several threads at once.
+ *
+ * \param pfb the filter bank state
+ * \param branches branches given by rtlsdr_pfb_process()
+ * \param blocks number of blocks of branches
+ * \param channel channel index, negative for channels below the center
+ * \param out output buffer, room for 2 * blocks floats
+ * \return 0 on success, -1 on an invalid channel, -ENOMEM if out of memory
+ */
+RTLSDR_API int rtlsdr_pfb_extract(rtlsdr_pfb_t *pfb, const float *branches,
+				  uint32_t blocks, int32_t channel, float *out);
+
+/*!
+ * Compute the weights that pick one channel out of the branches, for
+ * rtlsdr_pfb_extract_weights(). A channel extracted over and over is
+ * cheaper that way than with rtlsdr_pfb_extract(), which computes them
+ * on every call.
+ *
+ * \param pfb the filter bank state
+ * \param channel channel index, negative for channels below the center
+ * \param weights output buffer, room for 2 * channels floats
+ * \return 0 on success, -1 on an invalid channel
+ */
+RTLSDR_API int rtlsdr_pfb_channel_weights(rtlsdr_pfb_t *pfb, int32_t channel,
+					  float *weights);
+
+/*!
+ * Compute the samples of one channel from the branches, like
+ * rtlsdr_pfb_extract(), with weights given by rtlsdr_pfb_channel_weights().
+ * Safe to call from several threads at once.
+ *
+ * \param pfb the filter bank state
+ * \param branches branches given by rtlsdr_pfb_process()
+ * \param blocks number of blocks of branches
+ * \param weights weights of the channel
+ * \param out output buffer, room for 2 * blocks floats
+ */
+RTLSDR_API void rtlsdr_pfb_extract_weights(rtlsdr_pfb_t *pfb,
+					   const float *branches,
+					   uint32_t blocks,
+					   const float *weights, float *out);
+
+/*!
+ * Get the number of channels of a filter bank.
+ *
+ * \param pfb the filter bank state
+ * \return the number of channels, 0 if pfb is NULL
+ */
+RTLSDR_API uint32_t rtlsdr_pfb_get_channels(rtlsdr_pfb_t *pfb);
+
+/* shared context for multiple devices */
+
+/*!
+ * Create a context that lets several devices share one libusb context and
+ * a single event thread handling the asynchronous transfers of all of
+ * them. Buffer timestamps of all devices use the same monotonic clock and
+ * can be compared directly.
+ *
+ * \param out_ctx returns the context handle
+ * \return 0 on success
+ * \return -3 if the event thread could not be started
+ */
+RTLSDR_API int rtlsdr_ctx_create(rtlsdr_ctx_t **out_ctx);
+
+/*!
+ * Stop the event thread and release the context.
+ *
+ * \param ctx the context handle given by rtlsdr_ctx_create()
+ * \return 0 on success
+ * \return -2 if devices opened on the context have not been closed yet
+ */
+RTLSDR_API int rtlsdr_ctx_destroy(rtlsdr_ctx_t *ctx);
+
+/*!
+ * Open a device on a shared context, like rtlsdr_open(). The device is
+ * closed with rtlsdr_close() as usual.
+ *
+ * \param ctx the context handle given by rtlsdr_ctx_create()
+ * \param out_dev returns the device handle
+ * \param index the device index
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_ctx_open(rtlsdr_ctx_t *ctx, rtlsdr_dev_t **out_dev,
+			       uint32_t index);
+
+/*!
+ * Start reading samples from a device opened with rtlsdr_ctx_open(). Unlike
+ * rtlsdr_read_async_ex() this function returns right away, the callback is
+ * called from the event thread of the context, which is shared by all of its
+ * devices and thus must not block. Use rtlsdr_cancel_async() to stop.
+ *
+ * \param dev the device handle given by rtlsdr_ctx_open()
+ * \param cb callback function to return received samples and metadata
+ * \param ctx user specific context to pass via the callback function
+ * \param buf_num optional buffer count, set to 0 for default (15)
+ * \param buf_len optional buffer length, must be multiple of 512,
+ *		  set to 0 for default buffer length (16 * 32 * 512)
+ * \return 0 on success
+ * \return -2 if the device is busy, e.g. still canceling
+ */
+RTLSDR_API int rtlsdr_ctx_read_async(rtlsdr_dev_t *dev,
+				     rtlsdr_read_async_ex_cb_t cb,
+				     void *ctx,
+				     uint32_t buf_num,
+				     uint32_t buf_len);
+
 /*!
  * Enable or disable the bias tee on GPIO PIN 0.
  *
@@ -0,0 +1,48 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTLSDR_MODEL_H
+#define __RTLSDR_MODEL_H
+
+#include <stdint.h>
+
+#define RTLSDR_MODEL_NOTCH_MAX	3
+
+/*
+ * Board specific behaviour, resolved from the USB strings when a device
+ * is opened. Frequencies are in Hz, fields left 0 disable the feature.
+ */
+typedef struct rtlsdr_model {
+	const char *manufact;
+	const char *product;
+	const char *name;
+	int tuner_on_rtl_xtal;	/* tuner clocked by the RTL2832 crystal */
+	/* HF upconverter: frequencies below upconv_below are tuned
+	 * upconv_offs higher */
+	uint32_t upconv_below;
+	uint32_t upconv_offs;
+	/* notch filters, switched off when tuned within [lo, hi] */
+	uint32_t notch[RTLSDR_MODEL_NOTCH_MAX][2];
+	int num_notch;
+	/* separate HF, VHF and UHF inputs: HF up to and including hf_max,
+	 * UHF from uhf_min */
+	uint32_t hf_max;
+	uint32_t uhf_min;
+	int hf_gpio;		/* GPIO driven low on HF, -1 if none */
+} rtlsdr_model_t;
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTLSDR_TRANSPORT_H
+#define __RTLSDR_TRANSPORT_H
+
+#include <stdint.h>
+#include <libusb.h>
+
+struct timeval;
+
+#define RTLSDR_CTRL_WRITE_MAX	8	/* largest write that can be batched */
+
+/* vendor control request queued for write_batch(), an OUT request unless
+ * in is set, which marks a dummy read whose data is discarded */
+typedef struct rtlsdr_ctrl_write {
+	uint16_t value;
+	uint16_t index;
+	uint16_t len;
+	uint8_t in;
+	unsigned char data[RTLSDR_CTRL_WRITE_MAX];
+} rtlsdr_ctrl_write_t;
+
+/*
+ * Transport the register and sample I/O of a device goes through. The
+ * functions follow the semantics of their libusb counterparts, including
+ * the return values. Asynchronous transfers are plain libusb transfers,
+ * a transport other than USB completes them from handle_events() by
+ * calling their callback. write_batch() performs a sequence of control
+ * requests in order and returns 0 or the error of the first one that
+ * failed.
+ */
+typedef struct rtlsdr_transport {
+	int (*control)(void *priv, uint8_t request_type, uint8_t request,
+		       uint16_t value, uint16_t index, unsigned char *data,
+		       uint16_t len, unsigned int timeout);
+	int (*write_batch)(void *priv, const rtlsdr_ctrl_write_t *writes,
+			   int num, unsigned int timeout);
+	int (*bulk)(void *priv, unsigned char endpoint, unsigned char *data,
+		    int len, int *actual_len, unsigned int timeout);
+	int (*submit)(void *priv, struct libusb_transfer *xfer);
+	int (*cancel)(void *priv, struct libusb_transfer *xfer);
+	int (*handle_events)(void *priv, struct timeval *tv, int *completed);
+	void (*interrupt)(void *priv);
+	int (*get_strings)(void *priv, char *manufact, char *product,
+			   char *serial);
+	void (*close)(void *priv);
+} rtlsdr_transport_t;
+
+/* simulated RTL2832U with an R820T tuner, see rtlsdr_sim.c */
+extern const rtlsdr_transport_t rtlsdr_sim_transport;
+
+void *rtlsdr_sim_create(const char *args);
+void *rtlsdr_sim_create_file(const char *path, int pace);
+
+#endif
@@ -219,4 +219,8 @@ int e4k_dc_offset_gen_table(struct e4k_state *e4k);
 int e4k_set_lna_gain(struct e4k_state *e4k, int32_t gain);
 int e4k_enable_manual_gain(struct e4k_state *e4k, uint8_t manual);
 int e4k_set_enh_gain(struct e4k_state *e4k, int32_t gain);
+
+struct tuner_reg_image;
+int e4k_gain_image(struct tuner_reg_image *img, int32_t lna_gain,
+		   int8_t mixer_gain);
 #endif /* _E4K_TUNER_H */
@@ -33,4 +33,7 @@ int fc0012_init(void *dev);
 int fc0012_set_params(void *dev, uint32_t freq, uint32_t bandwidth);
 int fc0012_set_gain(void *dev, int gain);
 
+struct tuner_reg_image;
+int fc0012_gain_image(struct tuner_reg_image *img, int gain);
+
 #endif
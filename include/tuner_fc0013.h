@@ -34,4 +34,7 @@ int fc0013_set_params(void *dev, uint32_t freq, uint32_t bandwidth);
 int fc0013_set_gain_mode(void *dev, int manual);
 int fc0013_set_lna_gain(void *dev, int gain);
 
+struct tuner_reg_image;
+int fc0013_lna_gain_image(struct tuner_reg_image *img, int gain);
+
 #endif
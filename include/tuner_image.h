@@ -0,0 +1,38 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TUNER_IMAGE_H
+#define __TUNER_IMAGE_H
+
+#include <stdint.h>
+
+#define TUNER_IMAGE_REGS	4
+
+/*
+ * Register values of one tuner setting, computed by the tuner driver
+ * without touching the device so the library can write them later in a
+ * single batch. Only the bits set in mask are owned by the setting.
+ */
+struct tuner_reg_image {
+	uint8_t i2c_addr;
+	uint8_t num;
+	uint8_t reg[TUNER_IMAGE_REGS];
+	uint8_t val[TUNER_IMAGE_REGS];
+	uint8_t mask[TUNER_IMAGE_REGS];
+};
+
+#endif
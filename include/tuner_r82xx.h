@@ -64,6 +64,8 @@ enum r82xx_xtal_cap_value {
 	XTAL_HIGH_CAP_0P
 };
 
+struct rtlsdr_model;
+
 struct r82xx_config {
 	uint8_t i2c_addr;
 	uint32_t xtal;
@@ -83,6 +85,9 @@ struct r82xx_priv {
 	uint8_t				fil_cal_code;
 	uint8_t				input;
 	int				has_lock;
+	uint32_t			lock_timeout_us; /* PLL lock wait */
+	uint32_t			lock_poll_us;
+	uint64_t			lock_ns; /* lock wait of the last tune */
 	int				init_done;
 
 	/* Store current mode */
@@ -92,6 +97,7 @@ struct r82xx_priv {
 	uint32_t			bw;	/* in MHz */
 
 	void *rtl_dev;
+	const struct rtlsdr_model	*model;	/* board quirks */
 };
 
 struct r82xx_freq_range {
@@ -104,6 +110,14 @@ struct r82xx_freq_range {
 	uint8_t		xtal_cap0p;
 };
 
+/* registers programmed for a frequency, see r82xx_make_plan() */
+struct r82xx_freq_plan {
+	uint32_t	freq;		/* Hz, as passed to r82xx_set_freq() */
+	int		valid;		/* the PLL can be set for freq */
+	uint8_t		img[NUM_REGS];
+	uint8_t		mask[NUM_REGS];	/* bits of img to be written */
+};
+
 enum r82xx_delivery_system {
 	SYS_UNDEFINED,
 	SYS_DVBT,
@@ -114,6 +128,10 @@ enum r82xx_delivery_system {
 int r82xx_standby(struct r82xx_priv *priv);
 int r82xx_init(struct r82xx_priv *priv);
 int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq);
+int r82xx_make_plan(struct r82xx_priv *priv, struct r82xx_freq_plan *plan,
+		    unsigned int num);
+int r82xx_set_freq_plan(struct r82xx_priv *priv,
+			const struct r82xx_freq_plan *plan);
 int r82xx_set_gain(struct r82xx_priv *priv, int set_manual_gain, int gain);
 int r82xx_set_bandwidth(struct r82xx_priv *priv, int bandwidth,  uint32_t rate);
 
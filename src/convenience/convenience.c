@@ -245,64 +245,135 @@ int verbose_reset_buffer(rtlsdr_dev_t *dev)
 	return r;
 }
 
-int verbose_device_search(char *s)
+/* USB port path of a device as taken by rtlsdr_open_by_path() */
+static void device_path(const rtlsdr_device_info_t *info, char *path, int len)
+{
+	int i, n;
+	n = snprintf(path, len, "%u", info->bus);
+	for (i = 0; i < info->port_depth && n < len; i++) {
+		n += snprintf(path + n, len - n, "%c%u", i ? '.' : '-',
+			info->port_path[i]);
+	}
+}
+
+/* pick the closest matching device of a snapshot, prints the devices */
+static int device_find(char *s, rtlsdr_device_info_t *out)
 {
 	int i, device_count, device, offset;
 	char *s2;
-	char vendor[256], product[256], serial[256];
-	device_count = rtlsdr_get_device_count();
-	if (!device_count) {
+	char path[32];
+	rtlsdr_device_info_t *list;
+	uint32_t count;
+	if (rtlsdr_get_device_list(&list, &count) < 0 || !count) {
 		fprintf(stderr, "No supported devices found.\n");
 		return -1;
 	}
+	device_count = (int)count;
 	fprintf(stderr, "Found %d device(s):\n", device_count);
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		fprintf(stderr, "  %d:  %s, %s, SN: %s\n", i, vendor, product, serial);
+		device_path(&list[i], path, sizeof(path));
+		fprintf(stderr, "  %d:  %s, %s, SN: %s, USB: %s\n", i,
+			list[i].manufact, list[i].product, list[i].serial, path);
 	}
 	fprintf(stderr, "\n");
+	device = -1;
 	/* does string look like raw id number */
-	device = (int)strtol(s, &s2, 0);
-	if (s2[0] == '\0' && device >= 0 && device < device_count) {
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+	i = (int)strtol(s, &s2, 0);
+	if (s2[0] == '\0' && i >= 0 && i < device_count) {
+		device = i;
+		goto found;
+	}
+	/* does string exact match a USB port path */
+	for (i = 0; i < device_count; i++) {
+		device_path(&list[i], path, sizeof(path));
+		if (!list[i].port_depth || strcmp(s, path) != 0) {
+			continue;}
+		device = i;
+		goto found;
 	}
 	/* does string exact match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		if (strcmp(s, serial) != 0) {
+		if (strcmp(s, list[i].serial) != 0) {
 			continue;}
 		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		goto found;
 	}
 	/* does string prefix match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		if (strncmp(s, serial, strlen(s)) != 0) {
+		if (strncmp(s, list[i].serial, strlen(s)) != 0) {
 			continue;}
 		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		goto found;
 	}
 	/* does string suffix match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		offset = strlen(serial) - strlen(s);
+		offset = strlen(list[i].serial) - strlen(s);
 		if (offset < 0) {
 			continue;}
-		if (strncmp(s, serial+offset, strlen(s)) != 0) {
+		if (strncmp(s, list[i].serial+offset, strlen(s)) != 0) {
 			continue;}
 		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		goto found;
 	}
 	fprintf(stderr, "No matching devices found.\n");
+	rtlsdr_free_device_list(list);
 	return -1;
+found:
+	fprintf(stderr, "Using device %d: %s\n", device, list[device].name);
+	*out = list[device];
+	rtlsdr_free_device_list(list);
+	return device;
+}
+
+int verbose_device_search(char *s)
+{
+	rtlsdr_device_info_t info;
+	return device_find(s, &info);
+}
+
+int verbose_device_open(rtlsdr_dev_t **dev, char *s)
+{
+	int r, device, realtime = 1;
+	char *path = NULL, *end;
+	char usb_path[32];
+	rtlsdr_device_info_t info;
+	if (strncmp(s, "file:", 5) == 0) {
+		path = s + 5;}
+	if (strncmp(s, "fastfile:", 9) == 0) {
+		path = s + 9;
+		realtime = 0;}
+	if (path) {
+		r = rtlsdr_open_file(dev, path, realtime);
+		if (r < 0) {
+			fprintf(stderr, "Failed to open capture %s.\n", path);
+			return r;}
+		fprintf(stderr, "Replaying %s%s\n", path,
+			realtime ? "" : " as fast as possible");
+		return 0;
+	}
+	if (getenv("RTLSDR_STATE_FILE")) {
+		rtlsdr_set_state_file(getenv("RTLSDR_STATE_FILE"));}
+	/* a full serial number is looked up and opened in one enumeration,
+	 * anything else is matched against the list of devices */
+	strtol(s, &end, 0);
+	if (end[0] != '\0' && !(strchr(s, '-') &&
+	    strspn(s, "0123456789-.") == strlen(s)) &&
+	    rtlsdr_open_by_serial(dev, s) == 0) {
+		fprintf(stderr, "Using device with serial %s\n", s);
+		return 0;
+	}
+	device = device_find(s, &info);
+	if (device < 0) {
+		return -1;}
+	/* the port stays the same if the devices enumerate in another order */
+	if (info.port_depth) {
+		device_path(&info, usb_path, sizeof(usb_path));
+		r = rtlsdr_open_by_path(dev, usb_path);
+	} else {
+		r = rtlsdr_open(dev, (uint32_t)device);}
+	if (r < 0) {
+		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", device);}
+	return r;
 }
 
 // vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
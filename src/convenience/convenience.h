@@ -140,3 +140,17 @@ int verbose_reset_buffer(rtlsdr_dev_t *dev);
 
 int verbose_device_search(char *s);
 
+/*!
+ * Open the closest matching device, or replay a capture when the string
+ * is "file:<path>" (at the sample rate) or "fastfile:<path>" (as fast as
+ * possible). A full serial number is opened right away, without listing
+ * the devices first. The state file named by the RTLSDR_STATE_FILE
+ * environment variable is used to reopen a known dongle faster.
+ *
+ * \param dev the device handle
+ * \param s a string to be parsed
+ * \return 0 on success
+ */
+
+int verbose_device_open(rtlsdr_dev_t **dev, char *s);
+
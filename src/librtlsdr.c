@@ -22,11 +22,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/time.h>
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+#include <pthread.h>
 #include <libusb.h>
 
 /*
@@ -39,14 +42,52 @@
 #define LIBUSB_CALL
 #endif
 
+/*
+ * Lock-free primitives used by the buffer rings between the libusb event
+ * thread and the consumer thread(s).
+ */
+#ifdef _MSC_VER
+#include <stdint.h>
+#include <intrin.h>
+#define rtlsdr_load32(p)	((uint32_t)_InterlockedOr((volatile long *)(p), 0))
+#define rtlsdr_store32(p, v)	_InterlockedExchange((volatile long *)(p), (long)(v))
+#define rtlsdr_add32(p, v)	_InterlockedExchangeAdd((volatile long *)(p), (long)(v))
+#define rtlsdr_load64(p)	((uint64_t)_InterlockedCompareExchange64((volatile __int64 *)(p), 0, 0))
+#define rtlsdr_store64(p, v)	_InterlockedExchange64((volatile __int64 *)(p), (__int64)(v))
+#define rtlsdr_fence()		MemoryBarrier()
+static __inline int rtlsdr_cas32(uint32_t *p, uint32_t *expected, uint32_t val)
+{
+	uint32_t old = (uint32_t)_InterlockedCompareExchange((volatile long *)p,
+							     (long)val,
+							     (long)*expected);
+	if (old == *expected)
+		return 1;
+
+	*expected = old;
+	return 0;
+}
+#else
+#define rtlsdr_load32(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define rtlsdr_store32(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define rtlsdr_add32(p, v)	__atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define rtlsdr_load64(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define rtlsdr_store64(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define rtlsdr_cas32(p, e, v)	__atomic_compare_exchange_n((p), (e), (v), 0, \
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define rtlsdr_fence()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
 /* two raised to the power of n */
 #define TWO_POW(n)		((double)(1ULL<<(n)))
 
 #include "rtl-sdr.h"
+#include "rtlsdr_model.h"
+#include "rtlsdr_transport.h"
 #include "tuner_e4k.h"
 #include "tuner_fc0012.h"
 #include "tuner_fc0013.h"
 #include "tuner_fc2580.h"
+#include "tuner_image.h"
 #include "tuner_r82xx.h"
 
 typedef struct rtlsdr_tuner_iface {
@@ -58,6 +99,8 @@ typedef struct rtlsdr_tuner_iface {
 	int (*set_gain)(void *, int gain /* tenth dB */);
 	int (*set_if_gain)(void *, int stage, int gain /* tenth dB */);
 	int (*set_gain_mode)(void *, int manual);
+	/* register image of a gain step, see struct tuner_reg_image */
+	int (*gain_image)(void *, int gain, struct tuner_reg_image *img);
 } rtlsdr_tuner_iface_t;
 
 enum rtlsdr_async_status {
@@ -66,6 +109,35 @@ enum rtlsdr_async_status {
 	RTLSDR_RUNNING
 };
 
+/* devices sharing one libusb context and event thread */
+struct rtlsdr_ctx {
+	libusb_context *usb;
+	pthread_t thread;
+	pthread_mutex_t lock; /* protects the device list */
+	rtlsdr_dev_t *devs;
+	uint32_t running;
+};
+
+/* bounded ring of buffer indices, multiple producers, single consumer */
+struct rtlsdr_ring_cell {
+	uint32_t seq;
+	uint32_t val;
+};
+
+struct rtlsdr_ring {
+	struct rtlsdr_ring_cell *cell;
+	uint32_t mask; /* size - 1, size is a power of two */
+	uint32_t head; /* claimed by the producers */
+	uint32_t tail; /* advanced by the consumer only */
+};
+
+/* a sample buffer of the pool, passed as user_data of its transfer */
+struct rtlsdr_block {
+	rtlsdr_buffer_t pub; /* must be the first member */
+	rtlsdr_dev_t *dev;
+	uint32_t idx;
+};
+
 #define FIR_LEN 16
 
 /*
@@ -86,18 +158,82 @@ static const int fir_default[FIR_LEN] = {
 	101, 156, 215, 273, 327, 372, 404, 421	/* 12 bit signed */
 };
 
+#define WRITE_BATCH_LEN	32 /* register writes queued before a flush */
+#define DEMOD_SHADOW_PAGES	5 /* demod register pages mirrored */
+#define SETTLE_STEPS_MAX	16
+#define GAIN_IMAGES_MAX	32
+
+/* time it takes the signal to settle after a tuning step */
+struct rtlsdr_settle {
+	uint32_t step; /* Hz */
+	uint32_t ns;
+};
+
 struct rtlsdr_dev {
 	libusb_context *ctx;
+	rtlsdr_ctx_t *group; /* owner of ctx, if shared */
+	rtlsdr_dev_t *group_next;
 	struct libusb_device_handle *devh;
+	const rtlsdr_transport_t *tp; /* register and sample I/O */
+	void *tp_priv;
+	/* register writes queued between _rtlsdr_batch_begin() and end */
+	int batch_depth;
+	int batch_num;
+	int batch_err;
+	rtlsdr_ctrl_write_t batch[WRITE_BATCH_LEN];
+	/* last values written to the demod registers */
+	uint8_t demod_shadow[DEMOD_SHADOW_PAGES][256];
+	uint8_t demod_shadow_ok[DEMOD_SHADOW_PAGES][256 / 8];
+	int repeater_depth; /* open rtlsdr_begin_tuner_batch() sessions */
 	uint32_t xfer_buf_num;
 	uint32_t xfer_buf_len;
+	uint32_t xfer_len; /* bytes requested per transfer, <= xfer_buf_len */
+	uint32_t latency_us; /* target, 0 to use fixed transfer sizes */
+	int xfer_adaptive; /* xfer_len follows the sample rate */
 	struct libusb_transfer **xfer;
 	unsigned char **xfer_buf;
+	uint32_t buf_pool_num; /* buffers allocated, >= xfer_buf_num */
+	struct rtlsdr_block *blocks;
+	enum rtlsdr_sample_format stream_format;
+	unsigned char *conv_buf; /* converted samples of all blocks */
+	rtlsdr_iq_corr_t *iq_corr; /* applied to converted float buffers */
+	rtlsdr_ddc_t *ddc; /* down-converts them after the correction */
 	rtlsdr_read_async_cb_t cb;
+	rtlsdr_read_async_buf_cb_t buf_cb;
+	rtlsdr_read_async_ex_cb_t ex_cb;
 	void *cb_ctx;
 	enum rtlsdr_async_status async_status;
 	int async_cancel;
 	int use_zerocopy;
+	/* buffer metadata context, owned by the event thread */
+	uint64_t sample_count;
+	uint32_t pending_flags;
+	uint32_t settings_seen;
+	/* sample clock, published by the event thread under clock_seq */
+	uint32_t clock_seq;
+	uint64_t clock_index;
+	uint64_t clock_ts;
+	uint64_t retune_index; /* first sample after the last settings change */
+	/* stream statistics, written by the event thread */
+	uint64_t stat_completed;
+	uint64_t stat_errored;
+	uint32_t stat_in_flight;
+	uint32_t stat_min_in_flight;
+	uint32_t stat_cb_hist[RTLSDR_STATS_HIST_BINS];
+	uint32_t stat_jitter_hist[RTLSDR_STATS_HIST_BINS];
+	/* buffer pool context */
+	struct rtlsdr_ring free_ring; /* filled by the consumer(s) */
+	struct libusb_transfer **parked; /* waiting for a free buffer */
+	uint32_t parked_num;
+	/* stream context */
+	int stream_mode;
+	uint32_t stream_running;
+	uint32_t stream_waiting;
+	uint32_t stream_overflows;
+	struct rtlsdr_ring fill_ring; /* filled by the event thread */
+	pthread_t stream_thread;
+	pthread_mutex_t stream_lock;
+	pthread_cond_t stream_cond;
 	/* rtl demod context */
 	uint32_t rate; /* Hz */
 	uint32_t rtl_xtal; /* Hz */
@@ -112,19 +248,65 @@ struct rtlsdr_dev {
 	uint32_t offs_freq; /* Hz */
 	int corr; /* ppm */
 	int gain; /* tenth dB */
+	int gain_mode; /* manual gain enabled */
+	int agc_mode; /* rtl agc enabled */
+	uint32_t bias_tee; /* GPIOs powering a bias tee */
+	uint32_t settings_seq; /* bumped on freq, rate and gain changes */
 	struct e4k_state e4k_s;
 	struct r82xx_config r82xx_c;
 	struct r82xx_priv r82xx_p;
+	/* hop frequencies, see rtlsdr_set_freq_plan() */
+	uint32_t *plan_freq;
+	uint32_t plan_num;
+	struct r82xx_freq_plan *plan_r82xx; /* precomputed registers */
+	uint32_t plan_offs; /* offset, IF and xtal plan_r82xx is valid for */
+	uint32_t plan_if;
+	uint32_t plan_xtal;
+	/* tuner PLL lock wait and its statistics */
+	uint32_t lock_timeout_us;
+	uint32_t lock_poll_us;
+	uint32_t lock_tunes;
+	uint32_t lock_failures;
+	uint32_t lock_last_us;
+	uint32_t lock_hist[RTLSDR_STATS_HIST_BINS];
+	/* precomputed register images of the listed gain steps */
+	int gain_img_gain[GAIN_IMAGES_MAX];
+	struct tuner_reg_image gain_img[GAIN_IMAGES_MAX];
+	int gain_img_num;
+	/* last values written to the registers of the tuner at tuner_i2c_addr */
+	uint8_t tuner_i2c_addr;
+	uint8_t tuner_shadow[256];
+	uint8_t tuner_shadow_ok[256 / 8];
+	/* gain step latency */
+	uint32_t gain_steps;
+	uint32_t gain_fast_steps;
+	uint32_t gain_last_us;
+	uint32_t gain_hist[RTLSDR_STATS_HIST_BINS];
+	/* measured by rtlsdr_calibrate_settling(), ascending steps */
+	struct rtlsdr_settle settle[SETTLE_STEPS_MAX];
+	uint32_t settle_num;
 	/* status */
 	int dev_lost;
+	int auto_recover;
 	int driver_active;
 	unsigned int xfer_errors;
+	const rtlsdr_model_t *model; /* never NULL once opened */
 	char manufact[256];
 	char product[256];
+	char serial[256];
+	uint32_t index; /* at open time */
 };
 
 void rtlsdr_set_gpio_bit(rtlsdr_dev_t *dev, uint8_t gpio, int val);
 static int rtlsdr_set_if_freq(rtlsdr_dev_t *dev, uint32_t freq);
+static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev);
+static void _rtlsdr_mark_retune(rtlsdr_dev_t *dev);
+static void _rtlsdr_update_xfer_len(rtlsdr_dev_t *dev);
+static void _rtlsdr_ctx_unlink(rtlsdr_ctx_t *ctx, rtlsdr_dev_t *dev);
+static void _rtlsdr_hist_add(uint32_t *hist, uint64_t ns);
+static uint64_t _rtlsdr_monotonic_ns(void);
+static void _rtlsdr_state_store(rtlsdr_dev_t *dev);
+static void _rtlsdr_convert_block(rtlsdr_dev_t *dev, struct rtlsdr_block *block);
 
 /* generic tuner interface functions, shall be moved to the tuner implementations */
 int e4000_init(void *dev) {
@@ -171,6 +353,10 @@ int e4000_set_gain(void *dev, int gain) {
 #endif
 	return 0;
 }
+int e4000_gain_image(void *dev, int gain, struct tuner_reg_image *img) {
+	int mixgain = (gain > 340) ? 12 : 4;
+	return e4k_gain_image(img, min(300, gain - mixgain * 10), mixgain);
+}
 int e4000_set_if_gain(void *dev, int stage, int gain) {
 	rtlsdr_dev_t* devt = (rtlsdr_dev_t*)dev;
 	return e4k_if_gain_set(&devt->e4k_s, (uint8_t)stage, (int8_t)(gain / 10));
@@ -189,6 +375,9 @@ int fc0012_set_freq(void *dev, uint32_t freq) {
 }
 int fc0012_set_bw(void *dev, int bw) { return 0; }
 int _fc0012_set_gain(void *dev, int gain) { return fc0012_set_gain(dev, gain); }
+int _fc0012_gain_image(void *dev, int gain, struct tuner_reg_image *img) {
+	return fc0012_gain_image(img, gain);
+}
 int fc0012_set_gain_mode(void *dev, int manual) { return 0; }
 
 int _fc0013_init(void *dev) { return fc0013_init(dev); }
@@ -198,6 +387,9 @@ int fc0013_set_freq(void *dev, uint32_t freq) {
 }
 int fc0013_set_bw(void *dev, int bw) { return 0; }
 int _fc0013_set_gain(void *dev, int gain) { return fc0013_set_lna_gain(dev, gain); }
+int _fc0013_gain_image(void *dev, int gain, struct tuner_reg_image *img) {
+	return fc0013_lna_gain_image(img, gain);
+}
 
 int fc2580_init(void *dev) { return fc2580_Initialize(dev); }
 int fc2580_exit(void *dev) { return 0; }
@@ -211,6 +403,7 @@ int fc2580_set_gain_mode(void *dev, int manual) { return 0; }
 int r820t_init(void *dev) {
 	rtlsdr_dev_t* devt = (rtlsdr_dev_t*)dev;
 	devt->r82xx_p.rtl_dev = dev;
+	devt->r82xx_p.model = devt->model;
 
 	if (devt->tuner_type == RTLSDR_TUNER_R828D) {
 		devt->r82xx_c.i2c_addr = R828D_I2C_ADDR;
@@ -225,6 +418,8 @@ int r820t_init(void *dev) {
 	devt->r82xx_c.max_i2c_msg_len = 8;
 	devt->r82xx_c.use_predetect = 0;
 	devt->r82xx_p.cfg = &devt->r82xx_c;
+	devt->r82xx_p.lock_timeout_us = devt->lock_timeout_us;
+	devt->r82xx_p.lock_poll_us = devt->lock_poll_us;
 
 	return r82xx_init(&devt->r82xx_p);
 }
@@ -233,9 +428,31 @@ int r820t_exit(void *dev) {
 	return r82xx_standby(&devt->r82xx_p);
 }
 
+/* account the PLL lock wait of an R82xx tune, if it got that far */
+static void r820t_account_lock(rtlsdr_dev_t *devt)
+{
+	uint64_t ns = devt->r82xx_p.lock_ns;
+
+	if (ns == UINT64_MAX)
+		return;
+
+	devt->lock_tunes++;
+	devt->lock_last_us = ns / 1000;
+	if (devt->r82xx_p.has_lock)
+		_rtlsdr_hist_add(devt->lock_hist, ns);
+	else
+		devt->lock_failures++;
+}
+
 int r820t_set_freq(void *dev, uint32_t freq) {
+	int r;
 	rtlsdr_dev_t* devt = (rtlsdr_dev_t*)dev;
-	return r82xx_set_freq(&devt->r82xx_p, freq);
+
+	devt->r82xx_p.lock_ns = UINT64_MAX;
+	r = r82xx_set_freq(&devt->r82xx_p, freq);
+	r820t_account_lock(devt);
+
+	return r;
 }
 
 int r820t_set_bw(void *dev, int bw) {
@@ -263,37 +480,37 @@ int r820t_set_gain_mode(void *dev, int manual) {
 /* definition order must match enum rtlsdr_tuner */
 static rtlsdr_tuner_iface_t tuners[] = {
 	{
-		NULL, NULL, NULL, NULL, NULL, NULL, NULL /* dummy for unknown tuners */
+		NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL /* dummy for unknown tuners */
 	},
 	{
 		e4000_init, e4000_exit,
 		e4000_set_freq, e4000_set_bw, e4000_set_gain, e4000_set_if_gain,
-		e4000_set_gain_mode
+		e4000_set_gain_mode, e4000_gain_image
 	},
 	{
 		_fc0012_init, fc0012_exit,
 		fc0012_set_freq, fc0012_set_bw, _fc0012_set_gain, NULL,
-		fc0012_set_gain_mode
+		fc0012_set_gain_mode, _fc0012_gain_image
 	},
 	{
 		_fc0013_init, fc0013_exit,
 		fc0013_set_freq, fc0013_set_bw, _fc0013_set_gain, NULL,
-		fc0013_set_gain_mode
+		fc0013_set_gain_mode, _fc0013_gain_image
 	},
 	{
 		fc2580_init, fc2580_exit,
 		_fc2580_set_freq, fc2580_set_bw, fc2580_set_gain, NULL,
-		fc2580_set_gain_mode
+		fc2580_set_gain_mode, NULL
 	},
 	{
 		r820t_init, r820t_exit,
 		r820t_set_freq, r820t_set_bw, r820t_set_gain, NULL,
-		r820t_set_gain_mode
+		r820t_set_gain_mode, NULL
 	},
 	{
 		r820t_init, r820t_exit,
 		r820t_set_freq, r820t_set_bw, r820t_set_gain, NULL,
-		r820t_set_gain_mode
+		r820t_set_gain_mode, NULL
 	},
 };
 
@@ -351,9 +568,37 @@ static rtlsdr_dongle_t known_devices[] = {
 	{ 0x1f4d, 0xd803, "PROlectrix DV107669" },
 };
 
+/* boards without any quirks */
+static const rtlsdr_model_t generic_model = {
+	NULL, NULL, NULL, 0, 0, 0, { { 0, 0 } }, 0, 0, 0, -1
+};
+
+/*
+ * Boards needing special treatment, identified by the manufacturer and
+ * product strings in their EEPROM.
+ */
+static const rtlsdr_model_t known_models[] = {
+	{
+		"RTLSDRBlog", "Blog V4", "RTL-SDR Blog V4",
+		1,
+		28800000, 28800000,
+		{ { 0, 2200000 }, { 85000000, 112000000 },
+		  { 172000000, 242000000 } }, 3,
+		28800000, 250000000, 5
+	},
+};
+
 #define DEFAULT_BUF_NUMBER	15
 #define DEFAULT_BUF_LENGTH	(16 * 32 * 512)
 
+/* transfer sizing for a latency target */
+#define MAX_SAMP_RATE		3200000
+#define MIN_LATENCY_BUF_NUMBER	4
+#define MAX_LATENCY_BUF_LENGTH	(4 * DEFAULT_BUF_LENGTH)
+#define LATENCY_SLACK_US	200000 /* host stall covered by transfers */
+#define MIN_SLACK_LATENCY_US	1000 /* shortest target that gets full slack */
+#define MAX_LATENCY_BUF_NUMBER	(LATENCY_SLACK_US / MIN_SLACK_LATENCY_US)
+
 #define DEF_RTL_XTAL_FREQ	28800000
 #define MIN_RTL_XTAL_FREQ	(DEF_RTL_XTAL_FREQ - 1000)
 #define MAX_RTL_XTAL_FREQ	(DEF_RTL_XTAL_FREQ + 1000)
@@ -402,12 +647,146 @@ enum blocks {
 	IICB			= 6,
 };
 
+/*
+ * Demod register shadow. Writes go through to the device and are
+ * remembered, a write of the value a register already holds is skipped.
+ * Whatever may have reset the demod has to invalidate the shadow.
+ */
+static void _rtlsdr_demod_shadow_invalidate(rtlsdr_dev_t *dev)
+{
+	memset(dev->demod_shadow_ok, 0, sizeof(dev->demod_shadow_ok));
+}
+
+static int _rtlsdr_demod_shadow_equal(rtlsdr_dev_t *dev, uint8_t page,
+				      uint16_t addr, const uint8_t *data,
+				      uint8_t len)
+{
+	int i, reg;
+
+	if (page >= DEMOD_SHADOW_PAGES || addr + len > 256)
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		reg = addr + i;
+		if (!(dev->demod_shadow_ok[page][reg >> 3] & (1 << (reg & 7))) ||
+		    dev->demod_shadow[page][reg] != data[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/* remember a written value, or forget the register if valid is 0 */
+static void _rtlsdr_demod_shadow_store(rtlsdr_dev_t *dev, uint8_t page,
+				       uint16_t addr, const uint8_t *data,
+				       uint8_t len, int valid)
+{
+	int i, reg;
+
+	if (page >= DEMOD_SHADOW_PAGES || addr + len > 256)
+		return;
+
+	for (i = 0; i < len; i++) {
+		reg = addr + i;
+		dev->demod_shadow[page][reg] = data[i];
+		if (valid)
+			dev->demod_shadow_ok[page][reg >> 3] |= 1 << (reg & 7);
+		else
+			dev->demod_shadow_ok[page][reg >> 3] &= ~(1 << (reg & 7));
+	}
+}
+
+/*
+ * Register write batching. Between _rtlsdr_batch_begin() and
+ * _rtlsdr_batch_end() writes of up to RTLSDR_CTRL_WRITE_MAX bytes are
+ * queued and handed to the transport in one go, which submits them
+ * back-to-back instead of waiting a round trip for each. Any read flushes
+ * the queue first, so the device sees the same order of requests. The
+ * dummy read that follows every demod write is queued along with it.
+ *
+ * A queued write cannot report its own outcome, it returns the error of
+ * an earlier flush of the batch if there was one, and _rtlsdr_batch_end()
+ * returns the first error of all of them.
+ */
+static int _rtlsdr_batch_flush(rtlsdr_dev_t *dev)
+{
+	int num = dev->batch_num;
+	int r = 0;
+
+	if (!num)
+		return 0;
+
+	dev->batch_num = 0;
+
+	r = dev->tp->write_batch(dev->tp_priv, dev->batch, num, CTRL_TIMEOUT);
+	if (r < 0) {
+		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
+		if (!dev->batch_err)
+			dev->batch_err = r;
+		/* the queued demod and tuner writes were stored optimistically */
+		_rtlsdr_demod_shadow_invalidate(dev);
+		memset(dev->tuner_shadow_ok, 0, sizeof(dev->tuner_shadow_ok));
+	}
+
+	return r;
+}
+
+/* queue a control write, or a dummy read if in is set, while batching,
+ * returns 0 if the caller has to do the transfer itself */
+static int _rtlsdr_batch_add(rtlsdr_dev_t *dev, int in, uint16_t value,
+			     uint16_t index, const uint8_t *data, uint16_t len)
+{
+	rtlsdr_ctrl_write_t *w;
+
+	if (!dev->batch_depth)
+		return 0;
+
+	if (len > RTLSDR_CTRL_WRITE_MAX || dev->batch_num == WRITE_BATCH_LEN)
+		_rtlsdr_batch_flush(dev);
+
+	if (len > RTLSDR_CTRL_WRITE_MAX)
+		return 0;
+
+	w = &dev->batch[dev->batch_num++];
+	w->value = value;
+	w->index = index;
+	w->len = len;
+	w->in = in ? 1 : 0;
+	if (!in)
+		memcpy(w->data, data, len);
+
+	return 1;
+}
+
+static void _rtlsdr_batch_begin(rtlsdr_dev_t *dev)
+{
+	dev->batch_depth++;
+}
+
+/* flushes the outermost batch, returns the first error of its writes */
+static int _rtlsdr_batch_end(rtlsdr_dev_t *dev)
+{
+	int r;
+
+	if (--dev->batch_depth)
+		return 0;
+
+	_rtlsdr_batch_flush(dev);
+
+	r = dev->batch_err;
+	dev->batch_err = 0;
+
+	return r < 0 ? -1 : 0;
+}
+
 int rtlsdr_read_array(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_t *array, uint8_t len)
 {
 	int r;
 	uint16_t index = (block << 8);
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, array, len, CTRL_TIMEOUT);
+	_rtlsdr_batch_flush(dev);
+
+	r = dev->tp->control(dev->tp_priv, CTRL_IN, 0, addr, index, array, len, CTRL_TIMEOUT);
 #if 0
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -420,7 +799,10 @@ int rtlsdr_write_array(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_t
 	int r;
 	uint16_t index = (block << 8) | 0x10;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, array, len, CTRL_TIMEOUT);
+	if (_rtlsdr_batch_add(dev, 0, addr, index, array, len))
+		return dev->batch_err ? dev->batch_err : len;
+
+	r = dev->tp->control(dev->tp_priv, CTRL_OUT, 0, addr, index, array, len, CTRL_TIMEOUT);
 #if 0
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -428,14 +810,57 @@ int rtlsdr_write_array(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_t
 	return r;
 }
 
-int rtlsdr_i2c_write_reg(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t reg, uint8_t val)
+/*
+ * Tuner register shadow. Single register writes to the tuner the gain images
+ * belong to are recorded, so applying an image needs no read-modify-write of
+ * the registers it touches. Whether longer writes auto-increment the register
+ * address is up to the tuner, so they forget all of the shadow.
+ */
+static void _rtlsdr_tuner_shadow_write(rtlsdr_dev_t *dev, const uint8_t *buf,
+				       int len, int valid)
+{
+	uint8_t reg;
+
+	/* only addresses a register for reading */
+	if (len < 2)
+		return;
+
+	if (len > 2) {
+		memset(dev->tuner_shadow_ok, 0, sizeof(dev->tuner_shadow_ok));
+		return;
+	}
+
+	reg = buf[0];
+	if (valid) {
+		dev->tuner_shadow[reg] = buf[1];
+		dev->tuner_shadow_ok[reg >> 3] |= 1 << (reg & 7);
+	} else {
+		dev->tuner_shadow_ok[reg >> 3] &= ~(1 << (reg & 7));
+	}
+}
+
+int rtlsdr_i2c_write(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t *buffer, int len)
 {
 	uint16_t addr = i2c_addr;
+	int r;
+
+	if (!dev)
+		return -1;
+
+	r = rtlsdr_write_array(dev, IICB, addr, buffer, len);
+	if (dev->gain_img_num && i2c_addr == dev->tuner_i2c_addr)
+		_rtlsdr_tuner_shadow_write(dev, buffer, len, r == len);
+
+	return r;
+}
+
+int rtlsdr_i2c_write_reg(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t reg, uint8_t val)
+{
 	uint8_t data[2];
 
 	data[0] = reg;
 	data[1] = val;
-	return rtlsdr_write_array(dev, IICB, addr, (uint8_t *)&data, 2);
+	return rtlsdr_i2c_write(dev, i2c_addr, data, 2);
 }
 
 uint8_t rtlsdr_i2c_read_reg(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t reg)
@@ -449,16 +874,6 @@ uint8_t rtlsdr_i2c_read_reg(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t reg)
 	return data;
 }
 
-int rtlsdr_i2c_write(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t *buffer, int len)
-{
-	uint16_t addr = i2c_addr;
-
-	if (!dev)
-		return -1;
-
-	return rtlsdr_write_array(dev, IICB, addr, buffer, len);
-}
-
 int rtlsdr_i2c_read(rtlsdr_dev_t *dev, uint8_t i2c_addr, uint8_t *buffer, int len)
 {
 	uint16_t addr = i2c_addr;
@@ -476,7 +891,9 @@ uint16_t rtlsdr_read_reg(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_
 	uint16_t index = (block << 8);
 	uint16_t reg;
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
+	_rtlsdr_batch_flush(dev);
+
+	r = dev->tp->control(dev->tp_priv, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -500,7 +917,10 @@ int rtlsdr_write_reg(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint16_t v
 
 	data[1] = val & 0xff;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
+	if (_rtlsdr_batch_add(dev, 0, addr, index, data, len))
+		return dev->batch_err ? dev->batch_err : len;
+
+	r = dev->tp->control(dev->tp_priv, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -517,7 +937,9 @@ uint16_t rtlsdr_demod_read_reg(rtlsdr_dev_t *dev, uint8_t page, uint16_t addr, u
 	uint16_t reg;
 	addr = (addr << 8) | 0x20;
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
+	_rtlsdr_batch_flush(dev);
+
+	r = dev->tp->control(dev->tp_priv, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -532,6 +954,7 @@ int rtlsdr_demod_write_reg(rtlsdr_dev_t *dev, uint8_t page, uint16_t addr, uint1
 	int r;
 	unsigned char data[2];
 	uint16_t index = 0x10 | page;
+	uint16_t reg = addr;
 	addr = (addr << 8) | 0x20;
 
 	if (len == 1)
@@ -541,11 +964,23 @@ int rtlsdr_demod_write_reg(rtlsdr_dev_t *dev, uint8_t page, uint16_t addr, uint1
 
 	data[1] = val & 0xff;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
+	if (_rtlsdr_demod_shadow_equal(dev, page, reg, data, len))
+		return 0;
+
+	if (_rtlsdr_batch_add(dev, 0, addr, index, data, len)) {
+		/* stored optimistically, a failed flush drops the shadow */
+		_rtlsdr_demod_shadow_store(dev, page, reg, data, len, 1);
+		_rtlsdr_batch_add(dev, 1, (0x01 << 8) | 0x20, 0x0a, NULL, 1);
+		return dev->batch_err ? -1 : 0;
+	}
+
+	r = dev->tp->control(dev->tp_priv, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
 
+	_rtlsdr_demod_shadow_store(dev, page, reg, data, len, r == len);
+
 	rtlsdr_demod_read_reg(dev, 0x0a, 0x01, 1);
 
 	return (r == len) ? 0 : -1;
@@ -574,6 +1009,10 @@ void rtlsdr_set_gpio_output(rtlsdr_dev_t *dev, uint8_t gpio)
 
 void rtlsdr_set_i2c_repeater(rtlsdr_dev_t *dev, int on)
 {
+	/* within a tuner batch the repeater is closed by its end */
+	if (!on && dev->repeater_depth)
+		return;
+
 	rtlsdr_demod_write_reg(dev, 1, 0x01, on ? 0x18 : 0x10, 1);
 }
 
@@ -602,18 +1041,24 @@ int rtlsdr_set_fir(rtlsdr_dev_t *dev)
 		fir[8+i*3/2+2] = val1;
 	}
 
+	_rtlsdr_batch_begin(dev);
+
 	for (i = 0; i < (int)sizeof(fir); i++) {
-		if (rtlsdr_demod_write_reg(dev, 1, 0x1c + i, fir[i], 1))
-				return -1;
+		if (rtlsdr_demod_write_reg(dev, 1, 0x1c + i, fir[i], 1)) {
+			_rtlsdr_batch_end(dev);
+			return -1;
+		}
 	}
 
-	return 0;
+	return _rtlsdr_batch_end(dev);
 }
 
 void rtlsdr_init_baseband(rtlsdr_dev_t *dev)
 {
 	unsigned int i;
 
+	_rtlsdr_batch_begin(dev);
+
 	/* initialize USB */
 	rtlsdr_write_reg(dev, USBB, USB_SYSCTL, 0x09, 1);
 	rtlsdr_write_reg(dev, USBB, USB_EPA_MAXPKT, 0x0002, 2);
@@ -626,6 +1071,7 @@ void rtlsdr_init_baseband(rtlsdr_dev_t *dev)
 	/* reset demod (bit 3, soft_rst) */
 	rtlsdr_demod_write_reg(dev, 1, 0x01, 0x14, 1);
 	rtlsdr_demod_write_reg(dev, 1, 0x01, 0x10, 1);
+	_rtlsdr_demod_shadow_invalidate(dev);
 
 	/* disable spectrum inversion and adjacent channel rejection */
 	rtlsdr_demod_write_reg(dev, 1, 0x15, 0x00, 1);
@@ -662,6 +1108,8 @@ void rtlsdr_init_baseband(rtlsdr_dev_t *dev)
 
 	/* disable 4.096 MHz clock output on pin TP_CK0 */
 	rtlsdr_demod_write_reg(dev, 0, 0x0d, 0x83, 1);
+
+	_rtlsdr_batch_end(dev);
 }
 
 int rtlsdr_deinit_baseband(rtlsdr_dev_t *dev)
@@ -679,6 +1127,7 @@ int rtlsdr_deinit_baseband(rtlsdr_dev_t *dev)
 
 	/* poweroff demodulator and ADCs */
 	rtlsdr_write_reg(dev, SYSB, DEMOD_CTL, 0x20, 1);
+	_rtlsdr_demod_shadow_invalidate(dev);
 
 	return r;
 }
@@ -699,12 +1148,14 @@ static int rtlsdr_set_if_freq(rtlsdr_dev_t *dev, uint32_t freq)
 
 	if_freq = ((freq * TWO_POW(22)) / rtl_xtal) * (-1);
 
+	_rtlsdr_batch_begin(dev);
 	tmp = (if_freq >> 16) & 0x3f;
 	r = rtlsdr_demod_write_reg(dev, 1, 0x19, tmp, 1);
 	tmp = (if_freq >> 8) & 0xff;
 	r |= rtlsdr_demod_write_reg(dev, 1, 0x1a, tmp, 1);
 	tmp = if_freq & 0xff;
 	r |= rtlsdr_demod_write_reg(dev, 1, 0x1b, tmp, 1);
+	r |= _rtlsdr_batch_end(dev);
 
 	return r;
 }
@@ -725,7 +1176,7 @@ int rtlsdr_set_sample_freq_correction(rtlsdr_dev_t *dev, int ppm)
 
 int rtlsdr_set_xtal_freq(rtlsdr_dev_t *dev, uint32_t rtl_freq, uint32_t tuner_freq)
 {
-	int r = 0;
+	int r = 0, changed = 0;
 
 	if (!dev)
 		return -1;
@@ -736,6 +1187,7 @@ int rtlsdr_set_xtal_freq(rtlsdr_dev_t *dev, uint32_t rtl_freq, uint32_t tuner_fr
 
 	if (rtl_freq > 0 && dev->rtl_xtal != rtl_freq) {
 		dev->rtl_xtal = rtl_freq;
+		changed = 1;
 
 		/* update xtal-dependent settings */
 		if (dev->rate)
@@ -747,6 +1199,7 @@ int rtlsdr_set_xtal_freq(rtlsdr_dev_t *dev, uint32_t rtl_freq, uint32_t tuner_fr
 			dev->tun_xtal = dev->rtl_xtal;
 		else
 			dev->tun_xtal = tuner_freq;
+		changed = 1;
 
 		/* read corrected clock value into e4k and r82xx structure */
 		if (rtlsdr_get_xtal_freq(dev, NULL, &dev->e4k_s.vco.fosc) ||
@@ -758,6 +1211,9 @@ int rtlsdr_set_xtal_freq(rtlsdr_dev_t *dev, uint32_t rtl_freq, uint32_t tuner_fr
 			r = rtlsdr_set_center_freq(dev, dev->freq);
 	}
 
+	if (changed)
+		_rtlsdr_state_store(dev);
+
 	return r;
 }
 
@@ -777,17 +1233,183 @@ int rtlsdr_get_xtal_freq(rtlsdr_dev_t *dev, uint32_t *rtl_freq, uint32_t *tuner_
 	return 0;
 }
 
-int rtlsdr_get_usb_strings(rtlsdr_dev_t *dev, char *manufact, char *product,
-			    char *serial)
+/* USB transport, priv is the device itself */
+static int _rtlsdr_usb_control(void *priv, uint8_t request_type,
+			       uint8_t request, uint16_t value, uint16_t index,
+			       unsigned char *data, uint16_t len,
+			       unsigned int timeout)
+{
+	rtlsdr_dev_t *dev = priv;
+
+	return libusb_control_transfer(dev->devh, request_type, request, value,
+				       index, data, len, timeout);
+}
+
+struct rtlsdr_usb_batch {
+	int pending;
+	int done; /* set once nothing is pending */
+	int err;
+};
+
+static void LIBUSB_CALL _rtlsdr_usb_batch_cb(struct libusb_transfer *xfer)
+{
+	struct rtlsdr_usb_batch *b = xfer->user_data;
+
+	if (LIBUSB_TRANSFER_COMPLETED != xfer->status && !b->err) {
+		switch (xfer->status) {
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			b->err = LIBUSB_ERROR_TIMEOUT;
+			break;
+		case LIBUSB_TRANSFER_STALL:
+			b->err = LIBUSB_ERROR_PIPE;
+			break;
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			b->err = LIBUSB_ERROR_NO_DEVICE;
+			break;
+		default:
+			b->err = LIBUSB_ERROR_IO;
+			break;
+		}
+	}
+
+	b->done = !--b->pending;
+}
+
+/* submit all requests at once, control transfers complete in order */
+static int _rtlsdr_usb_write_batch(void *priv,
+				   const rtlsdr_ctrl_write_t *writes, int num,
+				   unsigned int timeout)
+{
+	rtlsdr_dev_t *dev = priv;
+	const int buf_len = LIBUSB_CONTROL_SETUP_SIZE + RTLSDR_CTRL_WRITE_MAX;
+	struct libusb_transfer **xfer;
+	struct rtlsdr_usb_batch *b;
+	struct timeval tv = { 1, 0 };
+	unsigned char *buf;
+	int i, j, e, r = 0;
+	int canceled = 0;
+
+	/* the callbacks refer to b, it must outlive a failed event loop */
+	b = calloc(1, sizeof(struct rtlsdr_usb_batch));
+	xfer = calloc(num, sizeof(struct libusb_transfer *));
+	buf = malloc(num * buf_len);
+	if (!b || !xfer || !buf) {
+		free(b);
+		free(xfer);
+		free(buf);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	for (i = 0; i < num; i++) {
+		xfer[i] = libusb_alloc_transfer(0);
+		if (!xfer[i]) {
+			r = LIBUSB_ERROR_NO_MEM;
+			break;
+		}
+
+		libusb_fill_control_setup(buf + i * buf_len,
+					  writes[i].in ? CTRL_IN : CTRL_OUT, 0,
+					  writes[i].value, writes[i].index,
+					  writes[i].len);
+		if (!writes[i].in)
+			memcpy(buf + i * buf_len + LIBUSB_CONTROL_SETUP_SIZE,
+			       writes[i].data, writes[i].len);
+		libusb_fill_control_transfer(xfer[i], dev->devh,
+					     buf + i * buf_len,
+					     _rtlsdr_usb_batch_cb, b, timeout);
+
+		b->pending++;
+		r = libusb_submit_transfer(xfer[i]);
+		if (r < 0) {
+			b->pending--;
+			break;
+		}
+	}
+
+	b->done = !b->pending;
+	while (!b->done) {
+		e = libusb_handle_events_timeout_completed(dev->ctx, &tv,
+							   &b->done);
+		if (e >= 0 || e == LIBUSB_ERROR_INTERRUPTED)
+			continue;
+
+		if (!b->err)
+			b->err = e;
+
+		/* a second failure, nothing will reap the cancellations */
+		if (canceled)
+			break;
+
+		/* give up on the requests still in flight, as
+		 * libusb_control_transfer() would */
+		for (j = 0; j < i; j++)
+			libusb_cancel_transfer(xfer[j]);
+		canceled = 1;
+	}
+
+	r = b->err ? b->err : r;
+
+	/* transfers still owned by libusb keep their memory, leaking it
+	 * beats a completion writing to freed memory */
+	if (!b->done)
+		return r;
+
+	for (i = 0; i < num; i++)
+		libusb_free_transfer(xfer[i]);
+
+	free(xfer);
+	free(buf);
+	free(b);
+
+	return r;
+}
+
+static int _rtlsdr_usb_bulk(void *priv, unsigned char endpoint,
+			    unsigned char *data, int len, int *actual_len,
+			    unsigned int timeout)
+{
+	rtlsdr_dev_t *dev = priv;
+
+	return libusb_bulk_transfer(dev->devh, endpoint, data, len, actual_len,
+				    timeout);
+}
+
+static int _rtlsdr_usb_submit(void *priv, struct libusb_transfer *xfer)
+{
+	return libusb_submit_transfer(xfer);
+}
+
+static int _rtlsdr_usb_cancel(void *priv, struct libusb_transfer *xfer)
+{
+	return libusb_cancel_transfer(xfer);
+}
+
+static int _rtlsdr_usb_handle_events(void *priv, struct timeval *tv,
+				     int *completed)
+{
+	rtlsdr_dev_t *dev = priv;
+
+	return libusb_handle_events_timeout_completed(dev->ctx, tv, completed);
+}
+
+static void _rtlsdr_usb_interrupt(void *priv)
+{
+#if LIBUSB_API_VERSION >= 0x01000105
+	rtlsdr_dev_t *dev = priv;
+
+	libusb_interrupt_event_handler(dev->ctx);
+#endif
+}
+
+static int _rtlsdr_usb_get_strings(void *priv, char *manufact, char *product,
+				   char *serial)
 {
+	rtlsdr_dev_t *dev = priv;
 	struct libusb_device_descriptor dd;
 	libusb_device *device = NULL;
 	const int buf_max = 256;
 	int r = 0;
 
-	if (!dev || !dev->devh)
-		return -1;
-
 	device = libusb_get_device(dev->devh);
 
 	r = libusb_get_device_descriptor(device, &dd);
@@ -818,6 +1440,45 @@ int rtlsdr_get_usb_strings(rtlsdr_dev_t *dev, char *manufact, char *product,
 	return 0;
 }
 
+static void _rtlsdr_usb_close(void *priv)
+{
+	rtlsdr_dev_t *dev = priv;
+
+	libusb_release_interface(dev->devh, 0);
+
+#ifdef DETACH_KERNEL_DRIVER
+	if (dev->driver_active) {
+		if (!libusb_attach_kernel_driver(dev->devh, 0))
+			fprintf(stderr, "Reattached kernel driver\n");
+		else
+			fprintf(stderr, "Reattaching kernel driver failed!\n");
+	}
+#endif
+
+	libusb_close(dev->devh);
+}
+
+static const rtlsdr_transport_t _rtlsdr_usb_transport = {
+	_rtlsdr_usb_control,
+	_rtlsdr_usb_write_batch,
+	_rtlsdr_usb_bulk,
+	_rtlsdr_usb_submit,
+	_rtlsdr_usb_cancel,
+	_rtlsdr_usb_handle_events,
+	_rtlsdr_usb_interrupt,
+	_rtlsdr_usb_get_strings,
+	_rtlsdr_usb_close,
+};
+
+int rtlsdr_get_usb_strings(rtlsdr_dev_t *dev, char *manufact, char *product,
+			    char *serial)
+{
+	if (!dev || !dev->tp)
+		return -1;
+
+	return dev->tp->get_strings(dev->tp_priv, manufact, product, serial);
+}
+
 int rtlsdr_write_eeprom(rtlsdr_dev_t *dev, uint8_t *data, uint8_t offset, uint16_t len)
 {
 	int r = 0;
@@ -896,10 +1557,123 @@ int rtlsdr_set_center_freq(rtlsdr_dev_t *dev, uint32_t freq)
 		rtlsdr_set_i2c_repeater(dev, 0);
 	}
 
-	if (!r)
+	if (!r) {
 		dev->freq = freq;
-	else
+		_rtlsdr_mark_retune(dev);
+	} else {
 		dev->freq = 0;
+	}
+
+	return r;
+}
+
+static void _rtlsdr_free_plan(rtlsdr_dev_t *dev)
+{
+	free(dev->plan_freq);
+	free(dev->plan_r82xx);
+	dev->plan_freq = NULL;
+	dev->plan_r82xx = NULL;
+	dev->plan_num = 0;
+}
+
+static int _rtlsdr_make_plan(rtlsdr_dev_t *dev)
+{
+	uint32_t i;
+	int r;
+
+	if (!dev->plan_r82xx) {
+		dev->plan_r82xx = malloc(dev->plan_num * sizeof(*dev->plan_r82xx));
+		if (!dev->plan_r82xx)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < dev->plan_num; i++)
+		dev->plan_r82xx[i].freq = dev->plan_freq[i] - dev->offs_freq;
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	r = r82xx_make_plan(&dev->r82xx_p, dev->plan_r82xx, dev->plan_num);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	if (r < 0) {
+		free(dev->plan_r82xx);
+		dev->plan_r82xx = NULL;
+		return r;
+	}
+
+	dev->plan_offs = dev->offs_freq;
+	dev->plan_if = dev->r82xx_p.int_freq;
+	dev->plan_xtal = dev->r82xx_c.xtal;
+
+	return 0;
+}
+
+static int _rtlsdr_plan_valid(rtlsdr_dev_t *dev)
+{
+	return dev->plan_r82xx &&
+	       dev->plan_offs == dev->offs_freq &&
+	       dev->plan_if == dev->r82xx_p.int_freq &&
+	       dev->plan_xtal == dev->r82xx_c.xtal;
+}
+
+int rtlsdr_set_freq_plan(rtlsdr_dev_t *dev, const uint32_t *freqs, uint32_t num)
+{
+	if (!dev || !dev->tuner || (num && !freqs))
+		return -1;
+
+	_rtlsdr_free_plan(dev);
+
+	if (!num)
+		return 0;
+
+	dev->plan_freq = malloc(num * sizeof(uint32_t));
+	if (!dev->plan_freq)
+		return -ENOMEM;
+
+	memcpy(dev->plan_freq, freqs, num * sizeof(uint32_t));
+	dev->plan_num = num;
+
+	/* only the R82xx driver can program a precomputed frequency */
+	if ((dev->tuner_type == RTLSDR_TUNER_R820T ||
+	     dev->tuner_type == RTLSDR_TUNER_R828D) && !dev->direct_sampling)
+		return _rtlsdr_make_plan(dev);
+
+	return 0;
+}
+
+int rtlsdr_hop(rtlsdr_dev_t *dev, uint32_t index)
+{
+	uint32_t freq;
+	int r;
+
+	if (!dev || !dev->tuner || index >= dev->plan_num)
+		return -1;
+
+	freq = dev->plan_freq[index];
+
+	if (dev->direct_sampling || (dev->tuner_type != RTLSDR_TUNER_R820T &&
+				     dev->tuner_type != RTLSDR_TUNER_R828D))
+		return rtlsdr_set_center_freq(dev, freq);
+
+	/* offset tuning, bandwidth or ppm changed since the plan was made */
+	if (!_rtlsdr_plan_valid(dev) && _rtlsdr_make_plan(dev) < 0)
+		return rtlsdr_set_center_freq(dev, freq);
+
+	/* queue the repeater and register writes up to the lock check */
+	_rtlsdr_batch_begin(dev);
+	rtlsdr_set_i2c_repeater(dev, 1);
+	dev->r82xx_p.lock_ns = UINT64_MAX;
+	r = r82xx_set_freq_plan(&dev->r82xx_p, &dev->plan_r82xx[index]);
+	r820t_account_lock(dev);
+	rtlsdr_set_i2c_repeater(dev, 0);
+	if (_rtlsdr_batch_end(dev) < 0 && !r)
+		r = -1;
+
+	if (!r) {
+		dev->freq = freq;
+		_rtlsdr_mark_retune(dev);
+	} else {
+		dev->freq = 0;
+	}
 
 	return r;
 }
@@ -1025,23 +1799,127 @@ int rtlsdr_set_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw)
 	return r;
 }
 
+/* precompute the register images of all gain steps the tuner lists */
+static void _rtlsdr_gain_images(rtlsdr_dev_t *dev)
+{
+	int gains[GAIN_IMAGES_MAX];
+	struct tuner_reg_image *img;
+	int i, n;
+
+	dev->gain_img_num = 0;
+	dev->tuner_i2c_addr = 0;
+	memset(dev->tuner_shadow_ok, 0, sizeof(dev->tuner_shadow_ok));
+
+	if (!dev->tuner || !dev->tuner->gain_image)
+		return;
+
+	n = rtlsdr_get_tuner_gains(dev, NULL);
+	if (n <= 0 || n > GAIN_IMAGES_MAX)
+		return;
+	rtlsdr_get_tuner_gains(dev, gains);
+
+	for (i = 0; i < n; i++) {
+		img = &dev->gain_img[dev->gain_img_num];
+		if (dev->tuner->gain_image(dev, gains[i], img) < 0)
+			continue;
+		dev->gain_img_gain[dev->gain_img_num++] = gains[i];
+		dev->tuner_i2c_addr = img->i2c_addr;
+	}
+}
+
+/* write an image, registers not in the shadow yet are read once, returns
+ * the number of registers written */
+static int _rtlsdr_gain_image_write(rtlsdr_dev_t *dev,
+				    const struct tuner_reg_image *img)
+{
+	uint8_t data[2], cur;
+	uint8_t reg;
+	int i, known, n = 0;
+
+	for (i = 0; i < img->num; i++) {
+		reg = img->reg[i];
+		/* the tuner AGC moves the gain registers in auto gain mode,
+		 * so the shadow of them can't be trusted there */
+		known = dev->gain_mode &&
+			(dev->tuner_shadow_ok[reg >> 3] & (1 << (reg & 7)));
+
+		if (known) {
+			cur = dev->tuner_shadow[reg];
+		} else if (img->mask[i] == 0xff) {
+			cur = 0;
+		} else {
+			if (rtlsdr_i2c_write(dev, img->i2c_addr, &reg, 1) < 1 ||
+			    rtlsdr_i2c_read(dev, img->i2c_addr, &cur, 1) < 1)
+				return -1;
+		}
+
+		data[0] = reg;
+		data[1] = (cur & ~img->mask[i]) | (img->val[i] & img->mask[i]);
+		if (known && data[1] == cur)
+			continue;
+
+		if (rtlsdr_i2c_write(dev, img->i2c_addr, data, 2) != 2)
+			return -1;
+		n++;
+	}
+
+	return n;
+}
+
 int rtlsdr_set_tuner_gain(rtlsdr_dev_t *dev, int gain)
 {
-	int r = 0;
+	const struct tuner_reg_image *img = NULL;
+	uint64_t start, ns;
+	int r = 0, wrote = 0;
+	int i;
 
 	if (!dev || !dev->tuner)
 		return -1;
 
-	if (dev->tuner->set_gain) {
+	for (i = 0; i < dev->gain_img_num; i++) {
+		if (dev->gain_img_gain[i] == gain) {
+			img = &dev->gain_img[i];
+			break;
+		}
+	}
+
+	start = _rtlsdr_monotonic_ns();
+
+	if (img) {
+		/* repeater on, gain registers and repeater off in one go */
+		_rtlsdr_batch_begin(dev);
+		rtlsdr_set_i2c_repeater(dev, 1);
+		r = _rtlsdr_gain_image_write(dev, img);
+		rtlsdr_set_i2c_repeater(dev, 0);
+		wrote = r > 0;
+		if (r > 0)
+			r = 0;
+		if (_rtlsdr_batch_end(dev))
+			r = -1;
+	} else if (dev->tuner->set_gain) {
 		rtlsdr_set_i2c_repeater(dev, 1);
 		r = dev->tuner->set_gain((void *)dev, gain);
 		rtlsdr_set_i2c_repeater(dev, 0);
+		wrote = 1;
 	}
 
-	if (!r)
+	/* failed steps and those that wrote nothing would only water down
+	 * the statistics */
+	if (wrote && !r) {
+		ns = _rtlsdr_monotonic_ns() - start;
+		dev->gain_steps++;
+		if (img)
+			dev->gain_fast_steps++;
+		dev->gain_last_us = ns / 1000;
+		_rtlsdr_hist_add(dev->gain_hist, ns);
+	}
+
+	if (!r) {
 		dev->gain = gain;
-	else
+		_rtlsdr_mark_retune(dev);
+	} else {
 		dev->gain = 0;
+	}
 
 	return r;
 }
@@ -1083,9 +1961,37 @@ int rtlsdr_set_tuner_gain_mode(rtlsdr_dev_t *dev, int mode)
 		rtlsdr_set_i2c_repeater(dev, 0);
 	}
 
+	/* the tuner AGC may have changed the gain registers behind our back */
+	memset(dev->tuner_shadow_ok, 0, sizeof(dev->tuner_shadow_ok));
+
+	if (!r)
+		dev->gain_mode = mode;
+
 	return r;
 }
 
+int rtlsdr_begin_tuner_batch(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	dev->repeater_depth++;
+
+	return 0;
+}
+
+int rtlsdr_end_tuner_batch(rtlsdr_dev_t *dev)
+{
+	if (!dev || !dev->repeater_depth)
+		return -1;
+
+	/* a no-op if no tuner access opened the repeater meanwhile */
+	if (!--dev->repeater_depth)
+		rtlsdr_set_i2c_repeater(dev, 0);
+
+	return 0;
+}
+
 int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 {
 	int r = 0;
@@ -1114,6 +2020,8 @@ int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 
 	dev->rate = (uint32_t)real_rate;
 
+	_rtlsdr_batch_begin(dev);
+
 	if (dev->tuner && dev->tuner->set_bw) {
 		rtlsdr_set_i2c_repeater(dev, 1);
 		dev->tuner->set_bw(dev, dev->bw > 0 ? dev->bw : dev->rate);
@@ -1130,11 +2038,18 @@ int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 	/* reset demod (bit 3, soft_rst) */
 	r |= rtlsdr_demod_write_reg(dev, 1, 0x01, 0x14, 1);
 	r |= rtlsdr_demod_write_reg(dev, 1, 0x01, 0x10, 1);
+	_rtlsdr_demod_shadow_invalidate(dev);
 
 	/* recalculate offset frequency if offset tuning is enabled */
 	if (dev->offs_freq)
 		rtlsdr_set_offset_tuning(dev, 1);
 
+	r |= _rtlsdr_batch_end(dev);
+
+	_rtlsdr_update_xfer_len(dev);
+	if (!r)
+		_rtlsdr_mark_retune(dev);
+
 	return r;
 }
 
@@ -1159,6 +2074,8 @@ int rtlsdr_set_agc_mode(rtlsdr_dev_t *dev, int on)
 	if (!dev)
 		return -1;
 
+	dev->agc_mode = on;
+
 	return rtlsdr_demod_write_reg(dev, 0, 0x19, on ? 0x25 : 0x05, 1);
 }
 
@@ -1196,6 +2113,7 @@ int rtlsdr_set_direct_sampling(rtlsdr_dev_t *dev, int on)
 			r |= dev->tuner->init(dev);
 			rtlsdr_set_i2c_repeater(dev, 0);
 		}
+		_rtlsdr_gain_images(dev);
 
 		if ((dev->tuner_type == RTLSDR_TUNER_R820T) ||
 		    (dev->tuner_type == RTLSDR_TUNER_R828D)) {
@@ -1294,224 +2212,637 @@ static rtlsdr_dongle_t *find_known_device(uint16_t vid, uint16_t pid)
 	return device;
 }
 
-uint32_t rtlsdr_get_device_count(void)
+/* snapshot of the supported devices, the USB strings of a device are kept
+ * across enumerations for as long as it stays at the same bus address */
+static pthread_mutex_t enum_lock = PTHREAD_MUTEX_INITIALIZER;
+static rtlsdr_device_info_t *enum_list;
+static uint32_t enum_num;
+
+/* find a device of the last snapshot whose strings are known, call with
+ * enum_lock held */
+static const rtlsdr_device_info_t *_rtlsdr_enum_lookup(uint16_t vid,
+							uint16_t pid,
+							uint8_t bus,
+							uint8_t address)
 {
-	int i,r;
-	libusb_context *ctx;
-	libusb_device **list;
-	uint32_t device_count = 0;
-	struct libusb_device_descriptor dd;
-	ssize_t cnt;
-
-	r = libusb_init(&ctx);
-	if(r < 0)
-		return 0;
-
-	cnt = libusb_get_device_list(ctx, &list);
-
-	for (i = 0; i < cnt; i++) {
-		libusb_get_device_descriptor(list[i], &dd);
-
-		if (find_known_device(dd.idVendor, dd.idProduct))
-			device_count++;
+	uint32_t i;
+
+	for (i = 0; i < enum_num; i++) {
+		if (!enum_list[i].strings_err &&
+		    enum_list[i].bus == bus &&
+		    enum_list[i].address == address &&
+		    enum_list[i].vid == vid &&
+		    enum_list[i].pid == pid)
+			return &enum_list[i];
 	}
 
-	libusb_free_device_list(list, 1);
-
-	libusb_exit(ctx);
-
-	return device_count;
+	return NULL;
 }
 
-const char *rtlsdr_get_device_name(uint32_t index)
+/* enumerate the supported devices in a single pass, opening only those
+ * not seen before, call with enum_lock held */
+static int _rtlsdr_enumerate(void)
 {
-	int i,r;
 	libusb_context *ctx;
 	libusb_device **list;
 	struct libusb_device_descriptor dd;
-	rtlsdr_dongle_t *device = NULL;
-	uint32_t device_count = 0;
-	ssize_t cnt;
+	rtlsdr_dongle_t *device;
+	rtlsdr_device_info_t *infos, *info;
+	const rtlsdr_device_info_t *old;
+	rtlsdr_dev_t devt;
+	uint32_t num = 0;
+	ssize_t cnt, i;
+	int r;
 
 	r = libusb_init(&ctx);
-	if(r < 0)
-		return "";
+	if (r < 0)
+		return r;
 
 	cnt = libusb_get_device_list(ctx, &list);
+	if (cnt < 0) {
+		libusb_exit(ctx);
+		return (int)cnt;
+	}
+
+	infos = calloc(cnt ? cnt : 1, sizeof(rtlsdr_device_info_t));
+	if (!infos) {
+		libusb_free_device_list(list, 1);
+		libusb_exit(ctx);
+		return -ENOMEM;
+	}
 
 	for (i = 0; i < cnt; i++) {
 		libusb_get_device_descriptor(list[i], &dd);
 
 		device = find_known_device(dd.idVendor, dd.idProduct);
+		if (!device)
+			continue;
 
-		if (device) {
-			device_count++;
+		info = &infos[num];
+		info->index = num++;
+		info->vid = dd.idVendor;
+		info->pid = dd.idProduct;
+		info->name = device->name;
+		info->bus = libusb_get_bus_number(list[i]);
+		info->address = libusb_get_device_address(list[i]);
+#if LIBUSB_API_VERSION >= 0x01000102
+		r = libusb_get_port_numbers(list[i], info->port_path,
+					    RTLSDR_PORT_PATH_MAX);
+		if (r > 0)
+			info->port_depth = r;
+#endif
 
-			if (index == device_count - 1)
-				break;
+		old = _rtlsdr_enum_lookup(info->vid, info->pid,
+					  info->bus, info->address);
+		if (old) {
+			memcpy(info->manufact, old->manufact, 256);
+			memcpy(info->product, old->product, 256);
+			memcpy(info->serial, old->serial, 256);
+			continue;
 		}
+
+		r = libusb_open(list[i], &devt.devh);
+		if (!r) {
+			r = _rtlsdr_usb_get_strings(&devt, info->manufact,
+						    info->product,
+						    info->serial);
+			libusb_close(devt.devh);
+		}
+		info->strings_err = r;
 	}
 
 	libusb_free_device_list(list, 1);
 
 	libusb_exit(ctx);
 
-	if (device)
-		return device->name;
-	else
-		return "";
+	free(enum_list);
+	enum_list = infos;
+	enum_num = num;
+
+	return 0;
 }
 
-int rtlsdr_get_device_usb_strings(uint32_t index, char *manufact,
-				   char *product, char *serial)
+/* copy the strings of an enumerated device, returns 0 if they were known */
+static int _rtlsdr_enum_strings(libusb_device *device, rtlsdr_dev_t *dev)
 {
-	int r = -2;
-	int i;
-	libusb_context *ctx;
-	libusb_device **list;
 	struct libusb_device_descriptor dd;
-	rtlsdr_dongle_t *device = NULL;
-	rtlsdr_dev_t devt;
-	uint32_t device_count = 0;
-	ssize_t cnt;
+	const rtlsdr_device_info_t *info;
+	int r = -1;
 
-	r = libusb_init(&ctx);
-	if(r < 0)
-		return r;
+	if (libusb_get_device_descriptor(device, &dd) < 0)
+		return -1;
 
-	cnt = libusb_get_device_list(ctx, &list);
+	pthread_mutex_lock(&enum_lock);
+	info = _rtlsdr_enum_lookup(dd.idVendor, dd.idProduct,
+				   libusb_get_bus_number(device),
+				   libusb_get_device_address(device));
+	if (info) {
+		memcpy(dev->manufact, info->manufact, 256);
+		memcpy(dev->product, info->product, 256);
+		memcpy(dev->serial, info->serial, 256);
+		r = 0;
+	}
+	pthread_mutex_unlock(&enum_lock);
 
-	for (i = 0; i < cnt; i++) {
-		libusb_get_device_descriptor(list[i], &dd);
+	return r;
+}
 
-		device = find_known_device(dd.idVendor, dd.idProduct);
+int rtlsdr_get_device_list(rtlsdr_device_info_t **out_list, uint32_t *count)
+{
+	rtlsdr_device_info_t *list = NULL;
+	int r;
 
-		if (device) {
-			device_count++;
-
-			if (index == device_count - 1) {
-				r = libusb_open(list[i], &devt.devh);
-				if (!r) {
-					r = rtlsdr_get_usb_strings(&devt,
-								   manufact,
-								   product,
-								   serial);
-					libusb_close(devt.devh);
-				}
-				break;
-			}
-		}
+	if (!out_list || !count)
+		return -1;
+
+	pthread_mutex_lock(&enum_lock);
+
+	r = _rtlsdr_enumerate();
+	if (!r && enum_num) {
+		list = malloc(enum_num * sizeof(rtlsdr_device_info_t));
+		if (list)
+			memcpy(list, enum_list,
+			       enum_num * sizeof(rtlsdr_device_info_t));
+		else
+			r = -ENOMEM;
 	}
 
-	libusb_free_device_list(list, 1);
+	*count = list ? enum_num : 0;
 
-	libusb_exit(ctx);
+	pthread_mutex_unlock(&enum_lock);
+
+	*out_list = list;
 
 	return r;
 }
 
-int rtlsdr_get_index_by_serial(const char *serial)
+void rtlsdr_free_device_list(rtlsdr_device_info_t *list)
 {
-	int i, cnt, r;
-	char str[256];
+	free(list);
+}
 
-	if (!serial)
-		return -1;
+uint32_t rtlsdr_get_device_count(void)
+{
+	uint32_t device_count = 0;
 
-	cnt = rtlsdr_get_device_count();
+	pthread_mutex_lock(&enum_lock);
 
-	if (!cnt)
-		return -2;
+	if (!_rtlsdr_enumerate())
+		device_count = enum_num;
 
-	for (i = 0; i < cnt; i++) {
-		r = rtlsdr_get_device_usb_strings(i, NULL, NULL, str);
-		if (!r && !strcmp(serial, str))
-			return i;
-	}
+	pthread_mutex_unlock(&enum_lock);
 
-	return -3;
+	return device_count;
 }
 
-/* Returns true if the manufact_check and product_check strings match what is in the dongles EEPROM */
-int rtlsdr_check_dongle_model(void *dev, char *manufact_check, char *product_check)
+const char *rtlsdr_get_device_name(uint32_t index)
 {
-	if ((strcmp(((rtlsdr_dev_t *)dev)->manufact, manufact_check) == 0&& strcmp(((rtlsdr_dev_t *)dev)->product, product_check) == 0))
-		return 1;
+	const char *name = "";
 
-	return 0;
-}
+	pthread_mutex_lock(&enum_lock);
 
+	if (!_rtlsdr_enumerate() && index < enum_num)
+		name = enum_list[index].name;
 
-int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
-{
-	int r;
-	int i;
-	libusb_device **list;
-	rtlsdr_dev_t *dev = NULL;
-	libusb_device *device = NULL;
-	uint32_t device_count = 0;
-	struct libusb_device_descriptor dd;
-	uint8_t reg;
-	ssize_t cnt;
+	pthread_mutex_unlock(&enum_lock);
 
-	dev = malloc(sizeof(rtlsdr_dev_t));
-	if (NULL == dev)
-		return -ENOMEM;
+	return name;
+}
 
-	memset(dev, 0, sizeof(rtlsdr_dev_t));
-	memcpy(dev->fir, fir_default, sizeof(fir_default));
+int rtlsdr_get_device_usb_strings(uint32_t index, char *manufact,
+				   char *product, char *serial)
+{
+	rtlsdr_device_info_t *info;
+	int r;
 
-	r = libusb_init(&dev->ctx);
-	if(r < 0){
-		free(dev);
-		return -1;
+	pthread_mutex_lock(&enum_lock);
+
+	r = _rtlsdr_enumerate();
+	if (!r && index >= enum_num)
+		r = -2;
+
+	if (!r) {
+		info = &enum_list[index];
+		r = info->strings_err;
+		if (!r && manufact)
+			memcpy(manufact, info->manufact, 256);
+		if (!r && product)
+			memcpy(product, info->product, 256);
+		if (!r && serial)
+			memcpy(serial, info->serial, 256);
 	}
 
-	dev->dev_lost = 1;
-
-	cnt = libusb_get_device_list(dev->ctx, &list);
+	pthread_mutex_unlock(&enum_lock);
 
-	for (i = 0; i < cnt; i++) {
-		device = list[i];
+	return r;
+}
 
-		libusb_get_device_descriptor(list[i], &dd);
+int rtlsdr_get_index_by_serial(const char *serial)
+{
+	uint32_t i;
+	int r;
 
-		if (find_known_device(dd.idVendor, dd.idProduct)) {
-			device_count++;
-		}
+	if (!serial)
+		return -1;
 
-		if (index == device_count - 1)
-			break;
+	pthread_mutex_lock(&enum_lock);
 
-		device = NULL;
+	if (_rtlsdr_enumerate() < 0 || !enum_num) {
+		r = -2;
+	} else {
+		r = -3;
+		for (i = 0; i < enum_num; i++) {
+			if (!enum_list[i].strings_err &&
+			    !strcmp(serial, enum_list[i].serial)) {
+				r = (int)i;
+				break;
+			}
+		}
 	}
 
-	if (!device) {
-		r = -1;
-		goto err;
-	}
+	pthread_mutex_unlock(&enum_lock);
 
-	r = libusb_open(device, &dev->devh);
-	if (r < 0) {
+	return r;
+}
+
+static const char *tuner_names[] = {
+	NULL,
+	"Elonics E4000",
+	"Fitipower FC0012",
+	"Fitipower FC0013",
+	"FCI 2580",
+	"Rafael Micro R820T",
+	"Rafael Micro R828D",
+};
+
+/* order in which the tuners are probed for */
+static const enum rtlsdr_tuner probe_order[] = {
+	RTLSDR_TUNER_E4000,
+	RTLSDR_TUNER_FC0013,
+	RTLSDR_TUNER_R820T,
+	RTLSDR_TUNER_R828D,
+	RTLSDR_TUNER_FC2580,
+	RTLSDR_TUNER_FC0012,
+};
+
+/* pulse the reset line of the tuner, needs the I2C repeater enabled */
+static void _rtlsdr_reset_tuner(rtlsdr_dev_t *dev)
+{
+	/* initialise GPIOs */
+	rtlsdr_set_gpio_output(dev, 4);
+
+	/* reset tuner before probing */
+	rtlsdr_set_gpio_bit(dev, 4, 1);
+	rtlsdr_set_gpio_bit(dev, 4, 0);
+}
+
+/* read the check register of a tuner, returns 1 if it answers */
+static int _rtlsdr_probe_tuner(rtlsdr_dev_t *dev, enum rtlsdr_tuner type)
+{
+	uint8_t reg;
+
+	switch (type) {
+	case RTLSDR_TUNER_E4000:
+		reg = rtlsdr_i2c_read_reg(dev, E4K_I2C_ADDR, E4K_CHECK_ADDR);
+		return reg == E4K_CHECK_VAL;
+	case RTLSDR_TUNER_FC0013:
+		reg = rtlsdr_i2c_read_reg(dev, FC0013_I2C_ADDR,
+					  FC0013_CHECK_ADDR);
+		return reg == FC0013_CHECK_VAL;
+	case RTLSDR_TUNER_R820T:
+		reg = rtlsdr_i2c_read_reg(dev, R820T_I2C_ADDR,
+					  R82XX_CHECK_ADDR);
+		return reg == R82XX_CHECK_VAL;
+	case RTLSDR_TUNER_R828D:
+		reg = rtlsdr_i2c_read_reg(dev, R828D_I2C_ADDR,
+					  R82XX_CHECK_ADDR);
+		return reg == R82XX_CHECK_VAL;
+	case RTLSDR_TUNER_FC2580:
+		reg = rtlsdr_i2c_read_reg(dev, FC2580_I2C_ADDR,
+					  FC2580_CHECK_ADDR);
+		return (reg & 0x7f) == FC2580_CHECK_VAL;
+	case RTLSDR_TUNER_FC0012:
+		reg = rtlsdr_i2c_read_reg(dev, FC0012_I2C_ADDR,
+					  FC0012_CHECK_ADDR);
+		return reg == FC0012_CHECK_VAL;
+	default:
+		return 0;
+	}
+}
+
+/* what is remembered about a dongle in the state file, keyed by serial */
+struct rtlsdr_known_state {
+	enum rtlsdr_tuner tuner_type;
+	uint32_t rtl_xtal;
+	uint32_t tun_xtal;
+};
+
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *state_path;
+
+int rtlsdr_set_state_file(const char *path)
+{
+	char *p = NULL;
+
+	if (path) {
+		p = strdup(path);
+		if (!p)
+			return -ENOMEM;
+	}
+
+	pthread_mutex_lock(&state_lock);
+	free(state_path);
+	state_path = p;
+	pthread_mutex_unlock(&state_lock);
+
+	return 0;
+}
+
+/* the state file is whitespace separated, other serials can't be keys */
+static int _rtlsdr_state_key_ok(const char *serial)
+{
+	if (!serial[0])
+		return 0;
+
+	for (; *serial; serial++) {
+		if ((unsigned char)*serial <= ' ')
+			return 0;
+	}
+
+	return 1;
+}
+
+/* a remembered tuner crystal must be near the 28.8 MHz shared with the
+ * RTL, or the 16 MHz of an R828D, within the tolerance of the RTL one */
+static int _rtlsdr_state_tun_xtal_ok(int type, unsigned int tun_xtal)
+{
+	if (tun_xtal >= MIN_RTL_XTAL_FREQ && tun_xtal <= MAX_RTL_XTAL_FREQ)
+		return 1;
+
+	return type == RTLSDR_TUNER_R828D &&
+	       tun_xtal >= R828D_XTAL_FREQ - (MAX_RTL_XTAL_FREQ - DEF_RTL_XTAL_FREQ) &&
+	       tun_xtal <= R828D_XTAL_FREQ + (MAX_RTL_XTAL_FREQ - DEF_RTL_XTAL_FREQ);
+}
+
+/* look up the state remembered for a dongle, returns 0 if there is one */
+static int _rtlsdr_state_load(rtlsdr_dev_t *dev, struct rtlsdr_known_state *st)
+{
+	FILE *f = NULL;
+	char line[512], serial[256];
+	unsigned int rtl_xtal, tun_xtal;
+	int type, r = -1;
+
+	if (!_rtlsdr_state_key_ok(dev->serial))
+		return -1;
+
+	pthread_mutex_lock(&state_lock);
+
+	if (state_path)
+		f = fopen(state_path, "r");
+
+	while (f && fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%255s %d %u %u", serial, &type,
+			   &rtl_xtal, &tun_xtal) != 4)
+			continue;
+
+		if (strcmp(serial, dev->serial) ||
+		    type <= RTLSDR_TUNER_UNKNOWN || type > RTLSDR_TUNER_R828D ||
+		    rtl_xtal < MIN_RTL_XTAL_FREQ || rtl_xtal > MAX_RTL_XTAL_FREQ ||
+		    !_rtlsdr_state_tun_xtal_ok(type, tun_xtal))
+			continue;
+
+		st->tuner_type = (enum rtlsdr_tuner)type;
+		st->rtl_xtal = rtl_xtal;
+		st->tun_xtal = tun_xtal;
+		r = 0;
+		break;
+	}
+
+	if (f)
+		fclose(f);
+
+	pthread_mutex_unlock(&state_lock);
+
+	return r;
+}
+
+/* remember the tuner and crystal frequencies of a dongle, the file is
+ * replaced as a whole so readers never see a partial update */
+static void _rtlsdr_state_store(rtlsdr_dev_t *dev)
+{
+	FILE *in, *out;
+	char line[512], serial[256];
+	char *tmp = NULL;
+
+	if (dev->tuner_type == RTLSDR_TUNER_UNKNOWN ||
+	    !_rtlsdr_state_key_ok(dev->serial))
+		return;
+
+	pthread_mutex_lock(&state_lock);
+
+	if (!state_path)
+		goto out;
+
+	tmp = malloc(strlen(state_path) + 16);
+	if (!tmp)
+		goto out;
+
+#ifdef _WIN32
+	sprintf(tmp, "%s.%lu", state_path,
+		(unsigned long)GetCurrentProcessId());
+#else
+	sprintf(tmp, "%s.%lu", state_path, (unsigned long)getpid());
+#endif
+
+	out = fopen(tmp, "w");
+	if (!out)
+		goto out;
+
+	fprintf(out, "# serial tuner rtl_xtal tun_xtal\n");
+
+	in = fopen(state_path, "r");
+	while (in && fgets(line, sizeof(line), in)) {
+		if (line[0] == '#' ||
+		    (sscanf(line, "%255s", serial) == 1 &&
+		     !strcmp(serial, dev->serial)))
+			continue;
+
+		fputs(line, out);
+	}
+
+	if (in)
+		fclose(in);
+
+	fprintf(out, "%s %d %u %u\n", dev->serial, dev->tuner_type,
+		dev->rtl_xtal, dev->tun_xtal);
+
+	if (fclose(out)) {
+		remove(tmp);
+		goto out;
+	}
+
+#ifdef _WIN32
+	remove(state_path);
+#endif
+	if (rename(tmp, state_path))
+		remove(tmp);
+out:
+	pthread_mutex_unlock(&state_lock);
+	free(tmp);
+}
+
+/* look up the model matching the strings in the dongles EEPROM */
+static const rtlsdr_model_t *_rtlsdr_find_model(rtlsdr_dev_t *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(known_models)/sizeof(rtlsdr_model_t); i++) {
+		if (!strcmp(dev->manufact, known_models[i].manufact) &&
+		    !strcmp(dev->product, known_models[i].product))
+			return &known_models[i];
+	}
+
+	return &generic_model;
+}
+
+const rtlsdr_model_t *rtlsdr_get_model(void *dev)
+{
+	return ((rtlsdr_dev_t *)dev)->model;
+}
+
+/* selects the USB device to open */
+struct rtlsdr_usb_match {
+	uint32_t index;		/* used if neither serial nor path is given */
+	const char *serial;	/* serial number, or NULL */
+	uint8_t bus;
+	uint8_t port_depth;	/* port path given if not 0 */
+	uint8_t port_path[RTLSDR_PORT_PATH_MAX];
+};
+
+static int _rtlsdr_match_serial(struct libusb_device_handle *devh,
+				const char *serial)
+{
+	struct libusb_device_descriptor dd;
+	char str[256];
+
+	if (libusb_get_device_descriptor(libusb_get_device(devh), &dd) < 0)
+		return 0;
+
+	memset(str, 0, sizeof(str));
+	libusb_get_string_descriptor_ascii(devh, dd.iSerialNumber,
+					   (unsigned char *)str, sizeof(str));
+
+	return !strcmp(str, serial);
+}
+
+/* check a supported device against a serial number or port path, the
+ * serial number is taken from the last enumeration if it is known there,
+ * otherwise the device is opened and the handle returned on a match */
+static int _rtlsdr_usb_matches(libusb_device *device,
+			       struct libusb_device_descriptor *dd,
+			       const struct rtlsdr_usb_match *m,
+			       struct libusb_device_handle **devh)
+{
+	const rtlsdr_device_info_t *info;
+	uint8_t path[RTLSDR_PORT_PATH_MAX];
+	int r = -1;
+
+	if (m->port_depth) {
+		if (libusb_get_bus_number(device) != m->bus)
+			return 0;
+#if LIBUSB_API_VERSION >= 0x01000102
+		r = libusb_get_port_numbers(device, path, RTLSDR_PORT_PATH_MAX);
+#endif
+		return r == m->port_depth &&
+		       !memcmp(path, m->port_path, m->port_depth);
+	}
+
+	pthread_mutex_lock(&enum_lock);
+	info = _rtlsdr_enum_lookup(dd->idVendor, dd->idProduct,
+				   libusb_get_bus_number(device),
+				   libusb_get_device_address(device));
+	if (info)
+		r = !strcmp(info->serial, m->serial);
+	pthread_mutex_unlock(&enum_lock);
+
+	if (r >= 0)
+		return r;
+
+	if (libusb_open(device, devh) < 0)
+		return 0;
+
+	if (_rtlsdr_match_serial(*devh, m->serial))
+		return 1;
+
+	libusb_close(*devh);
+	*devh = NULL;
+
+	return 0;
+}
+
+/* find the selected USB device in a single enumeration, open it and claim
+ * its interface */
+static int _rtlsdr_open_usb(rtlsdr_dev_t *dev,
+			    const struct rtlsdr_usb_match *m,
+			    struct libusb_device_handle **out_devh)
+{
+	int r;
+	int i;
+	libusb_device **list;
+	libusb_device *device = NULL;
+	struct libusb_device_handle *devh = NULL;
+	uint32_t device_count = 0;
+	struct libusb_device_descriptor dd;
+	ssize_t cnt;
+
+	cnt = libusb_get_device_list(dev->ctx, &list);
+
+	for (i = 0; i < cnt; i++) {
+		libusb_get_device_descriptor(list[i], &dd);
+
+		if (!find_known_device(dd.idVendor, dd.idProduct))
+			continue;
+
+		device_count++;
+
+		if (m->serial || m->port_depth) {
+			if (_rtlsdr_usb_matches(list[i], &dd, m, &devh)) {
+				device = list[i];
+				break;
+			}
+		} else if (m->index == device_count - 1) {
+			device = list[i];
+			break;
+		}
+	}
+
+	if (!device) {
 		libusb_free_device_list(list, 1);
+		return -1;
+	}
+
+	dev->index = device_count - 1;
+
+	r = devh ? 0 : libusb_open(device, &devh);
+	libusb_free_device_list(list, 1);
+	if (r < 0) {
 		fprintf(stderr, "usb_open error %d\n", r);
 		if(r == LIBUSB_ERROR_ACCESS)
 			fprintf(stderr, "Please fix the device permissions, e.g. "
 			"by installing the udev rules file rtl-sdr.rules\n");
-		goto err;
+		return r;
 	}
 
-	libusb_free_device_list(list, 1);
-
-	if (libusb_kernel_driver_active(dev->devh, 0) == 1) {
+	if (libusb_kernel_driver_active(devh, 0) == 1) {
 		dev->driver_active = 1;
 
 #ifdef DETACH_KERNEL_DRIVER
-		if (!libusb_detach_kernel_driver(dev->devh, 0)) {
+		if (!libusb_detach_kernel_driver(devh, 0)) {
 			fprintf(stderr, "Detached kernel driver\n");
 		} else {
 			fprintf(stderr, "Detaching kernel driver failed!");
-			goto err;
+			libusb_close(devh);
+			return -1;
 		}
 #else
 		fprintf(stderr, "\nKernel driver is active, or device is "
@@ -1523,16 +2854,38 @@ int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
 #endif
 	}
 
-	r = libusb_claim_interface(dev->devh, 0);
+	r = libusb_claim_interface(devh, 0);
 	if (r < 0) {
 		fprintf(stderr, "usb_claim_interface error %d\n", r);
-		goto err;
+		libusb_close(devh);
+		return r;
 	}
 
+	*out_devh = devh;
+
+	return 0;
+}
+
+/* bring up the demodulator and probe for the tuner, returns -1 if no
+ * supported tuner was found or it failed to initialize */
+static int _rtlsdr_init_device(rtlsdr_dev_t *dev)
+{
+	struct rtlsdr_known_state st;
+	unsigned int i;
+	int known, r = 0;
+
 	dev->rtl_xtal = DEF_RTL_XTAL_FREQ;
 
+	/* a reopened device may have come back with another tuner, or none */
+	dev->tuner_type = RTLSDR_TUNER_UNKNOWN;
+	dev->tuner = NULL;
+	dev->gain_img_num = 0;
+
+	/* nothing is known about the demod of a freshly opened device */
+	_rtlsdr_demod_shadow_invalidate(dev);
+
 	/* perform a dummy write, if it fails, reset the device */
-	if (rtlsdr_write_reg(dev, USBB, USB_SYSCTL, 0x09, 1) < 0) {
+	if (rtlsdr_write_reg(dev, USBB, USB_SYSCTL, 0x09, 1) < 0 && dev->devh) {
 		fprintf(stderr, "Resetting device...\n");
 		libusb_reset_device(dev->devh);
 	}
@@ -1540,77 +2893,65 @@ int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
 	rtlsdr_init_baseband(dev);
 	dev->dev_lost = 0;
 
-	/* Get device manufacturer and product id */
-	r = rtlsdr_get_usb_strings(dev, dev->manufact, dev->product, NULL);
+	/* Get device manufacturer, product id and serial, unless they are
+	 * known from an enumeration already */
+	if (!dev->devh ||
+	    _rtlsdr_enum_strings(libusb_get_device(dev->devh), dev) < 0)
+		rtlsdr_get_usb_strings(dev, dev->manufact, dev->product,
+				       dev->serial);
 
-	/* Probe tuners */
+	dev->model = _rtlsdr_find_model(dev);
+	if (dev->model->name)
+		fprintf(stderr, "%s Detected\n", dev->model->name);
+
+	/* Probe tuners, starting with the one remembered for this dongle */
 	rtlsdr_set_i2c_repeater(dev, 1);
 
-	reg = rtlsdr_i2c_read_reg(dev, E4K_I2C_ADDR, E4K_CHECK_ADDR);
-	if (reg == E4K_CHECK_VAL) {
-		fprintf(stderr, "Found Elonics E4000 tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_E4000;
-		goto found;
-	}
+	known = !_rtlsdr_state_load(dev, &st);
+	if (known) {
+		if (st.tuner_type == RTLSDR_TUNER_FC2580 ||
+		    st.tuner_type == RTLSDR_TUNER_FC0012)
+			_rtlsdr_reset_tuner(dev);
 
-	reg = rtlsdr_i2c_read_reg(dev, FC0013_I2C_ADDR, FC0013_CHECK_ADDR);
-	if (reg == FC0013_CHECK_VAL) {
-		fprintf(stderr, "Found Fitipower FC0013 tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_FC0013;
-		goto found;
-	}
+		if (_rtlsdr_probe_tuner(dev, st.tuner_type)) {
+			dev->tuner_type = st.tuner_type;
+			goto found;
+		}
 
-	reg = rtlsdr_i2c_read_reg(dev, R820T_I2C_ADDR, R82XX_CHECK_ADDR);
-	if (reg == R82XX_CHECK_VAL) {
-		fprintf(stderr, "Found Rafael Micro R820T tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_R820T;
-		goto found;
+		known = 0;
 	}
 
-	reg = rtlsdr_i2c_read_reg(dev, R828D_I2C_ADDR, R82XX_CHECK_ADDR);
-	if (reg == R82XX_CHECK_VAL) {
-		fprintf(stderr, "Found Rafael Micro R828D tuner\n");
+	for (i = 0; i < sizeof(probe_order)/sizeof(probe_order[0]); i++) {
+		/* the FC2580 and FC0012 only answer after a reset */
+		if (probe_order[i] == RTLSDR_TUNER_FC2580)
+			_rtlsdr_reset_tuner(dev);
 
-		if (rtlsdr_check_dongle_model(dev, "RTLSDRBlog", "Blog V4"))
-			fprintf(stderr, "RTL-SDR Blog V4 Detected\n");
-
-		dev->tuner_type = RTLSDR_TUNER_R828D;
-		goto found;
+		if (_rtlsdr_probe_tuner(dev, probe_order[i])) {
+			dev->tuner_type = probe_order[i];
+			break;
+		}
 	}
 
-	/* initialise GPIOs */
-	rtlsdr_set_gpio_output(dev, 4);
-
-	/* reset tuner before probing */
-	rtlsdr_set_gpio_bit(dev, 4, 1);
-	rtlsdr_set_gpio_bit(dev, 4, 0);
-
-	reg = rtlsdr_i2c_read_reg(dev, FC2580_I2C_ADDR, FC2580_CHECK_ADDR);
-	if ((reg & 0x7f) == FC2580_CHECK_VAL) {
-		fprintf(stderr, "Found FCI 2580 tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_FC2580;
-		goto found;
-	}
+found:
+	if (dev->tuner_type != RTLSDR_TUNER_UNKNOWN)
+		fprintf(stderr, "Found %s tuner\n", tuner_names[dev->tuner_type]);
 
-	reg = rtlsdr_i2c_read_reg(dev, FC0012_I2C_ADDR, FC0012_CHECK_ADDR);
-	if (reg == FC0012_CHECK_VAL) {
-		fprintf(stderr, "Found Fitipower FC0012 tuner\n");
+	if (dev->tuner_type == RTLSDR_TUNER_FC0012)
 		rtlsdr_set_gpio_output(dev, 6);
-		dev->tuner_type = RTLSDR_TUNER_FC0012;
-		goto found;
-	}
 
-found:
+	/* keep the crystal frequencies calibrated in an earlier session */
+	if (known)
+		dev->rtl_xtal = st.rtl_xtal;
+
 	/* use the rtl clock value by default */
 	dev->tun_xtal = dev->rtl_xtal;
 	dev->tuner = &tuners[dev->tuner_type];
 
 	switch (dev->tuner_type) {
 	case RTLSDR_TUNER_R828D:
-		/* If NOT an RTL-SDR Blog V4, set typical R828D 16 MHz freq. Otherwise, keep at 28.8 MHz. */
-		if (!(rtlsdr_check_dongle_model(dev, "RTLSDRBlog", "Blog V4"))) {
+		/* typical R828D 16 MHz freq, unless it shares the 28.8 MHz of the RTL */
+		if (!dev->model->tuner_on_rtl_xtal)
 			dev->tun_xtal = R828D_XTAL_FREQ;
-		}
 		/* fall-through */
 	case RTLSDR_TUNER_R820T:
 		/* disable Zero-IF mode */
@@ -1634,375 +2975,2036 @@ found:
 		break;
 	}
 
+	if (known)
+		dev->tun_xtal = st.tun_xtal;
+
 	if (dev->tuner->init)
 		r = dev->tuner->init(dev);
 
 	rtlsdr_set_i2c_repeater(dev, 0);
 
-	*out_dev = dev;
-
-	return 0;
-err:
-	if (dev) {
-		if (dev->devh)
-			libusb_close(dev->devh);
+	_rtlsdr_gain_images(dev);
 
-		if (dev->ctx)
-			libusb_exit(dev->ctx);
+	if (!known)
+		_rtlsdr_state_store(dev);
 
-		free(dev);
-	}
+	if (dev->tuner_type == RTLSDR_TUNER_UNKNOWN || r < 0)
+		return -1;
 
-	return r;
+	return 0;
 }
 
-int rtlsdr_close(rtlsdr_dev_t *dev)
+static int _rtlsdr_open(rtlsdr_dev_t **out_dev,
+			const struct rtlsdr_usb_match *m, rtlsdr_ctx_t *group)
 {
-	if (!dev)
-		return -1;
+	int r;
+	rtlsdr_dev_t *dev = NULL;
 
-	if(!dev->dev_lost) {
-		/* block until all async operations have been completed (if any) */
-		while (RTLSDR_INACTIVE != dev->async_status) {
-#ifdef _WIN32
-			Sleep(1);
-#else
-			usleep(1000);
-#endif
-		}
+	dev = malloc(sizeof(rtlsdr_dev_t));
+	if (NULL == dev)
+		return -ENOMEM;
 
-		rtlsdr_deinit_baseband(dev);
+	memset(dev, 0, sizeof(rtlsdr_dev_t));
+	memcpy(dev->fir, fir_default, sizeof(fir_default));
+
+	if (group) {
+		dev->group = group;
+		dev->ctx = group->usb;
+	} else {
+		r = libusb_init(&dev->ctx);
+		if(r < 0){
+			free(dev);
+			return -1;
+		}
 	}
 
-	libusb_release_interface(dev->devh, 0);
+	dev->dev_lost = 1;
+	dev->tp = &_rtlsdr_usb_transport;
+	dev->tp_priv = dev;
 
-#ifdef DETACH_KERNEL_DRIVER
-	if (dev->driver_active) {
-		if (!libusb_attach_kernel_driver(dev->devh, 0))
-			fprintf(stderr, "Reattached kernel driver\n");
-		else
-			fprintf(stderr, "Reattaching kernel driver failed!\n");
+	r = _rtlsdr_open_usb(dev, m, &dev->devh);
+	if (r < 0)
+		goto err;
+
+	/* dongles without a supported tuner remain usable in direct
+	 * sampling mode */
+	_rtlsdr_init_device(dev);
+
+	if (group) {
+		pthread_mutex_lock(&group->lock);
+		dev->group_next = group->devs;
+		group->devs = dev;
+		pthread_mutex_unlock(&group->lock);
 	}
-#endif
 
-	libusb_close(dev->devh);
+	*out_dev = dev;
+
+	return 0;
+err:
+	if (dev->ctx && !dev->group)
+		libusb_exit(dev->ctx);
 
-	libusb_exit(dev->ctx);
+	free(dev);
+
+	return r;
+}
+
+int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
+{
+	struct rtlsdr_usb_match m;
+
+	memset(&m, 0, sizeof(m));
+	m.index = index;
+
+	return _rtlsdr_open(out_dev, &m, NULL);
+}
+
+int rtlsdr_open_by_serial(rtlsdr_dev_t **out_dev, const char *serial)
+{
+	struct rtlsdr_usb_match m;
+
+	if (!serial)
+		return -1;
+
+	memset(&m, 0, sizeof(m));
+	m.serial = serial;
+
+	return _rtlsdr_open(out_dev, &m, NULL);
+}
+
+/* parse a port path of the form <bus>-<port>[.<port>...] */
+static int _rtlsdr_parse_path(const char *path, struct rtlsdr_usb_match *m)
+{
+	unsigned long val;
+	char *end;
+
+	val = strtoul(path, &end, 10);
+	if (end == path || *end != '-' || val > 255)
+		return -1;
+
+	m->bus = (uint8_t)val;
+
+	do {
+		path = end + 1;
+		val = strtoul(path, &end, 10);
+		if (end == path || val > 255 ||
+		    m->port_depth == RTLSDR_PORT_PATH_MAX)
+			return -1;
+
+		m->port_path[m->port_depth++] = (uint8_t)val;
+	} while (*end == '.');
+
+	return *end ? -1 : 0;
+}
+
+int rtlsdr_open_by_path(rtlsdr_dev_t **out_dev, const char *path)
+{
+	struct rtlsdr_usb_match m;
+
+	memset(&m, 0, sizeof(m));
+
+	if (!path || _rtlsdr_parse_path(path, &m) < 0)
+		return -1;
+
+	return _rtlsdr_open(out_dev, &m, NULL);
+}
+
+static int _rtlsdr_open_sim(rtlsdr_dev_t **out_dev, void *sim)
+{
+	rtlsdr_dev_t *dev = NULL;
+
+	if (!sim)
+		return -1;
+
+	dev = malloc(sizeof(rtlsdr_dev_t));
+	if (NULL == dev) {
+		rtlsdr_sim_transport.close(sim);
+		return -ENOMEM;
+	}
+
+	memset(dev, 0, sizeof(rtlsdr_dev_t));
+	memcpy(dev->fir, fir_default, sizeof(fir_default));
+
+	dev->tp = &rtlsdr_sim_transport;
+	dev->tp_priv = sim;
+
+	if (_rtlsdr_init_device(dev) < 0) {
+		fprintf(stderr, "Simulated tuner failed to initialize\n");
+		rtlsdr_sim_transport.close(sim);
+		free(dev);
+		return -1;
+	}
+
+	*out_dev = dev;
+
+	return 0;
+}
+
+int rtlsdr_open_sim(rtlsdr_dev_t **out_dev, const char *args)
+{
+	return _rtlsdr_open_sim(out_dev, rtlsdr_sim_create(args));
+}
+
+int rtlsdr_open_file(rtlsdr_dev_t **out_dev, const char *path, int realtime)
+{
+	if (!path)
+		return -1;
+
+	return _rtlsdr_open_sim(out_dev, rtlsdr_sim_create_file(path,
+								 realtime));
+}
+
+int rtlsdr_close(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	if (dev->stream_mode)
+		rtlsdr_stream_stop(dev);
+
+	/* block until all async operations have been completed (if any),
+	 * a shared event thread also retires those of a lost device */
+	if (!dev->dev_lost || dev->group) {
+		while (RTLSDR_INACTIVE != dev->async_status) {
+#ifdef _WIN32
+			Sleep(1);
+#else
+			usleep(1000);
+#endif
+		}
+	}
+
+	if(!dev->dev_lost)
+		rtlsdr_deinit_baseband(dev);
+
+	/* buffers may be left over from rtlsdr_read_async_deferred() */
+	_rtlsdr_free_async_buffers(dev);
+	_rtlsdr_free_plan(dev);
+	rtlsdr_iq_corr_destroy(dev->iq_corr);
+	rtlsdr_ddc_destroy(dev->ddc);
+
+	dev->tp->close(dev->tp_priv);
+
+	if (dev->group)
+		_rtlsdr_ctx_unlink(dev->group, dev);
+	else if (dev->ctx)
+		libusb_exit(dev->ctx);
+
+	free(dev);
+
+	return 0;
+}
+
+int rtlsdr_reset_buffer(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	rtlsdr_write_reg(dev, USBB, USB_EPA_CTL, 0x1002, 2);
+	rtlsdr_write_reg(dev, USBB, USB_EPA_CTL, 0x0000, 2);
+
+	return 0;
+}
+
+int rtlsdr_read_sync(rtlsdr_dev_t *dev, void *buf, int len, int *n_read)
+{
+	if (!dev)
+		return -1;
+
+	return dev->tp->bulk(dev->tp_priv, 0x81, buf, len, n_read, BULK_TIMEOUT);
+}
+
+static int _rtlsdr_ring_init(struct rtlsdr_ring *ring, uint32_t num)
+{
+	uint32_t i, size = 1;
+
+	while (size < num)
+		size <<= 1;
+
+	ring->cell = malloc(size * sizeof(struct rtlsdr_ring_cell));
+	if (!ring->cell)
+		return -ENOMEM;
+
+	/* a cell is writable when seq == position, readable when
+	 * seq == position + 1 */
+	for (i = 0; i < size; i++)
+		ring->cell[i].seq = i;
+
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+
+	return 0;
+}
+
+static void _rtlsdr_ring_free(struct rtlsdr_ring *ring)
+{
+	free(ring->cell);
+	ring->cell = NULL;
+}
+
+/* must only be called from the consumer side of the ring */
+static int _rtlsdr_ring_empty(struct rtlsdr_ring *ring)
+{
+	uint32_t tail = ring->tail;
+
+	return rtlsdr_load32(&ring->cell[tail & ring->mask].seq) != tail + 1;
+}
+
+/* may be called from any thread */
+static int _rtlsdr_ring_push(struct rtlsdr_ring *ring, uint32_t val)
+{
+	struct rtlsdr_ring_cell *cell;
+	uint32_t pos = rtlsdr_load32(&ring->head);
+	int32_t diff;
+
+	for (;;) {
+		cell = &ring->cell[pos & ring->mask];
+		diff = (int32_t)(rtlsdr_load32(&cell->seq) - pos);
+
+		if (diff == 0) {
+			if (rtlsdr_cas32(&ring->head, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return -1; /* full */
+		} else {
+			pos = rtlsdr_load32(&ring->head);
+		}
+	}
+
+	cell->val = val;
+	rtlsdr_store32(&cell->seq, pos + 1);
+
+	return 0;
+}
+
+/* must only be called from the consumer side of the ring */
+static int _rtlsdr_ring_pop(struct rtlsdr_ring *ring, uint32_t *val)
+{
+	struct rtlsdr_ring_cell *cell;
+	uint32_t tail = ring->tail;
+
+	cell = &ring->cell[tail & ring->mask];
+	if (rtlsdr_load32(&cell->seq) != tail + 1)
+		return -1;
+
+	*val = cell->val;
+	rtlsdr_store32(&cell->seq, tail + ring->mask + 1);
+	ring->tail = tail + 1;
+
+	return 0;
+}
+
+static void _rtlsdr_stream_wakeup(rtlsdr_dev_t *dev)
+{
+	/* pairs with the fence in rtlsdr_stream_acquire() */
+	rtlsdr_fence();
+
+	if (!rtlsdr_load32(&dev->stream_waiting))
+		return;
+
+	pthread_mutex_lock(&dev->stream_lock);
+	pthread_cond_signal(&dev->stream_cond);
+	pthread_mutex_unlock(&dev->stream_lock);
+}
+
+static uint64_t _rtlsdr_monotonic_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER cnt, freq;
+
+	QueryPerformanceCounter(&cnt);
+	QueryPerformanceFrequency(&freq);
+
+	return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000ULL +
+	       (uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000ULL /
+	       freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* describe a completed buffer, called from the event thread only */
+static void _rtlsdr_fill_info(rtlsdr_dev_t *dev, struct rtlsdr_block *block)
+{
+	rtlsdr_buffer_info_t *info = &block->pub.info;
+	uint32_t seq = rtlsdr_load32(&dev->settings_seq);
+
+	info->sample_index = dev->sample_count;
+	info->timestamp_ns = _rtlsdr_monotonic_ns();
+	info->center_freq = dev->freq;
+	info->sample_rate = dev->rate;
+	info->gain = dev->gain;
+	info->flags = dev->pending_flags;
+
+	if (seq != dev->settings_seen) {
+		info->flags |= RTLSDR_BUF_RETUNE;
+		dev->settings_seen = seq;
+	}
+
+	dev->pending_flags = 0;
+	dev->sample_count += block->pub.len / 2;
+	info->retune_index = rtlsdr_load64(&dev->retune_index);
+
+	/* publish the sample clock for _rtlsdr_mark_retune() */
+	rtlsdr_add32(&dev->clock_seq, 1);
+	rtlsdr_fence();
+	dev->clock_index = dev->sample_count;
+	dev->clock_ts = info->timestamp_ns;
+	rtlsdr_fence();
+	rtlsdr_add32(&dev->clock_seq, 1);
+}
+
+/*
+ * Record the index of the first sample captured after a settings change.
+ * The index is extrapolated from the arrival time of the last buffer, as
+ * samples still sitting in the device FIFO were taken before the change.
+ */
+static void _rtlsdr_mark_retune(rtlsdr_dev_t *dev)
+{
+	uint64_t index, ts, now, dt;
+	uint32_t seq;
+
+	do {
+		seq = rtlsdr_load32(&dev->clock_seq);
+		index = dev->clock_index;
+		ts = dev->clock_ts;
+		rtlsdr_fence();
+	} while ((seq & 1) || seq != rtlsdr_load32(&dev->clock_seq));
+
+	if (ts) {
+		now = _rtlsdr_monotonic_ns();
+		if (now > ts) {
+			/* split the interval, ns * rate overflows after minutes */
+			dt = now - ts;
+			index += dt / 1000000000ULL * (uint64_t)dev->rate +
+				 dt % 1000000000ULL * (uint64_t)dev->rate /
+				 1000000000ULL;
+		}
+	}
+
+	rtlsdr_store64(&dev->retune_index, index);
+	rtlsdr_add32(&dev->settings_seq, 1);
+}
+
+static void _rtlsdr_xfer_attach(struct libusb_transfer *xfer,
+				struct rtlsdr_block *block)
+{
+	xfer->buffer = block->pub.buf;
+	xfer->user_data = block;
+}
+
+/* submit a transfer, keeping track of the number in flight */
+static int _rtlsdr_submit_xfer(rtlsdr_dev_t *dev, struct libusb_transfer *xfer)
+{
+	int r;
+
+	/* count before submitting, the completion may come first */
+	rtlsdr_add32(&dev->stat_in_flight, 1);
+
+	r = dev->tp->submit(dev->tp_priv, xfer);
+	if (r < 0)
+		rtlsdr_add32(&dev->stat_in_flight, -1);
+
+	return r;
+}
+
+/* resubmit parked transfers for every buffer that has been released */
+static void _rtlsdr_submit_parked(rtlsdr_dev_t *dev)
+{
+	struct libusb_transfer *xfer;
+	uint32_t idx;
+
+	while (dev->parked_num > 0 &&
+	       !_rtlsdr_ring_pop(&dev->free_ring, &idx)) {
+		xfer = dev->parked[dev->parked_num - 1];
+		rtlsdr_store32(&dev->parked_num, dev->parked_num - 1);
+
+		_rtlsdr_xfer_attach(xfer, &dev->blocks[idx]);
+		_rtlsdr_submit_xfer(dev, xfer);
+	}
+}
+
+/* count a duration into a histogram with power of two microsecond bins */
+static void _rtlsdr_hist_add(uint32_t *hist, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	unsigned int bin = 0;
+
+	while (us && bin < RTLSDR_STATS_HIST_BINS - 1) {
+		us >>= 1;
+		bin++;
+	}
+
+	rtlsdr_store32(&hist[bin], hist[bin] + 1);
+}
+
+/* account the deviation of a buffer arrival from the sample clock */
+static void _rtlsdr_stat_arrival(rtlsdr_dev_t *dev, uint64_t prev_ts,
+				 struct rtlsdr_block *block)
+{
+	uint64_t expect, delta;
+
+	rtlsdr_store64(&dev->stat_completed, dev->stat_completed + 1);
+
+	if (!prev_ts || !dev->rate)
+		return;
+
+	/* time it takes to sample the previous buffer's worth of data */
+	expect = (uint64_t)block->pub.len / 2 * 1000000000ULL / dev->rate;
+	delta = block->pub.info.timestamp_ns - prev_ts;
+
+	_rtlsdr_hist_add(dev->stat_jitter_hist,
+			 delta > expect ? delta - expect : expect - delta);
+}
+
+static void LIBUSB_CALL _libusb_callback(struct libusb_transfer *xfer)
+{
+	struct rtlsdr_block *block = (struct rtlsdr_block *)xfer->user_data;
+	rtlsdr_dev_t *dev = block->dev;
+	uint32_t idx, in_flight;
+	uint64_t arrival;
+
+	in_flight = rtlsdr_add32(&dev->stat_in_flight, -1) - 1;
+	if (RTLSDR_RUNNING == dev->async_status &&
+	    in_flight < dev->stat_min_in_flight)
+		rtlsdr_store32(&dev->stat_min_in_flight, in_flight);
+
+	if (LIBUSB_TRANSFER_COMPLETED == xfer->status) {
+		arrival = dev->clock_ts;
+		block->pub.len = xfer->actual_length;
+		_rtlsdr_fill_info(dev, block);
+		_rtlsdr_stat_arrival(dev, arrival, block);
+		arrival = block->pub.info.timestamp_ns;
+		dev->xfer_errors = 0;
+
+		/* follow sample rate changes of the latency target */
+		xfer->length = rtlsdr_load32(&dev->xfer_len);
+
+		if (dev->stream_mode) {
+			/* hand the buffer over to the consumer and continue
+			 * with a free one, drop the data if there is none */
+			if (!_rtlsdr_ring_pop(&dev->free_ring, &idx)) {
+				_rtlsdr_ring_push(&dev->fill_ring, block->idx);
+				_rtlsdr_stream_wakeup(dev);
+				_rtlsdr_xfer_attach(xfer, &dev->blocks[idx]);
+			} else {
+				/* carry the flags over to the next buffer */
+				dev->pending_flags |= block->pub.info.flags |
+						      RTLSDR_BUF_GAP;
+				rtlsdr_add32(&dev->stream_overflows, 1);
+			}
+
+			_rtlsdr_submit_xfer(dev, xfer);
+		} else if (dev->buf_cb) {
+			/* continue with a spare buffer, or park the transfer
+			 * until the consumer releases one */
+			if (!_rtlsdr_ring_pop(&dev->free_ring, &idx)) {
+				_rtlsdr_xfer_attach(xfer, &dev->blocks[idx]);
+				_rtlsdr_submit_xfer(dev, xfer);
+			} else {
+				dev->parked[dev->parked_num] = xfer;
+				rtlsdr_store32(&dev->parked_num,
+					       dev->parked_num + 1);
+			}
+
+			_rtlsdr_convert_block(dev, block);
+			dev->buf_cb(&block->pub, dev->cb_ctx);
+		} else {
+			if (dev->ex_cb)
+				dev->ex_cb(xfer->buffer, xfer->actual_length,
+					   &block->pub.info, dev->cb_ctx);
+			else if (dev->cb)
+				dev->cb(xfer->buffer, xfer->actual_length,
+					dev->cb_ctx);
+
+			_rtlsdr_submit_xfer(dev, xfer); /* resubmit transfer */
+		}
+
+		_rtlsdr_hist_add(dev->stat_cb_hist,
+				 _rtlsdr_monotonic_ns() - arrival);
+	} else if (LIBUSB_TRANSFER_CANCELLED != xfer->status) {
+		/* the data of this transfer is lost, the samples of a lost
+		 * device are accounted for when it is recovered */
+		dev->pending_flags |= RTLSDR_BUF_GAP;
+		rtlsdr_store64(&dev->stat_errored, dev->stat_errored + 1);
+		if (LIBUSB_TRANSFER_NO_DEVICE != xfer->status)
+			dev->sample_count += xfer->length / 2;
+
+#ifndef _WIN32
+		if (LIBUSB_TRANSFER_ERROR == xfer->status)
+			dev->xfer_errors++;
+
+		if (dev->xfer_errors >= dev->xfer_buf_num ||
+		    LIBUSB_TRANSFER_NO_DEVICE == xfer->status) {
+#endif
+			/* once per loss, a replay reports its own end */
+			if (!dev->dev_lost && dev->devh)
+				fprintf(stderr, "cb transfer status: %d, "
+					"canceling...\n", xfer->status);
+			dev->dev_lost = 1;
+#ifndef _WIN32
+		}
+#endif
+	}
+}
+
+int rtlsdr_set_latency_target(rtlsdr_dev_t *dev, uint32_t latency_us)
+{
+	if (!dev)
+		return -1;
+
+	dev->latency_us = latency_us;
+
+	return 0;
+}
+
+int rtlsdr_set_auto_recovery(rtlsdr_dev_t *dev, int on)
+{
+	/* only a USB device can be reopened */
+	if (!dev || !dev->devh)
+		return -1;
+
+	dev->auto_recover = on ? 1 : 0;
+
+	return 0;
+}
+
+int rtlsdr_wait_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx)
+{
+	return rtlsdr_read_async(dev, cb, ctx, 0, 0);
+}
+
+/* bytes it takes to fill a transfer in latency_us at the given rate */
+static uint32_t _rtlsdr_latency_len(uint32_t latency_us, uint32_t rate,
+				    uint32_t max_len)
+{
+	uint64_t len = (uint64_t)rate * 2 * latency_us / 1000000;
+
+	len &= ~(uint64_t)511; /* len must be multiple of 512 */
+
+	if (len < 512)
+		len = 512;
+	if (len > max_len)
+		len = max_len;
+
+	return (uint32_t)len;
+}
+
+/* shorten the transfers after a sample rate change, takes effect as the
+ * transfers get resubmitted */
+static void _rtlsdr_update_xfer_len(rtlsdr_dev_t *dev)
+{
+	uint32_t len = dev->xfer_buf_len;
+
+	if (dev->xfer_adaptive && dev->latency_us && dev->rate)
+		len = _rtlsdr_latency_len(dev->latency_us, dev->rate, len);
+
+	rtlsdr_store32(&dev->xfer_len, len);
+}
+
+static void _rtlsdr_set_async_geometry(rtlsdr_dev_t *dev, uint32_t buf_num,
+				       uint32_t buf_len)
+{
+	uint32_t len;
+
+	dev->xfer_adaptive = 0;
+
+	if (buf_num > 0) {
+		dev->xfer_buf_num = buf_num;
+	} else if (dev->latency_us) {
+		/* keep enough transfers queued to ride out host stalls */
+		buf_num = LATENCY_SLACK_US / dev->latency_us;
+		if (buf_num < MIN_LATENCY_BUF_NUMBER)
+			buf_num = MIN_LATENCY_BUF_NUMBER;
+		if (buf_num > MAX_LATENCY_BUF_NUMBER)
+			buf_num = MAX_LATENCY_BUF_NUMBER;
+		dev->xfer_buf_num = buf_num;
+	} else {
+		dev->xfer_buf_num = DEFAULT_BUF_NUMBER;
+	}
+
+	if (buf_len > 0 && buf_len % 512 == 0) { /* len must be multiple of 512 */
+		dev->xfer_buf_len = buf_len;
+	} else if (dev->latency_us) {
+		/* size the buffers for the highest rate, so the transfers
+		 * can follow rate changes without reallocation */
+		len = _rtlsdr_latency_len(dev->latency_us, MAX_SAMP_RATE,
+					  MAX_LATENCY_BUF_LENGTH);
+		dev->xfer_buf_len = (len + 16383) & ~16383; /* URB size */
+		dev->xfer_adaptive = 1;
+	} else {
+		dev->xfer_buf_len = DEFAULT_BUF_LENGTH;
+	}
+
+	dev->buf_pool_num = dev->xfer_buf_num;
+
+	_rtlsdr_update_xfer_len(dev);
+}
+
+/* bytes per sample of a stream format */
+static uint32_t _rtlsdr_format_size(enum rtlsdr_sample_format format)
+{
+	switch (format) {
+	case RTLSDR_FMT_S16:
+		return sizeof(int16_t);
+	case RTLSDR_FMT_F32:
+		return sizeof(float);
+	default:
+		return 1;
+	}
+}
+
+/* convert a buffer to the stream format right before it is handed out */
+static void _rtlsdr_convert_block(rtlsdr_dev_t *dev, struct rtlsdr_block *block)
+{
+	rtlsdr_buffer_t *b = &block->pub;
+	uint32_t len = b->len;
+
+	switch (dev->stream_format) {
+	case RTLSDR_FMT_S16:
+		rtlsdr_convert_s16(b->buf, b->samples, b->len);
+		break;
+	case RTLSDR_FMT_F32:
+		rtlsdr_convert_f32(b->buf, b->samples, b->len);
+		if (dev->iq_corr) {
+			/* the DC offset moves with the frequency */
+			if (b->info.flags & RTLSDR_BUF_RETUNE)
+				rtlsdr_iq_corr_reset(dev->iq_corr);
+			rtlsdr_iq_corr_process(dev->iq_corr, b->samples, b->len);
+		}
+		if (dev->ddc)
+			len = rtlsdr_ddc_process(dev->ddc, b->samples, b->len,
+						 b->samples);
+		break;
+	default:
+		break;
+	}
+
+	b->samples_len = len * _rtlsdr_format_size(dev->stream_format);
+}
+
+int rtlsdr_set_stream_format(rtlsdr_dev_t *dev,
+			     enum rtlsdr_sample_format format)
+{
+	if (!dev || format < RTLSDR_FMT_U8 || format > RTLSDR_FMT_F32)
+		return -1;
+
+	/* the conversion buffers are allocated along with the stream */
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	dev->stream_format = format;
+
+	return 0;
+}
+
+int rtlsdr_set_iq_correction(rtlsdr_dev_t *dev, uint32_t flags)
+{
+	rtlsdr_iq_corr_t *corr = NULL;
+
+	if (!dev)
+		return -1;
+
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	if (flags) {
+		corr = rtlsdr_iq_corr_create(flags, 0);
+		if (!corr)
+			return -ENOMEM;
+	}
+
+	rtlsdr_iq_corr_destroy(dev->iq_corr);
+	dev->iq_corr = corr;
+
+	return 0;
+}
+
+int rtlsdr_set_stream_ddc(rtlsdr_dev_t *dev, int32_t offset, uint32_t decim)
+{
+	rtlsdr_ddc_t *ddc = NULL;
+
+	if (!dev)
+		return -1;
+
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	if (decim) {
+		if (!dev->rate)
+			return -1;
+		ddc = rtlsdr_ddc_create(dev->rate, offset, decim);
+		if (!ddc)
+			return -1;
+	}
+
+	rtlsdr_ddc_destroy(dev->ddc);
+	dev->ddc = ddc;
+
+	return 0;
+}
+
+static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
+{
+	unsigned int i;
+	uint32_t conv_len;
+
+	if (!dev)
+		return -1;
+
+	if (!dev->xfer) {
+		dev->xfer = malloc(dev->xfer_buf_num *
+				   sizeof(struct libusb_transfer *));
+
+		for(i = 0; i < dev->xfer_buf_num; ++i)
+			dev->xfer[i] = libusb_alloc_transfer(0);
+	}
+
+	if (dev->xfer_buf)
+		return -2;
+
+	dev->xfer_buf = malloc(dev->buf_pool_num * sizeof(unsigned char *));
+	memset(dev->xfer_buf, 0, dev->buf_pool_num * sizeof(unsigned char *));
+
+#if defined(ENABLE_ZEROCOPY) && defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
+	/* device memory can only be mapped with the USB transport */
+	dev->use_zerocopy = dev->devh != NULL;
+	if (dev->use_zerocopy)
+		fprintf(stderr, "Allocating %d zero-copy buffers\n",
+			dev->buf_pool_num);
+
+	for (i = 0; dev->use_zerocopy && i < dev->buf_pool_num; ++i) {
+		dev->xfer_buf[i] = libusb_dev_mem_alloc(dev->devh, dev->xfer_buf_len);
+
+		if (dev->xfer_buf[i]) {
+			/* Check if Kernel usbfs mmap() bug is present: if the
+			 * mapping is correct, the buffers point to memory that
+			 * was memset to 0 by the Kernel, otherwise, they point
+			 * to random memory. We check if the buffers are zeroed
+			 * and otherwise fall back to buffers in userspace.
+			 */
+			if (dev->xfer_buf[i][0] || memcmp(dev->xfer_buf[i],
+							  dev->xfer_buf[i] + 1,
+							  dev->xfer_buf_len - 1)) {
+				fprintf(stderr, "Detected Kernel usbfs mmap() "
+						"bug, falling back to buffers "
+						"in userspace\n");
+				dev->use_zerocopy = 0;
+				break;
+			}
+		} else {
+			fprintf(stderr, "Failed to allocate zero-copy "
+					"buffer for transfer %d\nFalling "
+					"back to buffers in userspace\n", i);
+			dev->use_zerocopy = 0;
+			break;
+		}
+	}
+
+	/* zero-copy buffer allocation failed (partially or completely)
+	 * we need to free the buffers again if already allocated */
+	if (!dev->use_zerocopy) {
+		for (i = 0; i < dev->buf_pool_num; ++i) {
+			if (dev->xfer_buf[i])
+				libusb_dev_mem_free(dev->devh,
+						    dev->xfer_buf[i],
+						    dev->xfer_buf_len);
+		}
+	}
+#endif
+
+	/* no zero-copy available, allocate buffers in userspace */
+	if (!dev->use_zerocopy) {
+		for (i = 0; i < dev->buf_pool_num; ++i) {
+			dev->xfer_buf[i] = malloc(dev->xfer_buf_len);
+
+			if (!dev->xfer_buf[i])
+				return -ENOMEM;
+		}
+	}
+
+	dev->blocks = malloc(dev->buf_pool_num * sizeof(struct rtlsdr_block));
+	if (!dev->blocks)
+		return -ENOMEM;
+
+	conv_len = dev->xfer_buf_len * _rtlsdr_format_size(dev->stream_format);
+	if (dev->stream_format != RTLSDR_FMT_U8) {
+		dev->conv_buf = malloc((size_t)dev->buf_pool_num * conv_len);
+		if (!dev->conv_buf)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < dev->buf_pool_num; ++i) {
+		dev->blocks[i].pub.buf = dev->xfer_buf[i];
+		dev->blocks[i].pub.len = 0;
+		dev->blocks[i].pub.samples = dev->conv_buf ?
+			dev->conv_buf + (size_t)i * conv_len : dev->xfer_buf[i];
+		dev->blocks[i].pub.samples_len = 0;
+		dev->blocks[i].dev = dev;
+		dev->blocks[i].idx = i;
+	}
+
+	return 0;
+}
+
+static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev)
+{
+	unsigned int i;
+
+	if (!dev)
+		return -1;
+
+	if (dev->xfer) {
+		for(i = 0; i < dev->xfer_buf_num; ++i) {
+			if (dev->xfer[i]) {
+				libusb_free_transfer(dev->xfer[i]);
+			}
+		}
+
+		free(dev->xfer);
+		dev->xfer = NULL;
+	}
+
+	if (dev->xfer_buf) {
+		for (i = 0; i < dev->buf_pool_num; ++i) {
+			if (dev->xfer_buf[i]) {
+				if (dev->use_zerocopy) {
+#if defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
+					libusb_dev_mem_free(dev->devh,
+							    dev->xfer_buf[i],
+							    dev->xfer_buf_len);
+#endif
+				} else {
+					free(dev->xfer_buf[i]);
+				}
+			}
+		}
+
+		free(dev->xfer_buf);
+		dev->xfer_buf = NULL;
+	}
+
+	free(dev->blocks);
+	dev->blocks = NULL;
+
+	free(dev->conv_buf);
+	dev->conv_buf = NULL;
+
+	free(dev->parked);
+	dev->parked = NULL;
+	dev->parked_num = 0;
+
+	_rtlsdr_ring_free(&dev->free_ring);
+	_rtlsdr_ring_free(&dev->fill_ring);
+
+	return 0;
+}
+
+/* set up the free list for a pool with spare buffers */
+static int _rtlsdr_alloc_buffer_pool(rtlsdr_dev_t *dev)
+{
+	uint32_t i;
+
+	if (_rtlsdr_alloc_async_buffers(dev) < 0 ||
+	    _rtlsdr_ring_init(&dev->free_ring, dev->buf_pool_num) < 0)
+		return -ENOMEM;
+
+	dev->parked = malloc(dev->xfer_buf_num *
+			     sizeof(struct libusb_transfer *));
+	if (!dev->parked)
+		return -ENOMEM;
+
+	dev->parked_num = 0;
+
+	/* the first xfer_buf_num buffers are owned by the transfers */
+	for (i = dev->xfer_buf_num; i < dev->buf_pool_num; i++)
+		_rtlsdr_ring_push(&dev->free_ring, i);
+
+	return 0;
+}
+
+/* reset the stream metadata and submit all transfers */
+static int _rtlsdr_submit_async(rtlsdr_dev_t *dev)
+{
+	unsigned int i;
+	int r = 0;
+
+	dev->sample_count = 0;
+	dev->pending_flags = 0;
+	dev->settings_seen = rtlsdr_load32(&dev->settings_seq);
+	dev->clock_index = 0;
+	dev->clock_ts = 0;
+	dev->retune_index = 0;
+
+	dev->stat_completed = 0;
+	dev->stat_errored = 0;
+	dev->stat_in_flight = 0;
+	dev->stat_min_in_flight = dev->xfer_buf_num;
+	memset(dev->stat_cb_hist, 0, sizeof(dev->stat_cb_hist));
+	memset(dev->stat_jitter_hist, 0, sizeof(dev->stat_jitter_hist));
+
+	for(i = 0; i < dev->xfer_buf_num; ++i) {
+		libusb_fill_bulk_transfer(dev->xfer[i],
+					  dev->devh,
+					  0x81,
+					  dev->xfer_buf[i],
+					  dev->xfer_len,
+					  _libusb_callback,
+					  (void *)&dev->blocks[i],
+					  BULK_TIMEOUT);
+
+		r = _rtlsdr_submit_xfer(dev, dev->xfer[i]);
+		if (r < 0) {
+			fprintf(stderr, "Failed to submit transfer %i\n"
+					"Please increase your allowed " 
+					"usbfs buffer size with the "
+					"following command:\n"
+					"echo 0 > /sys/module/usbcore"
+					"/parameters/usbfs_memory_mb\n", i);
+			dev->async_status = RTLSDR_CANCELING;
+			break;
+		}
+	}
+
+	return r;
+}
+
+/* forget about the parked transfers, their buffer belongs to the consumer
+ * already */
+static void _rtlsdr_drop_parked(rtlsdr_dev_t *dev)
+{
+	struct libusb_transfer *xfer;
+
+	while (dev->parked_num > 0) {
+		xfer = dev->parked[dev->parked_num - 1];
+		xfer->status = LIBUSB_TRANSFER_CANCELLED;
+		xfer->user_data = NULL;
+		rtlsdr_store32(&dev->parked_num, dev->parked_num - 1);
+	}
+}
+
+/* cancel all transfers still in flight, returns RTLSDR_INACTIVE once
+ * there are none left */
+static enum rtlsdr_async_status _rtlsdr_cancel_xfers(rtlsdr_dev_t *dev)
+{
+	unsigned int i;
+	int r;
+	struct timeval zerotv = { 0, 0 };
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	if (!dev->xfer)
+		return RTLSDR_INACTIVE;
+
+	/* parked transfers are not submitted, so there is nothing to
+	 * cancel */
+	_rtlsdr_drop_parked(dev);
+
+	for(i = 0; i < dev->xfer_buf_num; ++i) {
+		if (!dev->xfer[i])
+			continue;
+
+		if (LIBUSB_TRANSFER_CANCELLED != dev->xfer[i]->status) {
+			r = dev->tp->cancel(dev->tp_priv, dev->xfer[i]);
+			/* handle events after canceling
+			 * to allow transfer status to
+			 * propagate */
+#ifdef _WIN32
+			Sleep(1);
+#endif
+			dev->tp->handle_events(dev->tp_priv, &zerotv, NULL);
+			if (r < 0)
+				continue;
+
+			next_status = RTLSDR_CANCELING;
+		}
+	}
+
+	return next_status;
+}
+
+/* device settings restored after recovering a lost device */
+struct rtlsdr_state {
+	uint32_t rtl_xtal;
+	uint32_t tun_xtal;
+	uint32_t rate;
+	uint32_t freq;
+	uint32_t bw;
+	int offset_tuning;
+	int direct_sampling;
+	int corr;
+	int gain;
+	int gain_mode;
+	int agc_mode;
+	uint32_t bias_tee;
+};
+
+static void _rtlsdr_save_state(rtlsdr_dev_t *dev, struct rtlsdr_state *st)
+{
+	st->rtl_xtal = dev->rtl_xtal;
+	st->tun_xtal = dev->tun_xtal;
+	st->rate = dev->rate;
+	st->freq = dev->freq;
+	st->bw = dev->bw;
+	st->offset_tuning = dev->offs_freq ? 1 : 0;
+	st->direct_sampling = dev->direct_sampling;
+	st->corr = dev->corr;
+	st->gain = dev->gain;
+	st->gain_mode = dev->gain_mode;
+	st->agc_mode = dev->agc_mode;
+	st->bias_tee = dev->bias_tee;
+}
+
+static void _rtlsdr_replay_state(rtlsdr_dev_t *dev, struct rtlsdr_state *st)
+{
+	int gpio;
+
+	if (st->rtl_xtal != dev->rtl_xtal || st->tun_xtal != dev->tun_xtal)
+		rtlsdr_set_xtal_freq(dev, st->rtl_xtal, st->tun_xtal);
+
+	if (st->direct_sampling != dev->direct_sampling)
+		rtlsdr_set_direct_sampling(dev, st->direct_sampling);
+
+	if (st->rate)
+		rtlsdr_set_sample_rate(dev, st->rate);
+
+	if (st->bw)
+		rtlsdr_set_tuner_bandwidth(dev, st->bw);
+
+	if (st->offset_tuning)
+		rtlsdr_set_offset_tuning(dev, 1);
+
+	/* the correction is only written when it changes */
+	dev->corr = 0;
+	if (st->corr)
+		rtlsdr_set_freq_correction(dev, st->corr);
+
+	rtlsdr_set_agc_mode(dev, st->agc_mode);
+
+	if (st->gain_mode) {
+		rtlsdr_set_tuner_gain_mode(dev, st->gain_mode);
+		rtlsdr_set_tuner_gain(dev, st->gain);
+	}
+
+	if (st->freq)
+		rtlsdr_set_center_freq(dev, st->freq);
+
+	for (gpio = 0; gpio < 8; gpio++) {
+		if (st->bias_tee & (1 << gpio))
+			rtlsdr_set_bias_tee_gpio(dev, gpio, 1);
+	}
+
+	/* FIR coefficients are restored by rtlsdr_init_baseband() */
+}
+
+/* wait for a lost device to reappear, reopen it in place and restore its
+ * settings, returns 0 once streaming can be resumed */
+static int _rtlsdr_recover(rtlsdr_dev_t *dev)
+{
+	struct rtlsdr_state st;
+	struct libusb_device_handle *devh;
+	struct timeval shorttv = { 0, 1000 };
+	struct rtlsdr_usb_match m;
+	uint64_t ns, missed;
+	int i;
+
+	if (dev->use_zerocopy) {
+		fprintf(stderr, "Device lost, zero-copy buffers can't be "
+				"carried over to a reopened device\n");
+		return -1;
+	}
+
+	/* let the failed and canceled transfers complete */
+	for (i = 0; i < 1000 && rtlsdr_load32(&dev->stat_in_flight); i++)
+		libusb_handle_events_timeout_completed(dev->ctx, &shorttv,
+						       NULL);
+
+	if (rtlsdr_load32(&dev->stat_in_flight))
+		return -1;
+
+	fprintf(stderr, "Device lost, waiting for it to reappear...\n");
+
+	_rtlsdr_save_state(dev, &st);
+
+	/* without a serial number any dongle at the old index will do */
+	memset(&m, 0, sizeof(m));
+	m.index = dev->index;
+	if (dev->serial[0])
+		m.serial = dev->serial;
+
+	while (!dev->async_cancel) {
+		if (!_rtlsdr_open_usb(dev, &m, &devh))
+			break;
+
+		for (i = 0; i < 50 && !dev->async_cancel; i++) {
+#ifdef _WIN32
+			Sleep(10);
+#else
+			usleep(10000);
+#endif
+		}
+	}
+
+	if (dev->async_cancel)
+		return -1;
+
+	libusb_release_interface(dev->devh, 0);
+	libusb_close(dev->devh);
+	dev->devh = devh;
+
+	if (_rtlsdr_init_device(dev) < 0) {
+		fprintf(stderr, "Reopened device has no working tuner\n");
+		dev->dev_lost = 1;
+		return -1;
+	}
+
+	_rtlsdr_replay_state(dev, &st);
+	rtlsdr_reset_buffer(dev);
+
+	/* the sample index carries on as if the device had kept sampling */
+	if (dev->clock_ts && dev->rate) {
+		ns = _rtlsdr_monotonic_ns() - dev->clock_ts;
+		missed = ns / 1000000000 * dev->rate +
+			 ns % 1000000000 * dev->rate / 1000000000;
+		if (dev->clock_index + missed > dev->sample_count)
+			dev->sample_count = dev->clock_index + missed;
+	}
+
+	fprintf(stderr, "Device recovered, resuming\n");
+
+	return 0;
+}
+
+/* resubmit the transfers on a recovered device, transfers that were
+ * parked before get a free buffer or are parked again */
+static int _rtlsdr_resubmit_async(rtlsdr_dev_t *dev)
+{
+	struct libusb_transfer *xfer;
+	uint32_t i, idx;
+	int r = 0;
+
+	dev->xfer_errors = 0;
+
+	/* some may have completed and been parked while canceling */
+	_rtlsdr_drop_parked(dev);
+
+	for (i = 0; i < dev->xfer_buf_num; i++) {
+		xfer = dev->xfer[i];
+		xfer->dev_handle = dev->devh;
+		xfer->length = rtlsdr_load32(&dev->xfer_len);
+
+		if (!xfer->user_data) {
+			if (_rtlsdr_ring_pop(&dev->free_ring, &idx)) {
+				dev->parked[dev->parked_num] = xfer;
+				rtlsdr_store32(&dev->parked_num,
+					       dev->parked_num + 1);
+				continue;
+			}
+
+			_rtlsdr_xfer_attach(xfer, &dev->blocks[idx]);
+		}
+
+		r = _rtlsdr_submit_xfer(dev, xfer);
+		if (r < 0) {
+			dev->async_status = RTLSDR_CANCELING;
+			break;
+		}
+	}
+
+	return r;
+}
+
+/* submit all transfers and run the event loop until the stream ends */
+static int _rtlsdr_run_async(rtlsdr_dev_t *dev,
+			     enum rtlsdr_async_status *status)
+{
+	int r;
+	struct timeval tv = { 1, 0 };
+	struct timeval shorttv = { 0, 1000 };
+	struct timeval zerotv = { 0, 0 };
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	r = _rtlsdr_submit_async(dev);
+
+	while (RTLSDR_INACTIVE != dev->async_status) {
+		/* poll for released buffers while transfers are parked */
+		r = dev->tp->handle_events(dev->tp_priv,
+					   dev->parked_num ? &shorttv : &tv,
+					   &dev->async_cancel);
+		if (r < 0) {
+			/*fprintf(stderr, "handle_events returned: %d\n", r);*/
+			if (r == LIBUSB_ERROR_INTERRUPTED) /* stray signal */
+				continue;
+			break;
+		}
+
+		if (RTLSDR_RUNNING == dev->async_status)
+			_rtlsdr_submit_parked(dev);
+
+		/* Check if device was lost due to transfer errors */
+		if (dev->dev_lost && RTLSDR_RUNNING == dev->async_status) {
+			dev->async_status = RTLSDR_CANCELING;
+		}
+
+		if (RTLSDR_CANCELING == dev->async_status) {
+			next_status = _rtlsdr_cancel_xfers(dev);
+
+			if (dev->dev_lost || RTLSDR_INACTIVE == next_status) {
+				/* handle any events that still need to
+				 * be handled before exiting after we
+				 * just cancelled all transfers */
+				dev->tp->handle_events(dev->tp_priv,
+						       &zerotv, NULL);
+
+				if (dev->dev_lost && dev->auto_recover &&
+				    !_rtlsdr_recover(dev)) {
+					dev->pending_flags |= RTLSDR_BUF_GAP |
+							      RTLSDR_BUF_RECOVERED;
+					next_status = RTLSDR_INACTIVE;
+					dev->async_status = RTLSDR_RUNNING;
+					/* canceled while reopening */
+					if (dev->async_cancel)
+						dev->async_status = RTLSDR_CANCELING;
+
+					r = _rtlsdr_resubmit_async(dev);
+					continue;
+				}
+				break;
+			}
+		}
+	}
+
+	*status = next_status;
+
+	return r;
+}
+
+static int _rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb,
+			      rtlsdr_read_async_ex_cb_t ex_cb, void *ctx,
+			      uint32_t buf_num, uint32_t buf_len)
+{
+	int r = 0;
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	if (!dev)
+		return -1;
+
+	if (RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
+
+	dev->cb = cb;
+	dev->ex_cb = ex_cb;
+	dev->cb_ctx = ctx;
+
+	/* free buffers left over from rtlsdr_read_async_deferred() */
+	_rtlsdr_free_async_buffers(dev);
+
+	_rtlsdr_set_async_geometry(dev, buf_num, buf_len);
+
+	_rtlsdr_alloc_async_buffers(dev);
+
+	r = _rtlsdr_run_async(dev, &next_status);
+
+	_rtlsdr_free_async_buffers(dev);
+
+	dev->ex_cb = NULL;
+	dev->async_status = next_status;
+
+	if (dev->dev_lost)
+		return -1;
+
+	return r;
+}
+
+int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+			  uint32_t buf_num, uint32_t buf_len)
+{
+	return _rtlsdr_read_async(dev, cb, NULL, ctx, buf_num, buf_len);
+}
+
+int rtlsdr_read_async_ex(rtlsdr_dev_t *dev, rtlsdr_read_async_ex_cb_t cb,
+			 void *ctx, uint32_t buf_num, uint32_t buf_len)
+{
+	if (!cb)
+		return -1;
+
+	return _rtlsdr_read_async(dev, NULL, cb, ctx, buf_num, buf_len);
+}
+
+int rtlsdr_read_async_deferred(rtlsdr_dev_t *dev,
+			       rtlsdr_read_async_buf_cb_t cb, void *ctx,
+			       uint32_t buf_num, uint32_t buf_len,
+			       uint32_t spare_num)
+{
+	int r = 0;
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	if (!dev || !cb)
+		return -1;
+
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
+
+	_rtlsdr_free_async_buffers(dev);
+
+	_rtlsdr_set_async_geometry(dev, buf_num, buf_len);
+	dev->buf_pool_num += (spare_num > 0) ? spare_num : dev->xfer_buf_num;
+
+	if (_rtlsdr_alloc_buffer_pool(dev) < 0) {
+		_rtlsdr_free_async_buffers(dev);
+		dev->async_status = RTLSDR_INACTIVE;
+		return -ENOMEM;
+	}
+
+	dev->buf_cb = cb;
+	dev->cb_ctx = ctx;
+
+	r = _rtlsdr_run_async(dev, &next_status);
+
+	/* buffers still held by the consumer stay valid until the next
+	 * streaming call or rtlsdr_close() */
+	dev->buf_cb = NULL;
+	dev->async_status = next_status;
+
+	if (dev->dev_lost)
+		return -1;
+
+	return r;
+}
+
+int rtlsdr_buffer_release(rtlsdr_dev_t *dev, rtlsdr_buffer_t *buf)
+{
+	struct rtlsdr_block *block = (struct rtlsdr_block *)buf;
+
+	if (!dev || !buf || block->dev != dev)
+		return -1;
+
+	if (!dev->free_ring.cell)
+		return -2;
+
+	if (_rtlsdr_ring_push(&dev->free_ring, block->idx))
+		return -3;
+
+	/* wake up the event loop to resubmit a parked transfer */
+	if (rtlsdr_load32(&dev->parked_num))
+		dev->tp->interrupt(dev->tp_priv);
+
+	return 0;
+}
+
+int rtlsdr_cancel_async(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	/* if streaming, try to cancel gracefully */
+	if (RTLSDR_RUNNING == dev->async_status) {
+		dev->async_status = RTLSDR_CANCELING;
+		dev->async_cancel = 1;
+#if LIBUSB_API_VERSION >= 0x01000105
+		/* the shared event thread does not watch async_cancel */
+		if (dev->group)
+			libusb_interrupt_event_handler(dev->ctx);
+#endif
+		return 0;
+	}
+
+	/* a lost device may be waiting to be recovered */
+	if (RTLSDR_CANCELING == dev->async_status && dev->auto_recover) {
+		dev->async_cancel = 1;
+		return 0;
+	}
+
+	/* if called while in pending state, change the state forcefully */
+#if 0
+	if (RTLSDR_INACTIVE != dev->async_status) {
+		dev->async_status = RTLSDR_INACTIVE;
+		return 0;
+	}
+#endif
+	return -2;
+}
+
+static void *_rtlsdr_stream_thread(void *arg)
+{
+	rtlsdr_dev_t *dev = (rtlsdr_dev_t *)arg;
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	_rtlsdr_run_async(dev, &next_status);
+
+	/* wake up a consumer blocked on the (now final) ring contents */
+	pthread_mutex_lock(&dev->stream_lock);
+	rtlsdr_store32(&dev->stream_running, 0);
+	pthread_cond_broadcast(&dev->stream_cond);
+	pthread_mutex_unlock(&dev->stream_lock);
+
+	dev->async_status = next_status;
+
+	return NULL;
+}
+
+int rtlsdr_stream_start(rtlsdr_dev_t *dev, uint32_t buf_num, uint32_t buf_len,
+			uint32_t ring_len)
+{
+	if (!dev)
+		return -1;
+
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
+
+	_rtlsdr_free_async_buffers(dev);
+
+	_rtlsdr_set_async_geometry(dev, buf_num, buf_len);
+	dev->buf_pool_num += (ring_len > 0) ? ring_len : dev->xfer_buf_num;
+
+	if (_rtlsdr_alloc_buffer_pool(dev) < 0 ||
+	    _rtlsdr_ring_init(&dev->fill_ring, dev->buf_pool_num) < 0) {
+		_rtlsdr_free_async_buffers(dev);
+		return -ENOMEM;
+	}
+
+	dev->cb = NULL;
+	dev->cb_ctx = NULL;
+	dev->stream_overflows = 0;
+	dev->stream_waiting = 0;
+	dev->stream_running = 1;
+	dev->stream_mode = 1;
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
+
+	pthread_mutex_init(&dev->stream_lock, NULL);
+	pthread_cond_init(&dev->stream_cond, NULL);
+
+	if (pthread_create(&dev->stream_thread, NULL, _rtlsdr_stream_thread,
+			   (void *)dev)) {
+		pthread_cond_destroy(&dev->stream_cond);
+		pthread_mutex_destroy(&dev->stream_lock);
+		dev->async_status = RTLSDR_INACTIVE;
+		dev->stream_mode = 0;
+		_rtlsdr_free_async_buffers(dev);
+		return -3;
+	}
+
+	return 0;
+}
+
+static void _rtlsdr_abstime(struct timespec *ts, int timeout_ms)
+{
+#ifdef _WIN32
+	timespec_get(ts, TIME_UTC);
+#else
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	ts->tv_sec = now.tv_sec;
+	ts->tv_nsec = now.tv_usec * 1000;
+#endif
+	ts->tv_sec += timeout_ms / 1000;
+	ts->tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+int rtlsdr_stream_acquire(rtlsdr_dev_t *dev, rtlsdr_buffer_t **buf,
+			  int timeout_ms)
+{
+	struct timespec ts;
+	uint32_t running, idx;
+	int r = 0;
+
+	if (!dev || !buf)
+		return -1;
+
+	if (!dev->stream_mode)
+		return -2;
+
+	if (timeout_ms > 0)
+		_rtlsdr_abstime(&ts, timeout_ms);
+
+	for (;;) {
+		/* sample the state first, so no buffer queued right before
+		 * the event thread terminated gets lost */
+		running = rtlsdr_load32(&dev->stream_running);
+
+		if (!_rtlsdr_ring_pop(&dev->fill_ring, &idx))
+			break;
+
+		if (!running)
+			return -4;
+
+		if (!timeout_ms || r == ETIMEDOUT)
+			return -3;
+
+		pthread_mutex_lock(&dev->stream_lock);
+		rtlsdr_store32(&dev->stream_waiting, 1);
+		rtlsdr_fence();
+
+		if (_rtlsdr_ring_empty(&dev->fill_ring) &&
+		    rtlsdr_load32(&dev->stream_running)) {
+			if (timeout_ms > 0)
+				r = pthread_cond_timedwait(&dev->stream_cond,
+							   &dev->stream_lock,
+							   &ts);
+			else
+				pthread_cond_wait(&dev->stream_cond,
+						  &dev->stream_lock);
+		}
+
+		rtlsdr_store32(&dev->stream_waiting, 0);
+		pthread_mutex_unlock(&dev->stream_lock);
+	}
+
+	_rtlsdr_convert_block(dev, &dev->blocks[idx]);
+	*buf = &dev->blocks[idx].pub;
+
+	return 0;
+}
+
+int rtlsdr_stream_release(rtlsdr_dev_t *dev, rtlsdr_buffer_t *buf)
+{
+	if (!dev)
+		return -1;
+
+	if (!dev->stream_mode)
+		return -2;
+
+	return rtlsdr_buffer_release(dev, buf);
+}
+
+int rtlsdr_stream_stop(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	if (!dev->stream_mode)
+		return -2;
+
+	rtlsdr_cancel_async(dev);
+	pthread_join(dev->stream_thread, NULL);
+
+	pthread_cond_destroy(&dev->stream_cond);
+	pthread_mutex_destroy(&dev->stream_lock);
+
+	_rtlsdr_free_async_buffers(dev);
+	dev->stream_mode = 0;
+
+	return 0;
+}
+
+uint32_t rtlsdr_stream_get_overflows(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return 0;
+
+	return rtlsdr_load32(&dev->stream_overflows);
+}
+
+int rtlsdr_get_stream_stats(rtlsdr_dev_t *dev, rtlsdr_stream_stats_t *stats)
+{
+	int i;
+
+	if (!dev || !stats)
+		return -1;
+
+	stats->xfers_completed = rtlsdr_load64(&dev->stat_completed);
+	stats->xfers_errored = rtlsdr_load64(&dev->stat_errored);
+	stats->xfer_errors = dev->xfer_errors;
+	stats->in_flight = rtlsdr_load32(&dev->stat_in_flight);
+	stats->min_in_flight = rtlsdr_load32(&dev->stat_min_in_flight);
+	stats->overflows = rtlsdr_load32(&dev->stream_overflows);
+
+	for (i = 0; i < RTLSDR_STATS_HIST_BINS; i++) {
+		stats->cb_time_hist[i] = rtlsdr_load32(&dev->stat_cb_hist[i]);
+		stats->jitter_hist[i] = rtlsdr_load32(&dev->stat_jitter_hist[i]);
+	}
+
+	return 0;
+}
+
+int rtlsdr_set_lock_timeout(rtlsdr_dev_t *dev, uint32_t timeout_us,
+			    uint32_t poll_us)
+{
+	if (!dev)
+		return -1;
+
+	if (dev->tuner_type != RTLSDR_TUNER_R820T &&
+	    dev->tuner_type != RTLSDR_TUNER_R828D)
+		return -1;
 
-	free(dev);
+	dev->lock_timeout_us = timeout_us;
+	dev->lock_poll_us = poll_us;
+	dev->r82xx_p.lock_timeout_us = timeout_us;
+	dev->r82xx_p.lock_poll_us = poll_us;
 
 	return 0;
 }
 
-int rtlsdr_reset_buffer(rtlsdr_dev_t *dev)
+int rtlsdr_get_lock_stats(rtlsdr_dev_t *dev, rtlsdr_lock_stats_t *stats)
 {
-	if (!dev)
+	if (!dev || !stats)
 		return -1;
 
-	rtlsdr_write_reg(dev, USBB, USB_EPA_CTL, 0x1002, 2);
-	rtlsdr_write_reg(dev, USBB, USB_EPA_CTL, 0x0000, 2);
+	stats->tunes = dev->lock_tunes;
+	stats->failures = dev->lock_failures;
+	stats->last_lock_us = dev->lock_last_us;
+	memcpy(stats->lock_hist, dev->lock_hist, sizeof(stats->lock_hist));
 
 	return 0;
 }
 
-int rtlsdr_read_sync(rtlsdr_dev_t *dev, void *buf, int len, int *n_read)
+int rtlsdr_get_gain_step_latency(rtlsdr_dev_t *dev, rtlsdr_gain_latency_t *lat)
 {
-	if (!dev)
+	if (!dev || !lat)
 		return -1;
 
-	return libusb_bulk_transfer(dev->devh, 0x81, buf, len, n_read, BULK_TIMEOUT);
+	lat->steps = dev->gain_steps;
+	lat->fast_steps = dev->gain_fast_steps;
+	lat->last_us = dev->gain_last_us;
+	memcpy(lat->hist, dev->gain_hist, sizeof(lat->hist));
+
+	return 0;
 }
 
-static void LIBUSB_CALL _libusb_callback(struct libusb_transfer *xfer)
+/*
+ * Settling calibration. After every hop a capture is split into blocks,
+ * the second half of it serves as the reference of the settled signal.
+ * Blocks of the first half whose DC offset or power deviate from it are
+ * taken as corrupted by the retune.
+ */
+#define SETTLE_CAL_LEN		(64 * 1024) /* bytes captured per hop */
+#define SETTLE_CAL_HOPS		8
+#define SETTLE_BLOCK		128 /* samples */
+#define SETTLE_BLOCKS		(SETTLE_CAL_LEN / 2 / SETTLE_BLOCK)
+#define SETTLE_RUN		4 /* blocks */
+#define DEFAULT_SETTLE_NS	1000000 /* until calibrated */
+
+/* number of samples at the start of buf that are not settled yet */
+static uint32_t _rtlsdr_unsettled_len(const uint8_t *buf, int len)
 {
-	rtlsdr_dev_t *dev = (rtlsdr_dev_t *)xfer->user_data;
+	double feat[SETTLE_BLOCKS][3];
+	double ref[3] = { 0, 0, 0 }, var[3] = { 0, 0, 0 }, lim[3], d;
+	int nblk = len / 2 / SETTLE_BLOCK, half = nblk / 2;
+	int b, i, k, run;
 
-	if (LIBUSB_TRANSFER_COMPLETED == xfer->status) {
-		if (dev->cb)
-			dev->cb(xfer->buffer, xfer->actual_length, dev->cb_ctx);
+	if (nblk > SETTLE_BLOCKS)
+		nblk = SETTLE_BLOCKS;
 
-		libusb_submit_transfer(xfer); /* resubmit transfer */
-		dev->xfer_errors = 0;
-	} else if (LIBUSB_TRANSFER_CANCELLED != xfer->status) {
-#ifndef _WIN32
-		if (LIBUSB_TRANSFER_ERROR == xfer->status)
-			dev->xfer_errors++;
+	if (half < 1)
+		return 0;
 
-		if (dev->xfer_errors >= dev->xfer_buf_num ||
-		    LIBUSB_TRANSFER_NO_DEVICE == xfer->status) {
-#endif
-			dev->dev_lost = 1;
-			fprintf(stderr, "cb transfer status: %d, "
-				"canceling...\n", xfer->status);
-#ifndef _WIN32
+	/* DC offset of I and Q, power */
+	for (b = 0; b < nblk; b++) {
+		const uint8_t *p = buf + b * SETTLE_BLOCK * 2;
+
+		feat[b][0] = feat[b][1] = feat[b][2] = 0;
+		for (i = 0; i < SETTLE_BLOCK; i++) {
+			double re = p[2 * i] - 127.5, im = p[2 * i + 1] - 127.5;
+
+			feat[b][0] += re;
+			feat[b][1] += im;
+			feat[b][2] += re * re + im * im;
 		}
-#endif
+		for (k = 0; k < 3; k++)
+			feat[b][k] /= SETTLE_BLOCK;
 	}
-}
 
-int rtlsdr_wait_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx)
-{
-	return rtlsdr_read_async(dev, cb, ctx, 0, 0);
+	for (b = half; b < nblk; b++)
+		for (k = 0; k < 3; k++)
+			ref[k] += feat[b][k] / (nblk - half);
+
+	for (b = half; b < nblk; b++)
+		for (k = 0; k < 3; k++) {
+			d = feat[b][k] - ref[k];
+			var[k] += d * d / (nblk - half);
+		}
+
+	/* squared limits: five standard deviations, plus a floor for very
+	 * clean signals */
+	lim[0] = 25 * var[0] + 0.25;
+	lim[1] = 25 * var[1] + 0.25;
+	lim[2] = 25 * var[2] + 0.0025 * ref[2] * ref[2];
+
+	/* settled where a run of blocks within the limits starts, so that a
+	 * stray outlier in the settled signal does not count */
+	for (b = 0, run = 0; b < half; b++) {
+		for (k = 0; k < 3; k++) {
+			d = feat[b][k] - ref[k];
+			if (d * d > lim[k])
+				break;
+		}
+
+		run = (k == 3) ? run + 1 : 0;
+		if (run == SETTLE_RUN)
+			return (b + 1 - SETTLE_RUN) * SETTLE_BLOCK;
+	}
+
+	return half * SETTLE_BLOCK;
 }
 
-static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
+int rtlsdr_calibrate_settling(rtlsdr_dev_t *dev, uint32_t freq,
+			      const uint32_t *steps, uint32_t num)
 {
-	unsigned int i;
-
-	if (!dev)
+	struct rtlsdr_settle settle[SETTLE_STEPS_MAX];
+	struct rtlsdr_settle e;
+	uint32_t orig_freq, worst, n, i, j;
+	uint32_t settle_num = 0;
+	uint8_t *buf = NULL;
+	int r = 0, n_read;
+
+	if (!dev || !dev->rate || !steps || !num || num > SETTLE_STEPS_MAX)
 		return -1;
 
-	if (!dev->xfer) {
-		dev->xfer = malloc(dev->xfer_buf_num *
-				   sizeof(struct libusb_transfer *));
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status)
+		return -2;
 
-		for(i = 0; i < dev->xfer_buf_num; ++i)
-			dev->xfer[i] = libusb_alloc_transfer(0);
+	/* nothing settles on a simulated device, and a replayed capture
+	 * must not be consumed by measuring */
+	if (dev->devh) {
+		buf = malloc(SETTLE_CAL_LEN);
+		if (!buf)
+			return -ENOMEM;
 	}
 
-	if (dev->xfer_buf)
-		return -2;
+	orig_freq = dev->freq;
+
+	for (i = 0; i < num; i++) {
+		worst = 0;
+
+		/* alternate between freq and freq + step, the first tune
+		 * only gets there */
+		for (j = 0; buf && j <= SETTLE_CAL_HOPS; j++) {
+			r = rtlsdr_set_center_freq(dev, (j & 1) ? freq + steps[i] : freq);
+			if (!r)
+				r = rtlsdr_reset_buffer(dev);
+			if (!r)
+				r = rtlsdr_read_sync(dev, buf, SETTLE_CAL_LEN, &n_read);
+			if (r < 0)
+				goto out;
+
+			n = _rtlsdr_unsettled_len(buf, n_read);
+			if (j && n > worst)
+				worst = n;
+		}
 
-	dev->xfer_buf = malloc(dev->xfer_buf_num * sizeof(unsigned char *));
-	memset(dev->xfer_buf, 0, dev->xfer_buf_num * sizeof(unsigned char *));
+		/* one block of margin */
+		e.step = steps[i];
+		e.ns = buf ? (uint64_t)(worst + SETTLE_BLOCK) * 1000000000ULL / dev->rate : 0;
 
-#if defined(ENABLE_ZEROCOPY) && defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
-	fprintf(stderr, "Allocating %d zero-copy buffers\n", dev->xfer_buf_num);
+		/* keep the table sorted by step */
+		for (j = settle_num; j > 0 && settle[j - 1].step > e.step; j--)
+			settle[j] = settle[j - 1];
+		settle[j] = e;
+		settle_num++;
+	}
 
-	dev->use_zerocopy = 1;
-	for (i = 0; i < dev->xfer_buf_num; ++i) {
-		dev->xfer_buf[i] = libusb_dev_mem_alloc(dev->devh, dev->xfer_buf_len);
+	/* a failed calibration keeps the previous table */
+	memcpy(dev->settle, settle, settle_num * sizeof(settle[0]));
+	dev->settle_num = settle_num;
 
-		if (dev->xfer_buf[i]) {
-			/* Check if Kernel usbfs mmap() bug is present: if the
-			 * mapping is correct, the buffers point to memory that
-			 * was memset to 0 by the Kernel, otherwise, they point
-			 * to random memory. We check if the buffers are zeroed
-			 * and otherwise fall back to buffers in userspace.
-			 */
-			if (dev->xfer_buf[i][0] || memcmp(dev->xfer_buf[i],
-							  dev->xfer_buf[i] + 1,
-							  dev->xfer_buf_len - 1)) {
-				fprintf(stderr, "Detected Kernel usbfs mmap() "
-						"bug, falling back to buffers "
-						"in userspace\n");
-				dev->use_zerocopy = 0;
-				break;
-			}
-		} else {
-			fprintf(stderr, "Failed to allocate zero-copy "
-					"buffer for transfer %d\nFalling "
-					"back to buffers in userspace\n", i);
-			dev->use_zerocopy = 0;
-			break;
-		}
+out:
+	if (buf) {
+		free(buf);
+		if (orig_freq)
+			rtlsdr_set_center_freq(dev, orig_freq);
 	}
 
-	/* zero-copy buffer allocation failed (partially or completely)
-	 * we need to free the buffers again if already allocated */
-	if (!dev->use_zerocopy) {
-		for (i = 0; i < dev->xfer_buf_num; ++i) {
-			if (dev->xfer_buf[i])
-				libusb_dev_mem_free(dev->devh,
-						    dev->xfer_buf[i],
-						    dev->xfer_buf_len);
+	return r;
+}
+
+uint32_t rtlsdr_get_settling_samples(rtlsdr_dev_t *dev, uint32_t step)
+{
+	uint64_t ns = DEFAULT_SETTLE_NS;
+	uint32_t i;
+
+	if (!dev)
+		return 0;
+
+	/* the smallest calibrated step covering this one, or the largest */
+	if (dev->settle_num) {
+		ns = dev->settle[dev->settle_num - 1].ns;
+		for (i = 0; i < dev->settle_num; i++) {
+			if (dev->settle[i].step >= step) {
+				ns = dev->settle[i].ns;
+				break;
+			}
 		}
 	}
-#endif
 
-	/* no zero-copy available, allocate buffers in userspace */
-	if (!dev->use_zerocopy) {
-		for (i = 0; i < dev->xfer_buf_num; ++i) {
-			dev->xfer_buf[i] = malloc(dev->xfer_buf_len);
+	return (uint32_t)((ns * dev->rate + 999999999ULL) / 1000000000ULL);
+}
 
-			if (!dev->xfer_buf[i])
-				return -ENOMEM;
+static void *_rtlsdr_ctx_thread(void *arg)
+{
+	rtlsdr_ctx_t *ctx = (rtlsdr_ctx_t *)arg;
+	rtlsdr_dev_t *dev;
+	struct timeval tv = { 1, 0 };
+	struct timeval shorttv = { 0, 1000 };
+	int busy = 0;
+
+	while (rtlsdr_load32(&ctx->running)) {
+		/* poll while any device is canceling or has parked
+		 * transfers, otherwise sleep until something completes */
+		libusb_handle_events_timeout_completed(ctx->usb,
+						       busy ? &shorttv : &tv,
+						       NULL);
+		busy = 0;
+
+		pthread_mutex_lock(&ctx->lock);
+		for (dev = ctx->devs; dev; dev = dev->group_next) {
+			if (RTLSDR_RUNNING == dev->async_status)
+				_rtlsdr_submit_parked(dev);
+
+			if (dev->dev_lost &&
+			    RTLSDR_RUNNING == dev->async_status)
+				dev->async_status = RTLSDR_CANCELING;
+
+			if (RTLSDR_CANCELING == dev->async_status)
+				dev->async_status = _rtlsdr_cancel_xfers(dev);
+
+			if (RTLSDR_CANCELING == dev->async_status ||
+			    dev->parked_num)
+				busy = 1;
 		}
+		pthread_mutex_unlock(&ctx->lock);
 	}
 
-	return 0;
+	return NULL;
 }
 
-static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev)
+int rtlsdr_ctx_create(rtlsdr_ctx_t **out_ctx)
 {
-	unsigned int i;
+	rtlsdr_ctx_t *ctx;
 
-	if (!dev)
+	if (!out_ctx)
 		return -1;
 
-	if (dev->xfer) {
-		for(i = 0; i < dev->xfer_buf_num; ++i) {
-			if (dev->xfer[i]) {
-				libusb_free_transfer(dev->xfer[i]);
-			}
-		}
+	ctx = malloc(sizeof(rtlsdr_ctx_t));
+	if (NULL == ctx)
+		return -ENOMEM;
 
-		free(dev->xfer);
-		dev->xfer = NULL;
+	memset(ctx, 0, sizeof(rtlsdr_ctx_t));
+
+	if (libusb_init(&ctx->usb) < 0) {
+		free(ctx);
+		return -1;
 	}
 
-	if (dev->xfer_buf) {
-		for (i = 0; i < dev->xfer_buf_num; ++i) {
-			if (dev->xfer_buf[i]) {
-				if (dev->use_zerocopy) {
-#if defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
-					libusb_dev_mem_free(dev->devh,
-							    dev->xfer_buf[i],
-							    dev->xfer_buf_len);
-#endif
-				} else {
-					free(dev->xfer_buf[i]);
-				}
-			}
-		}
+	pthread_mutex_init(&ctx->lock, NULL);
+	ctx->running = 1;
 
-		free(dev->xfer_buf);
-		dev->xfer_buf = NULL;
+	if (pthread_create(&ctx->thread, NULL, _rtlsdr_ctx_thread,
+			   (void *)ctx)) {
+		pthread_mutex_destroy(&ctx->lock);
+		libusb_exit(ctx->usb);
+		free(ctx);
+		return -3;
 	}
 
+	*out_ctx = ctx;
+
 	return 0;
 }
 
-int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
-			  uint32_t buf_num, uint32_t buf_len)
+int rtlsdr_ctx_destroy(rtlsdr_ctx_t *ctx)
 {
-	unsigned int i;
-	int r = 0;
-	struct timeval tv = { 1, 0 };
-	struct timeval zerotv = { 0, 0 };
-	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
-
-	if (!dev)
+	if (!ctx)
 		return -1;
 
-	if (RTLSDR_INACTIVE != dev->async_status)
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->devs) {
+		pthread_mutex_unlock(&ctx->lock);
 		return -2;
+	}
+	pthread_mutex_unlock(&ctx->lock);
 
-	dev->async_status = RTLSDR_RUNNING;
-	dev->async_cancel = 0;
+	rtlsdr_store32(&ctx->running, 0);
+#if LIBUSB_API_VERSION >= 0x01000105
+	libusb_interrupt_event_handler(ctx->usb);
+#endif
+	pthread_join(ctx->thread, NULL);
 
-	dev->cb = cb;
-	dev->cb_ctx = ctx;
+	pthread_mutex_destroy(&ctx->lock);
+	libusb_exit(ctx->usb);
+	free(ctx);
 
-	if (buf_num > 0)
-		dev->xfer_buf_num = buf_num;
-	else
-		dev->xfer_buf_num = DEFAULT_BUF_NUMBER;
+	return 0;
+}
 
-	if (buf_len > 0 && buf_len % 512 == 0) /* len must be multiple of 512 */
-		dev->xfer_buf_len = buf_len;
-	else
-		dev->xfer_buf_len = DEFAULT_BUF_LENGTH;
+int rtlsdr_ctx_open(rtlsdr_ctx_t *ctx, rtlsdr_dev_t **out_dev, uint32_t index)
+{
+	struct rtlsdr_usb_match m;
 
-	_rtlsdr_alloc_async_buffers(dev);
+	if (!ctx)
+		return -1;
 
-	for(i = 0; i < dev->xfer_buf_num; ++i) {
-		libusb_fill_bulk_transfer(dev->xfer[i],
-					  dev->devh,
-					  0x81,
-					  dev->xfer_buf[i],
-					  dev->xfer_buf_len,
-					  _libusb_callback,
-					  (void *)dev,
-					  BULK_TIMEOUT);
+	memset(&m, 0, sizeof(m));
+	m.index = index;
 
-		r = libusb_submit_transfer(dev->xfer[i]);
-		if (r < 0) {
-			fprintf(stderr, "Failed to submit transfer %i\n"
-					"Please increase your allowed " 
-					"usbfs buffer size with the "
-					"following command:\n"
-					"echo 0 > /sys/module/usbcore"
-					"/parameters/usbfs_memory_mb\n", i);
-			dev->async_status = RTLSDR_CANCELING;
-			break;
-		}
-	}
+	return _rtlsdr_open(out_dev, &m, ctx);
+}
 
-	while (RTLSDR_INACTIVE != dev->async_status) {
-		r = libusb_handle_events_timeout_completed(dev->ctx, &tv,
-							   &dev->async_cancel);
-		if (r < 0) {
-			/*fprintf(stderr, "handle_events returned: %d\n", r);*/
-			if (r == LIBUSB_ERROR_INTERRUPTED) /* stray signal */
-				continue;
-			break;
-		}
+static void _rtlsdr_ctx_unlink(rtlsdr_ctx_t *ctx, rtlsdr_dev_t *dev)
+{
+	rtlsdr_dev_t **p;
 
-		/* Check if device was lost due to transfer errors */
-		if (dev->dev_lost && RTLSDR_RUNNING == dev->async_status) {
-			dev->async_status = RTLSDR_CANCELING;
+	pthread_mutex_lock(&ctx->lock);
+	for (p = &ctx->devs; *p; p = &(*p)->group_next) {
+		if (*p == dev) {
+			*p = dev->group_next;
+			break;
 		}
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
 
-		if (RTLSDR_CANCELING == dev->async_status) {
-			next_status = RTLSDR_INACTIVE;
-
-			if (!dev->xfer)
-				break;
-
-			for(i = 0; i < dev->xfer_buf_num; ++i) {
-				if (!dev->xfer[i])
-					continue;
+int rtlsdr_ctx_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_ex_cb_t cb,
+			  void *ctx, uint32_t buf_num, uint32_t buf_len)
+{
+	int r;
 
-				if (LIBUSB_TRANSFER_CANCELLED !=
-						dev->xfer[i]->status) {
-					r = libusb_cancel_transfer(dev->xfer[i]);
-					/* handle events after canceling
-					 * to allow transfer status to
-					 * propagate */
-#ifdef _WIN32
-					Sleep(1);
-#endif
-					libusb_handle_events_timeout_completed(dev->ctx,
-									       &zerotv, NULL);
-					if (r < 0)
-						continue;
+	if (!dev || !cb || !dev->group)
+		return -1;
 
-					next_status = RTLSDR_CANCELING;
-				}
-			}
+	pthread_mutex_lock(&dev->group->lock);
 
-			if (dev->dev_lost || RTLSDR_INACTIVE == next_status) {
-				/* handle any events that still need to
-				 * be handled before exiting after we
-				 * just cancelled all transfers */
-				libusb_handle_events_timeout_completed(dev->ctx,
-								       &zerotv, NULL);
-				break;
-			}
-		}
+	if (dev->stream_mode || RTLSDR_INACTIVE != dev->async_status) {
+		pthread_mutex_unlock(&dev->group->lock);
+		return -2;
 	}
 
 	_rtlsdr_free_async_buffers(dev);
 
-	dev->async_status = next_status;
+	_rtlsdr_set_async_geometry(dev, buf_num, buf_len);
 
-	if (dev->dev_lost)
-		return -1;
+	if (_rtlsdr_alloc_async_buffers(dev) < 0) {
+		pthread_mutex_unlock(&dev->group->lock);
+		return -ENOMEM;
+	}
 
-	return r;
-}
+	dev->cb = NULL;
+	dev->ex_cb = cb;
+	dev->cb_ctx = ctx;
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
 
-int rtlsdr_cancel_async(rtlsdr_dev_t *dev)
-{
-	if (!dev)
-		return -1;
+	/* on failure the event thread cancels what has been submitted */
+	r = _rtlsdr_submit_async(dev);
 
-	/* if streaming, try to cancel gracefully */
-	if (RTLSDR_RUNNING == dev->async_status) {
-		dev->async_status = RTLSDR_CANCELING;
-		dev->async_cancel = 1;
-		return 0;
-	}
+	pthread_mutex_unlock(&dev->group->lock);
 
-	/* if called while in pending state, change the state forcefully */
-#if 0
-	if (RTLSDR_INACTIVE != dev->async_status) {
-		dev->async_status = RTLSDR_INACTIVE;
-		return 0;
-	}
-#endif
-	return -2;
+	return r;
 }
 
 uint32_t rtlsdr_get_tuner_clock(void *dev)
@@ -2019,6 +5021,20 @@ uint32_t rtlsdr_get_tuner_clock(void *dev)
 	return tuner_freq;
 }
 
+uint64_t rtlsdr_get_time_ns(void)
+{
+	return _rtlsdr_monotonic_ns();
+}
+
+void rtlsdr_sleep_us(unsigned int us)
+{
+#ifdef _WIN32
+	Sleep((us + 999) / 1000);
+#else
+	usleep(us);
+#endif
+}
+
 int rtlsdr_i2c_write_fn(void *dev, uint8_t addr, uint8_t *buf, int len)
 {
 	if (dev)
@@ -2043,6 +5059,11 @@ int rtlsdr_set_bias_tee_gpio(rtlsdr_dev_t *dev, int gpio, int on)
 	rtlsdr_set_gpio_output(dev, gpio);
 	rtlsdr_set_gpio_bit(dev, gpio, on);
 
+	if (on)
+		dev->bias_tee |= 1 << gpio;
+	else
+		dev->bias_tee &= ~(1 << gpio);
+
 	return 0;
 }
 
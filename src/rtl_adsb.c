@@ -53,6 +53,7 @@
 #define ADSB_RATE			2000000
 #define ADSB_FREQ			1090000000
 #define DEFAULT_ASYNC_BUF_NUMBER	12
+#define DEFAULT_SPARE_BUF_NUMBER	4
 #define DEFAULT_BUF_LENGTH		(16 * 16384)
 #define AUTO_GAIN			-100
 
@@ -69,7 +70,7 @@ static rtlsdr_dev_t *dev = NULL;
 uint16_t squares[256];
 
 /* todo, bundle these up in a struct */
-uint8_t *buffer;  /* also abused for uint16_t */
+rtlsdr_buffer_t *pending = NULL;  /* latest samples, guarded by ready_m */
 int verbose_output = 0;
 int short_output = 0;
 int quality = 10;
@@ -89,7 +90,8 @@ void usage(void)
 	fprintf(stderr,
 		"rtl_adsb, a simple ADS-B decoder\n\n"
 		"Use:\trtl_adsb [-R] [-g gain] [-p ppm] [output file]\n"
-		"\t[-d device_index or serial (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
+		"\t    file:<capture> replays a recording, fastfile:<capture> unpaced\n"
 		"\t[-V verbove output (default: off)]\n"
 		"\t[-S show short frames (default: off)]\n"
 		"\t[-Q quality (0: no sanity checks, 0.5: half bit, 1: one bit (default), 2: two bits)]\n"
@@ -341,22 +343,40 @@ void messages(uint16_t *buf, int len)
 	}
 }
 
-static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
+static void rtlsdr_callback(rtlsdr_buffer_t *buf, void *ctx)
 {
+	rtlsdr_buffer_t *stale;
 	if (do_exit) {
+		rtlsdr_buffer_release(dev, buf);
 		return;}
-	memcpy(buffer, buf, len);
-	safe_cond_signal(&ready, &ready_m);
+	pthread_mutex_lock(&ready_m);
+	stale = pending;
+	pending = buf;
+	pthread_cond_signal(&ready);
+	pthread_mutex_unlock(&ready_m);
+	/* the demod thread fell behind, drop the older samples */
+	if (stale) {
+		rtlsdr_buffer_release(dev, stale);}
 }
 
 static void *demod_thread_fn(void *arg)
 {
 	int len;
+	rtlsdr_buffer_t *buf;
 	while (!do_exit) {
-		safe_cond_wait(&ready, &ready_m);
-		len = magnitute(buffer, DEFAULT_BUF_LENGTH);
-		manchester((uint16_t*)buffer, len);
-		messages((uint16_t*)buffer, len);
+		pthread_mutex_lock(&ready_m);
+		if (!pending) {
+			pthread_cond_wait(&ready, &ready_m);}
+		buf = pending;
+		pending = NULL;
+		pthread_mutex_unlock(&ready_m);
+		if (!buf) {
+			continue;}
+		/* the samples are processed in place, no copy needed */
+		len = magnitute(buf->buf, buf->len);
+		manchester((uint16_t*)buf->buf, len);
+		messages((uint16_t*)buf->buf, len);
+		rtlsdr_buffer_release(dev, buf);
 	}
 	rtlsdr_cancel_async(dev);
 	return 0;
@@ -370,8 +390,7 @@ int main(int argc, char **argv)
 	char *filename = NULL;
 	int r, opt;
 	int gain = AUTO_GAIN; /* tenths of a dB */
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	int ppm_error = 0;
 	int enable_biastee = 0;
 	pthread_cond_init(&ready, NULL);
@@ -382,8 +401,7 @@ int main(int argc, char **argv)
 	{
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'g':
 			gain = (int)(atof(optarg) * 10);
@@ -418,19 +436,8 @@ int main(int argc, char **argv)
 		filename = argv[optind];
 	}
 
-	buffer = malloc(DEFAULT_BUF_LENGTH * sizeof(uint8_t));
-
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
-		exit(1);
-	}
-
-	r = rtlsdr_open(&dev, (uint32_t)dev_index);
+	r = verbose_device_open(&dev, dev_str);
 	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
 		exit(1);
 	}
 #ifndef _WIN32
@@ -484,9 +491,10 @@ int main(int argc, char **argv)
 	verbose_reset_buffer(dev);
 
 	pthread_create(&demod_thread, NULL, demod_thread_fn, (void *)(NULL));
-	rtlsdr_read_async(dev, rtlsdr_callback, (void *)(NULL),
-			      DEFAULT_ASYNC_BUF_NUMBER,
-			      DEFAULT_BUF_LENGTH);
+	rtlsdr_read_async_deferred(dev, rtlsdr_callback, (void *)(NULL),
+				   DEFAULT_ASYNC_BUF_NUMBER,
+				   DEFAULT_BUF_LENGTH,
+				   DEFAULT_SPARE_BUF_NUMBER);
 
 	if (do_exit) {
 		fprintf(stderr, "\nUser cancel, exiting...\n");}
@@ -502,7 +510,6 @@ int main(int argc, char **argv)
 		fclose(file);}
 
 	rtlsdr_close(dev);
-	free(buffer);
 	return r >= 0 ? r : -r;
 }
 
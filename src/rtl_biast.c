@@ -41,7 +41,7 @@ void usage(void)
 		"bias tee: rtl_biast -d 0 -b 1\n"
 		"Any GPIO: rtl_biast -d 0 -g 1 -b 1\n\n"
 		"Usage:\n"
-		"\t[-d device_index (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
 		"\t[-b bias_on (default: 0)]\n"
 		"\t[-g GPIO select (default: 0)]\n");
 	exit(1);
@@ -50,8 +50,7 @@ void usage(void)
 int main(int argc, char **argv)
 {
 	int i, r, opt;
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	uint32_t bias_on = 0;
 	uint32_t gpio_pin = 0;
 	int device_count;
@@ -59,8 +58,7 @@ int main(int argc, char **argv)
 	while ((opt = getopt(argc, argv, "d:b:g:h?")) != -1) {
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'b':
 			bias_on = atoi(optarg);
@@ -74,15 +72,10 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
+	r = verbose_device_open(&dev, dev_str);
+	if (r < 0) {
 		exit(1);
 	}
-
-	r = rtlsdr_open(&dev, dev_index);
 	rtlsdr_set_bias_tee_gpio(dev, gpio_pin, bias_on);
 
 exit:
@@ -80,10 +80,17 @@
 #define MAXIMUM_OVERSAMPLE		16
 #define MAXIMUM_BUF_LENGTH		(MAXIMUM_OVERSAMPLE * DEFAULT_BUF_LENGTH)
 #define AUTO_GAIN			-100
-#define BUFFER_DUMP			4096
 
 #define FREQUENCIES_LIMIT		1000
 
+#define BANK_RATE			2400000
+#define BANK_WORKERS_DEFAULT		4
+#define BANK_WORKERS_MAX		64
+/* the most rtlsdr_pfb_create() takes */
+#define BANK_CHANNELS_MAX		4096
+/* float channel samples to 16 bit, leaving room for I/Q of full scale */
+#define BANK_SCALE			23170.0f
+
 static volatile int do_exit = 0;
 static int lcm_post[17] = {1,1,1,3,1,5,3,7,1,9,5,11,3,13,7,15,1};
 static int ACTUAL_BUF_LENGTH;
@@ -97,16 +104,14 @@ struct dongle_state
 	int      exit_flag;
 	pthread_t thread;
 	rtlsdr_dev_t *dev;
-	int      dev_index;
 	uint32_t freq;
 	uint32_t rate;
 	int      gain;
-	uint16_t buf16[MAXIMUM_BUF_LENGTH];
 	uint32_t buf_len;
 	int      ppm_error;
 	int      offset_tuning;
 	int      direct_sampling;
-	int      mute;
+	uint32_t settle;  /* samples muted after a hop */
 	struct demod_state *demod_target;
 };
 
@@ -135,7 +140,7 @@ struct demod_state
 	int      downsample_passes;
 	int      comp_fir_size;
 	int      custom_atan;
-	int      deemph, deemph_a;
+	int      deemph, deemph_a, deemph_avg;
 	int      now_lpr;
 	int      prev_lpr_index;
 	int      dc_block, dc_avg;
@@ -173,11 +178,52 @@ struct controller_state
 	pthread_mutex_t hop_m;
 };
 
+struct bank_channel
+{
+	uint32_t freq;
+	int32_t  index;  /* channel of the filter bank */
+	float    *weights;  /* picking it out of the branches */
+	FILE     *file;
+	struct demod_state *demod;
+};
+
+struct bank_worker
+{
+	int      id;
+	pthread_t thread;
+	float    *samples;
+	uint32_t samples_len;
+};
+
+struct bank_state
+{
+	uint32_t spacing;  /* 0 when not channelizing */
+	uint32_t center;
+	int      channels;
+	rtlsdr_pfb_t *pfb;
+	float    *samples;
+	uint32_t samples_len;
+	/* double buffered, workers demodulate one while the other fills */
+	float    *branches[2];
+	uint32_t branches_len[2];
+	uint32_t blocks[2];
+	int      gen;
+	int      done;
+	struct bank_channel chans[FREQUENCIES_LIMIT];
+	int      chan_len;
+	struct bank_worker workers[BANK_WORKERS_MAX];
+	int      worker_len;
+	pthread_mutex_t m;
+	pthread_cond_t ready;
+	pthread_cond_t finished;
+};
+
 // multiple of these, eventually
 struct dongle_state dongle;
 struct demod_state demod;
 struct output_state output;
 struct controller_state controller;
+struct bank_state bank;
 
 void usage(void)
 {
@@ -187,12 +233,18 @@ void usage(void)
 		"\t-f frequency_to_tune_to [Hz]\n"
 		"\t    use multiple -f for scanning (requires squelch)\n"
 		"\t    ranges supported, -f 118M:137M:25k\n"
+		"\t[-c channel_spacing (default: off)]\n"
+		"\t    demodulates all frequencies at once, each to its own\n"
+		"\t    file, they must be multiples of the spacing apart\n"
+		"\t    and within 2.4 MHz, filename needs a %%u for the frequency\n"
+		"\t[-j worker_threads for -c (default: 4)]\n"
 		"\t[-M modulation (default: fm)]\n"
 		"\t    fm, wbfm, raw, am, usb, lsb\n"
 		"\t    wbfm == -M fm -s 170k -o 4 -A fast -r 32k -l 0 -E deemp\n"
 		"\t    raw mode outputs 2x16 bit IQ pairs\n"
 		"\t[-s sample_rate (default: 24k)]\n"
-		"\t[-d device_index or serial (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
+		"\t    file:<capture> replays a recording, fastfile:<capture> unpaced\n"
 		"\t[-T enable bias-T on GPIO PIN 0 (works for rtl-sdr.com v3 dongles)]\n"
 		"\t[-g tuner_gain (default: automatic)]\n"
 		"\t[-l squelch_level (default: 0/off)]\n"
@@ -598,8 +650,8 @@ void raw_demod(struct demod_state *fm)
 
 void deemph_filter(struct demod_state *fm)
 {
-	static int avg;  // cheating...
 	int i, d;
+	int avg = fm->deemph_avg;
 	// de-emph IIR
 	// avg = avg * (1 - alpha) + sample * alpha;
 	for (i = 0; i < fm->result_len; i++) {
@@ -611,6 +663,7 @@ void deemph_filter(struct demod_state *fm)
 		}
 		fm->result[i] = (int16_t)avg;
 	}
+	fm->deemph_avg = avg;
 }
 
 void dc_block_filter(struct demod_state *fm)
@@ -780,9 +833,106 @@ void full_demod(struct demod_state *d)
 	}
 }
 
-static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
+static int bank_grow(float **buf, uint32_t *buf_len, uint32_t len)
+{
+	float *p;
+	if (len <= *buf_len) {
+		return 0;}
+	p = realloc(*buf, len * sizeof(float));
+	if (!p) {
+		fprintf(stderr, "Out of memory for the filter bank.\n");
+		do_exit = 1;
+		return -1;
+	}
+	*buf = p;
+	*buf_len = len;
+	return 0;
+}
+
+static void bank_callback(unsigned char *buf, uint32_t len)
+{
+	uint32_t blocks;
+	int next = bank.gen + 1;
+	int b = next & 1;
+	if (bank_grow(&bank.samples, &bank.samples_len, len) ||
+	    bank_grow(&bank.branches[b], &bank.branches_len[b],
+		      2 * bank.channels * (len / 2 / bank.channels + 1))) {
+		return;}
+	rtlsdr_convert_f32(buf, bank.samples, len);
+	blocks = rtlsdr_pfb_process(bank.pfb, bank.samples, len, bank.branches[b]);
+	/* the buffer just filled was the one of the generation before last,
+	 * hand it over once the workers are through with the last one */
+	pthread_mutex_lock(&bank.m);
+	while (bank.done < bank.worker_len && !do_exit) {
+		pthread_cond_wait(&bank.finished, &bank.m);}
+	bank.blocks[b] = blocks;
+	bank.done = 0;
+	bank.gen = next;
+	pthread_cond_broadcast(&bank.ready);
+	pthread_mutex_unlock(&bank.m);
+}
+
+static void bank_demod(struct bank_worker *w, struct bank_channel *ch,
+		       const float *branches, uint32_t blocks)
+{
+	uint32_t i;
+	float v;
+	struct demod_state *d = ch->demod;
+	rtlsdr_pfb_extract_weights(bank.pfb, branches, blocks, ch->weights,
+				   w->samples);
+	for (i = 0; i < 2 * blocks; i++) {
+		v = w->samples[i] * BANK_SCALE;
+		if (v > 32767.0f) {
+			v = 32767.0f;}
+		if (v < -32767.0f) {
+			v = -32767.0f;}
+		d->lowpassed[i] = (int16_t)lrintf(v);
+	}
+	d->lp_len = (int)(2 * blocks);
+	full_demod(d);
+	/* squelched channels are skipped, like hopping past them */
+	if (d->squelch_level && d->squelch_hits > d->conseq_squelch) {
+		d->squelch_hits = d->conseq_squelch + 1;
+		return;
+	}
+	fwrite(d->result, 2, d->result_len, ch->file);
+}
+
+static void *bank_worker_fn(void *arg)
+{
+	struct bank_worker *w = arg;
+	float *branches;
+	uint32_t blocks;
+	int i, gen = 0;
+	while (!do_exit) {
+		pthread_mutex_lock(&bank.m);
+		while (bank.gen == gen && !do_exit) {
+			pthread_cond_wait(&bank.ready, &bank.m);}
+		gen = bank.gen;
+		branches = bank.branches[gen & 1];
+		blocks = bank.blocks[gen & 1];
+		pthread_mutex_unlock(&bank.m);
+		if (do_exit) {
+			break;}
+		if (bank_grow(&w->samples, &w->samples_len, 2 * blocks)) {
+			break;}
+		/* channels are dealt out round robin */
+		for (i = w->id; i < bank.chan_len; i += bank.worker_len) {
+			bank_demod(w, &bank.chans[i], branches, blocks);}
+		pthread_mutex_lock(&bank.m);
+		bank.done++;
+		if (bank.done == bank.worker_len) {
+			pthread_cond_signal(&bank.finished);}
+		pthread_mutex_unlock(&bank.m);
+	}
+	return 0;
+}
+
+static void rtlsdr_callback(unsigned char *buf, uint32_t len,
+			    const rtlsdr_buffer_info_t *info, void *ctx)
 {
 	int i;
+	uint64_t stale, settled;
 	struct dongle_state *s = ctx;
 	struct demod_state *d = s->demod_target;
 
@@ -790,17 +940,26 @@ static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 		return;}
 	if (!ctx) {
 		return;}
-	if (s->mute) {
-		for (i=0; i<s->mute; i++) {
+	if (bank.spacing) {
+		bank_callback(buf, len);
+		return;}
+	/* mute the samples taken before the last hop took effect,
+	 * and those of the tuner settling */
+	settled = info->retune_index;
+	if (settled) {
+		settled += s->settle;}
+	if (settled > info->sample_index) {
+		stale = 2 * (settled - info->sample_index);
+		if (stale > len) {
+			stale = len;}
+		for (i=0; i<(int)stale; i++) {
 			buf[i] = 127;}
-		s->mute = 0;
 	}
 	if (!s->offset_tuning) {
 		rotate_90(buf, len);}
-	for (i=0; i<(int)len; i++) {
-		s->buf16[i] = (int16_t)buf[i] - 127;}
+	/* convert straight into the demod buffer, no intermediate copy */
 	pthread_rwlock_wrlock(&d->rw);
-	memcpy(d->lowpassed, s->buf16, 2*len);
+	rtlsdr_convert_s16(buf, d->lowpassed, len);
 	d->lp_len = len;
 	pthread_rwlock_unlock(&d->rw);
 	safe_cond_signal(&d->ready, &d->ready_m);
@@ -809,7 +968,7 @@ static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 static void *dongle_thread_fn(void *arg)
 {
 	struct dongle_state *s = arg;
-	int r = rtlsdr_read_async(s->dev, rtlsdr_callback, s, 0, s->buf_len);
+	int r = rtlsdr_read_async_ex(s->dev, rtlsdr_callback, s, 0, s->buf_len);
 	if (r != 0 && !do_exit) {
 		fprintf(stderr, "\nDevice error detected, async read returned: %d\n", r);
 		do_exit = 1;
@@ -888,6 +1047,7 @@ static void *controller_thread_fn(void *arg)
 	// thoughts for multiple dongles
 	// might be no good using a controller thread if retune/rate blocks
 	int i;
+	uint32_t lo, hi;
 	struct controller_state *s = arg;
 
 	if (s->wb_mode) {
@@ -913,6 +1073,18 @@ static void *controller_thread_fn(void *arg)
 	verbose_set_sample_rate(dongle.dev, dongle.rate);
 	fprintf(stderr, "Output at %u Hz.\n", demod.rate_in/demod.post_downsample);
 
+	/* the largest hop is the wrap around */
+	if (s->freq_len > 1) {
+		lo = hi = s->freqs[0];
+		for (i=1; i < s->freq_len; i++) {
+			if (s->freqs[i] < lo) {
+				lo = s->freqs[i];}
+			if (s->freqs[i] > hi) {
+				hi = s->freqs[i];}
+		}
+		dongle.settle = rtlsdr_get_settling_samples(dongle.dev, hi - lo);
+	}
+
 	while (!do_exit) {
 		safe_cond_wait(&s->hop, &s->hop_m);
 		if (s->freq_len <= 1) {
@@ -921,7 +1093,6 @@ static void *controller_thread_fn(void *arg)
 		s->freq_now = (s->freq_now + 1) % s->freq_len;
 		optimal_settings(s->freqs[s->freq_now], demod.rate_in);
 		rtlsdr_set_center_freq(dongle.dev, dongle.freq);
-		dongle.mute = BUFFER_DUMP;
 	}
 	return 0;
 }
@@ -963,7 +1134,6 @@ void dongle_init(struct dongle_state *s)
 {
 	s->rate = DEFAULT_SAMPLE_RATE;
 	s->gain = AUTO_GAIN; // tenths of a dB
-	s->mute = 0;
 	s->direct_sampling = 0;
 	s->offset_tuning = 0;
 	s->demod_target = &demod;
@@ -1035,6 +1205,137 @@ void controller_cleanup(struct controller_state *s)
 	pthread_mutex_destroy(&s->hop_m);
 }
 
+/* a center on the channel grid with all frequencies inside the usable
+ * part of the band, and none of them on the DC spike */
+static int bank_center(struct bank_state *b, struct controller_state *cs)
+{
+	int i, k, ok;
+	uint32_t lo, hi;
+	int64_t base, center, limit;
+	lo = hi = cs->freqs[0];
+	for (i=1; i < cs->freq_len; i++) {
+		if (cs->freqs[i] < lo) {
+			lo = cs->freqs[i];}
+		if (cs->freqs[i] > hi) {
+			hi = cs->freqs[i];}
+	}
+	limit = (int64_t)(b->channels / 2 - 1) * b->spacing;
+	base = lo + (int64_t)((hi - lo) / 2 / b->spacing) * b->spacing;
+	for (k = 0; k < b->channels; k++) {
+		center = base + (int64_t)((k & 1) ? -(k + 1) / 2 : k / 2) * b->spacing;
+		if (lo < center - limit || hi > center + limit) {
+			continue;}
+		ok = 1;
+		for (i=0; i < cs->freq_len; i++) {
+			if (cs->freqs[i] == center) {
+				ok = 0;}
+		}
+		if (ok) {
+			b->center = (uint32_t)center;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static struct demod_state *bank_demod_new(struct demod_state *tmpl)
+{
+	struct demod_state *d = calloc(1, sizeof(struct demod_state));
+	if (!d) {
+		return NULL;}
+	demod_init(d);
+	d->rate_in = tmpl->rate_out;
+	d->rate_out = tmpl->rate_out;
+	d->rate_out2 = tmpl->rate_out2;
+	d->downsample = 1;
+	d->output_scale = 1;
+	d->mode_demod = tmpl->mode_demod;
+	d->custom_atan = tmpl->custom_atan;
+	d->squelch_level = tmpl->squelch_level;
+	d->conseq_squelch = tmpl->conseq_squelch;
+	d->deemph = tmpl->deemph;
+	d->deemph_a = tmpl->deemph_a;
+	d->dc_block = tmpl->dc_block;
+	return d;
+}
+
+int bank_init(struct bank_state *b, struct controller_state *cs, char *pattern)
+{
+	int i, lo = 0;
+	char name[1024];
+	struct bank_channel *ch;
+	for (i=1; i < cs->freq_len; i++) {
+		if (cs->freqs[i] < cs->freqs[lo]) {
+			lo = i;}
+	}
+	for (i=0; i < cs->freq_len; i++) {
+		if ((cs->freqs[i] - cs->freqs[lo]) % b->spacing) {
+			fprintf(stderr, "%u Hz is off the grid of %u Hz channels.\n",
+				cs->freqs[i], b->spacing);
+			return -1;
+		}
+	}
+	if (bank_center(b, cs) < 0) {
+		fprintf(stderr, "Frequencies span more than %u kHz.\n",
+			(b->channels - 2) * b->spacing / 1000);
+		return -1;
+	}
+	b->pfb = rtlsdr_pfb_create(b->channels, 0);
+	if (!b->pfb) {
+		return -1;}
+	for (i=0; i < cs->freq_len; i++) {
+		ch = &b->chans[i];
+		ch->freq = cs->freqs[i];
+		ch->index = ((int64_t)ch->freq - b->center) / (int64_t)b->spacing;
+		/* counted right away, bank_cleanup() frees what got set up */
+		b->chan_len++;
+		ch->demod = bank_demod_new(&demod);
+		ch->weights = malloc(2 * b->channels * sizeof(float));
+		if (!ch->demod || !ch->weights) {
+			fprintf(stderr, "Out of memory for the filter bank.\n");
+			return -1;
+		}
+		if (rtlsdr_pfb_channel_weights(b->pfb, ch->index, ch->weights) < 0) {
+			return -1;}
+		snprintf(name, sizeof(name), pattern, ch->freq);
+		ch->file = fopen(name, "wb");
+		if (!ch->file) {
+			fprintf(stderr, "Failed to open %s\n", name);
+			return -1;
+		}
+	}
+	if (b->worker_len > b->chan_len) {
+		b->worker_len = b->chan_len;}
+	/* no buffer out yet, nothing to wait for */
+	b->done = b->worker_len;
+	for (i=0; i < b->worker_len; i++) {
+		b->workers[i].id = i;}
+	return 0;
+}
+
+void bank_cleanup(struct bank_state *b)
+{
+	int i;
+	for (i=0; i < b->chan_len; i++) {
+		if (b->chans[i].file) {
+			fclose(b->chans[i].file);}
+		if (b->chans[i].demod) {
+			demod_cleanup(b->chans[i].demod);
+			free(b->chans[i].demod);
+		}
+		free(b->chans[i].weights);
+	}
+	for (i=0; i < b->worker_len; i++) {
+		free(b->workers[i].samples);}
+	free(b->samples);
+	free(b->branches[0]);
+	free(b->branches[1]);
+	rtlsdr_pfb_destroy(b->pfb);
+	pthread_mutex_destroy(&b->m);
+	pthread_cond_destroy(&b->ready);
+	pthread_cond_destroy(&b->finished);
+}
+
 void sanity_checks(void)
 {
 	if (controller.freq_len == 0) {
@@ -1047,11 +1348,36 @@ void sanity_checks(void)
 		exit(1);
 	}
 
-	if (controller.freq_len > 1 && demod.squelch_level == 0) {
+	if (controller.freq_len > 1 && demod.squelch_level == 0 && !bank.spacing) {
 		fprintf(stderr, "Please specify a squelch level.  Required for scanning multiple frequencies.\n");
 		exit(1);
 	}
 
+	if (bank.spacing) {
+		if (bank.spacing > BANK_RATE / 4 || BANK_RATE % bank.spacing) {
+			fprintf(stderr, "Channel spacing must divide %i Hz at least four times.\n", BANK_RATE);
+			exit(1);
+		}
+		if (BANK_RATE / bank.spacing > BANK_CHANNELS_MAX) {
+			fprintf(stderr, "Channel spacing must be at least %i Hz.\n",
+				(BANK_RATE + BANK_CHANNELS_MAX - 1) / BANK_CHANNELS_MAX);
+			exit(1);
+		}
+		if (controller.wb_mode) {
+			fprintf(stderr, "Channelizing does not support wbfm.\n");
+			exit(1);
+		}
+		if (!output.filename || !strstr(output.filename, "%u") ||
+		    strchr(output.filename, '%') != strrchr(output.filename, '%')) {
+			fprintf(stderr, "Filename needs a single %%u for the channel frequency.\n");
+			exit(1);
+		}
+		if (bank.worker_len < 1 || bank.worker_len > BANK_WORKERS_MAX) {
+			fprintf(stderr, "Worker threads must be between 1 and %i.\n", BANK_WORKERS_MAX);
+			exit(1);
+		}
+	}
+
 }
 
 int main(int argc, char **argv)
@@ -1060,19 +1386,19 @@ int main(int argc, char **argv)
 	struct sigaction sigact;
 #endif
 	int r, opt;
-	int dev_given = 0;
+	char *dev_str = "0";
 	int custom_ppm = 0;
     int enable_biastee = 0;
 	dongle_init(&dongle);
 	demod_init(&demod);
 	output_init(&output);
 	controller_init(&controller);
+	bank.worker_len = BANK_WORKERS_DEFAULT;
 
-	while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:E:F:A:M:hT")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:c:j:E:F:A:M:hT")) != -1) {
 		switch (opt) {
 		case 'd':
-			dongle.dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'f':
 			if (controller.freq_len >= FREQUENCIES_LIMIT) {
@@ -1116,6 +1442,12 @@ int main(int argc, char **argv)
 			dongle.ppm_error = atoi(optarg);
 			custom_ppm = 1;
 			break;
+		case 'c':
+			bank.spacing = (uint32_t)atofs(optarg);
+			break;
+		case 'j':
+			bank.worker_len = atoi(optarg);
+			break;
 		case 'E':
 			if (strcmp("edge",  optarg) == 0) {
 				controller.edge = 1;}
@@ -1175,36 +1507,34 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* every channel comes out of the filter bank at the spacing */
+	if (bank.spacing) {
+		demod.rate_in = bank.spacing;
+		demod.rate_out = bank.spacing;
+		demod.post_downsample = 1;
+	}
+
 	/* quadruple sample_rate to limit to Δθ to ±π/2 */
 	demod.rate_in *= demod.post_downsample;
 
 	if (!output.rate) {
 		output.rate = demod.rate_out;}
 
-	sanity_checks();
-
-	if (controller.freq_len > 1) {
-		demod.terminate_on_squelch = 0;}
-
 	if (argc <= optind) {
 		output.filename = "-";
 	} else {
 		output.filename = argv[optind];
 	}
 
-	ACTUAL_BUF_LENGTH = lcm_post[demod.post_downsample] * DEFAULT_BUF_LENGTH;
+	sanity_checks();
 
-	if (!dev_given) {
-		dongle.dev_index = verbose_device_search("0");
-	}
+	if (controller.freq_len > 1) {
+		demod.terminate_on_squelch = 0;}
 
-	if (dongle.dev_index < 0) {
-		exit(1);
-	}
+	ACTUAL_BUF_LENGTH = lcm_post[demod.post_downsample] * DEFAULT_BUF_LENGTH;
 
-	r = rtlsdr_open(&dongle.dev, (uint32_t)dongle.dev_index);
+	r = verbose_device_open(&dongle.dev, dev_str);
 	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dongle.dev_index);
 		exit(1);
 	}
 #ifndef _WIN32
@@ -1237,7 +1567,9 @@ int main(int argc, char **argv)
 
 	verbose_ppm_set(dongle.dev, dongle.ppm_error);
 
-	if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
+	if (bank.spacing) {
+		/* one file per channel, opened along with the filter bank */
+	} else if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
 		output.file = stdout;
 #ifdef _WIN32
 		_setmode(_fileno(output.file), _O_BINARY);
@@ -1255,10 +1587,29 @@ int main(int argc, char **argv)
 	/* Reset endpoint before we start reading from it (mandatory) */
 	verbose_reset_buffer(dongle.dev);
 
-	pthread_create(&controller.thread, NULL, controller_thread_fn, (void *)(&controller));
-	usleep(100000);
-	pthread_create(&output.thread, NULL, output_thread_fn, (void *)(&output));
-	pthread_create(&demod.thread, NULL, demod_thread_fn, (void *)(&demod));
+	if (bank.spacing) {
+		bank.channels = BANK_RATE / bank.spacing;
+		pthread_mutex_init(&bank.m, NULL);
+		pthread_cond_init(&bank.ready, NULL);
+		pthread_cond_init(&bank.finished, NULL);
+		if (bank_init(&bank, &controller, output.filename) < 0) {
+			bank_cleanup(&bank);
+			rtlsdr_close(dongle.dev);
+			exit(1);
+		}
+		verbose_set_frequency(dongle.dev, bank.center);
+		verbose_set_sample_rate(dongle.dev, BANK_RATE);
+		fprintf(stderr, "Demodulating %i channels of %u Hz with %i threads.\n",
+			bank.chan_len, bank.spacing, bank.worker_len);
+		for (r=0; r < bank.worker_len; r++) {
+			pthread_create(&bank.workers[r].thread, NULL, bank_worker_fn, (void *)(&bank.workers[r]));}
+		r = 0;
+	} else {
+		pthread_create(&controller.thread, NULL, controller_thread_fn, (void *)(&controller));
+		usleep(100000);
+		pthread_create(&output.thread, NULL, output_thread_fn, (void *)(&output));
+		pthread_create(&demod.thread, NULL, demod_thread_fn, (void *)(&demod));
+	}
 	pthread_create(&dongle.thread, NULL, dongle_thread_fn, (void *)(&dongle));
 
 	while (!do_exit) {
@@ -1271,20 +1622,32 @@ int main(int argc, char **argv)
 		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);}
 
 	rtlsdr_cancel_async(dongle.dev);
-	pthread_join(dongle.thread, NULL);
-	safe_cond_signal(&demod.ready, &demod.ready_m);
-	pthread_join(demod.thread, NULL);
-	safe_cond_signal(&output.ready, &output.ready_m);
-	pthread_join(output.thread, NULL);
-	safe_cond_signal(&controller.hop, &controller.hop_m);
-	pthread_join(controller.thread, NULL);
+	if (bank.spacing) {
+		pthread_mutex_lock(&bank.m);
+		pthread_cond_broadcast(&bank.ready);
+		pthread_cond_broadcast(&bank.finished);
+		pthread_mutex_unlock(&bank.m);
+		pthread_join(dongle.thread, NULL);
+		for (r=0; r < bank.worker_len; r++) {
+			pthread_join(bank.workers[r].thread, NULL);}
+		r = 0;
+		bank_cleanup(&bank);
+	} else {
+		pthread_join(dongle.thread, NULL);
+		safe_cond_signal(&demod.ready, &demod.ready_m);
+		pthread_join(demod.thread, NULL);
+		safe_cond_signal(&output.ready, &output.ready_m);
+		pthread_join(output.thread, NULL);
+		safe_cond_signal(&controller.hop, &controller.hop_m);
+		pthread_join(controller.thread, NULL);
+	}
 
 	//dongle_cleanup(&dongle);
 	demod_cleanup(&demod);
 	output_cleanup(&output);
 	controller_cleanup(&controller);
 
-	if (output.file != stdout) {
+	if (output.file && output.file != stdout) {
 		fclose(output.file);}
 
 	rtlsdr_close(dongle.dev);
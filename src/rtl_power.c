@@ -76,6 +76,7 @@
 #define MINIMUM_RATE			1000000
 
 static volatile int do_exit = 0;
+static int input_ended = 0;
 static rtlsdr_dev_t *dev = NULL;
 FILE *file;
 
@@ -130,7 +131,8 @@ void usage(void)
 		"\t[-e exit_timer (default: off/0)]\n"
 		//"\t[-s avg/iir smoothing (default: avg)]\n"
 		//"\t[-t threads (default: 1)]\n"
-		"\t[-d device_index or serial (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
+		"\t    file:<capture> replays a recording, fastfile:<capture> unpaced\n"
 		"\t[-g tuner_gain (default: automatic)]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-T enable bias-T on GPIO PIN 0 (works for rtl-sdr.com v3 dongles)]\n"
@@ -538,16 +540,60 @@ void frequency_range(char *arg, double crop)
 	fprintf(stderr, "Buffer size: %i bytes (%0.2fms)\n", buf_len, 1000 * 0.5 * (float)buf_len / (float)bw_used);
 }
 
-void retune(rtlsdr_dev_t *d, int freq)
+void set_freq_plan(rtlsdr_dev_t *d)
+/* lets the library precompute the tuner settings of every hop */
+{
+	int i;
+	uint32_t *freqs = malloc(tune_count * sizeof(uint32_t));
+	if (!freqs) {
+		fprintf(stderr, "Error: malloc.\n");
+		exit(1);
+	}
+	for (i=0; i<tune_count; i++) {
+		freqs[i] = (uint32_t)tunes[i].freq;}
+	if (rtlsdr_set_freq_plan(d, freqs, tune_count) < 0) {
+		fprintf(stderr, "WARNING: Failed to set frequency plan.\n");}
+	free(freqs);
+}
+
+void calibrate_settling(rtlsdr_dev_t *d)
+/* measure the samples lost per hop and on the wrap around */
+{
+	uint32_t steps[2];
+	if (tune_count < 2) {
+		return;}
+	steps[0] = (uint32_t)(tunes[1].freq - tunes[0].freq);
+	steps[1] = (uint32_t)(tunes[tune_count-1].freq - tunes[0].freq);
+	if (rtlsdr_calibrate_settling(d, (uint32_t)tunes[0].freq, steps, 2) < 0) {
+		fprintf(stderr, "WARNING: Failed to calibrate settling time.\n");
+		return;}
+	fprintf(stderr, "Settling: %u samples per hop, %u on wrap around\n",
+		rtlsdr_get_settling_samples(d, steps[0]),
+		rtlsdr_get_settling_samples(d, steps[1]));
+}
+
+void retune(rtlsdr_dev_t *d, int hop)
 {
 	uint8_t dump[BUFFER_DUMP];
-	int n_read;
-	rtlsdr_set_center_freq(d, (uint32_t)freq);
-	/* wait for settling and flush buffer */
-	usleep(5000);
-	rtlsdr_read_sync(d, &dump, BUFFER_DUMP, &n_read);
-	if (n_read != BUFFER_DUMP) {
-		fprintf(stderr, "Error: bad retune.\n");}
+	int n_read, len, chunk;
+	int step = abs(tunes[hop].freq - (int)rtlsdr_get_center_freq(d));
+	/* a hop fails without a frequency plan, tune directly then */
+	if (rtlsdr_hop(d, (uint32_t)hop) < 0 &&
+	    rtlsdr_set_center_freq(d, (uint32_t)tunes[hop].freq) < 0) {
+		fprintf(stderr, "WARNING: Failed to tune to %i Hz.\n",
+			tunes[hop].freq);}
+	/* drop what was captured before the hop, then wait for settling */
+	rtlsdr_reset_buffer(d);
+	len = 2 * (int)rtlsdr_get_settling_samples(d, (uint32_t)step);
+	len = (len + 511) / 512 * 512;
+	while (len > 0) {
+		chunk = len < BUFFER_DUMP ? len : BUFFER_DUMP;
+		rtlsdr_read_sync(d, &dump, chunk, &n_read);
+		if (n_read != chunk) {
+			fprintf(stderr, "Error: bad retune.\n");
+			break;}
+		len -= chunk;
+	}
 }
 
 void fifth_order(int16_t *data, int length)
@@ -652,8 +698,13 @@ void scanner(void)
 		ts = &tunes[i];
 		f = (int)rtlsdr_get_center_freq(dev);
 		if (f != ts->freq) {
-			retune(dev, ts->freq);}
-		rtlsdr_read_sync(dev, ts->buf8, buf_len, &n_read);
+			retune(dev, i);}
+		if (rtlsdr_read_sync(dev, ts->buf8, buf_len, &n_read) < 0) {
+			/* device gone, or the end of a replayed capture */
+			fprintf(stderr, "Error: read failed.\n");
+			input_ended = 1;
+			do_exit = 1;
+			return;}
 		if (n_read != buf_len) {
 			fprintf(stderr, "Error: dropped samples.\n");}
 		/* rms */
@@ -662,9 +713,7 @@ void scanner(void)
 			continue;
 		}
 		/* prep for fft */
-		for (j=0; j<buf_len; j++) {
-			fft_buf[j] = (int16_t)ts->buf8[j] - 127;
-		}
+		rtlsdr_convert_s16(ts->buf8, fft_buf, buf_len);
 		ds = ts->downsample;
 		ds_p = ts->downsample_passes;
 		if (boxcar && ds > 1) {
@@ -772,8 +821,7 @@ int main(int argc, char **argv)
 	int i, length, r, opt, wb_mode = 0;
 	int f_set = 0;
 	int gain = AUTO_GAIN; // tenths of a dB
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	int ppm_error = 0;
 	int interval = 10;
 	int fft_threads = 1;
@@ -799,8 +847,7 @@ int main(int argc, char **argv)
 			f_set = 1;
 			break;
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'g':
 			gain = (int)(atof(optarg) * 10);
@@ -896,17 +943,8 @@ int main(int argc, char **argv)
 
 	fprintf(stderr, "Reporting every %i seconds\n", interval);
 
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
-		exit(1);
-	}
-
-	r = rtlsdr_open(&dev, (uint32_t)dev_index);
+	r = verbose_device_open(&dev, dev_str);
 	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
 		exit(1);
 	}
 #ifndef _WIN32
@@ -962,6 +1000,8 @@ int main(int argc, char **argv)
 
 	/* actually do stuff */
 	rtlsdr_set_sample_rate(dev, (uint32_t)tunes[0].rate);
+	set_freq_plan(dev);
+	calibrate_settling(dev);
 	sine_table(tunes[0].bin_e);
 	next_tick = time(NULL) + interval;
 	if (exit_time) {
@@ -975,7 +1015,8 @@ int main(int argc, char **argv)
 	while (!do_exit) {
 		scanner();
 		time_now = time(NULL);
-		if (time_now < next_tick) {
+		/* report the samples read so far when the input ends */
+		if (time_now < next_tick && !input_ended) {
 			continue;}
 		// time, Hz low, Hz high, Hz step, samples, dbm, dbm, ...
 		cal_time = localtime(&time_now);
@@ -49,10 +49,11 @@ void usage(void)
 		"rtl_sdr, an I/Q recorder for RTL2832 based DVB-T receivers\n\n"
 		"Usage:\t -f frequency_to_tune_to [Hz]\n"
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
-		"\t[-d device_index or serial (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
 		"\t[-g gain (default: 0 for auto)]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-b output_block_size (default: 16 * 16384)]\n"
+		"\t[-l latency target in ms, sizes async blocks (default: off)]\n"
 		"\t[-n number of samples to read (default: 0, infinite)]\n"
 		"\t[-S force sync output (default: async)]\n"
 		"\t[-D enable direct sampling (default: off)]\n"
@@ -118,17 +119,16 @@ int main(int argc, char **argv)
 	int sync_mode = 0;
 	FILE *file;
 	uint8_t *buffer;
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	uint32_t frequency = 100000000;
 	uint32_t samp_rate = DEFAULT_SAMPLE_RATE;
 	uint32_t out_block_size = DEFAULT_BUF_LENGTH;
+	uint32_t latency_us = 0;
 
-	while ((opt = getopt(argc, argv, "d:f:g:s:b:n:p:SD")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:s:b:l:n:p:SD")) != -1) {
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'f':
 			frequency = (uint32_t)atofs(optarg);
@@ -145,6 +145,9 @@ int main(int argc, char **argv)
 		case 'b':
 			out_block_size = (uint32_t)atof(optarg);
 			break;
+		case 'l':
+			latency_us = (uint32_t)(atof(optarg) * 1000);
+			break;
 		case 'n':
 			bytes_to_read = (uint32_t)atof(optarg) * 2;
 			break;
@@ -179,17 +182,8 @@ int main(int argc, char **argv)
 
 	buffer = malloc(out_block_size * sizeof(uint8_t));
 
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
-		exit(1);
-	}
-
-	r = rtlsdr_open(&dev, (uint32_t)dev_index);
+	r = verbose_device_open(&dev, dev_str);
 	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
 		exit(1);
 	}
 #ifndef _WIN32
@@ -270,6 +264,11 @@ int main(int argc, char **argv)
 		}
 	} else {
 		fprintf(stderr, "Reading samples in async mode...\n");
+		if (latency_us) {
+			/* let the library size the blocks for the rate */
+			rtlsdr_set_latency_target(dev, latency_us);
+			out_block_size = 0;
+		}
 		r = rtlsdr_read_async(dev, rtlsdr_callback, (void *)file,
 				      0, out_block_size);
 	}
@@ -102,7 +102,7 @@ void usage(void)
 	printf("\t[-s samplerate in Hz (default: %d Hz)]\n", DEFAULT_SAMPLE_RATE_HZ);
 	printf("\t[-b number of buffers (default: 15, set by library)]\n");
 	printf("\t[-n max number of linked list buffers to keep (default: %d)]\n", DEFAULT_MAX_NUM_BUFFERS);
-	printf("\t[-d device index or serial (default: 0)]\n");
+	printf("\t[-d device index, serial or USB path (default: 0)]\n");
 	printf("\t[-P ppm_error (default: 0)]\n");
 	printf("\t[-T enable bias-T on GPIO PIN 0 (works for rtl-sdr.com v3 dongles)]\n");
 	printf("\t[-D enable direct sampling (default: off)]\n");
@@ -393,8 +393,7 @@ int main(int argc, char **argv)
 	char remportinfo[NI_MAXSERV];
 	int aiErr;
 	uint32_t buf_num = 0;
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	int gain = 0;
 	int ppm_error = 0;
 	int direct_sampling = 0;
@@ -418,8 +417,7 @@ int main(int argc, char **argv)
 	while ((opt = getopt(argc, argv, "a:p:f:g:s:b:n:d:P:TD")) != -1) {
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 'f':
 			frequency = (uint32_t)atofs(optarg);
@@ -460,17 +458,8 @@ int main(int argc, char **argv)
 	if (argc < optind)
 		usage();
 
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
-	    exit(1);
-	}
-
-	rtlsdr_open(&dev, (uint32_t)dev_index);
-	if (NULL == dev) {
-	fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
+	r = verbose_device_open(&dev, dev_str);
+	if (r < 0) {
 		exit(1);
 	}
 
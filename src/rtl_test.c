@@ -90,7 +90,7 @@ void usage(void)
 		"rtl_test, a benchmark tool for RTL2832 based DVB-T receivers\n\n"
 		"Usage:\n"
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
-		"\t[-d device_index or serial (default: 0)]\n"
+		"\t[-d device_index, serial or USB path (default: 0)]\n"
 		"\t[-t enable Elonics E4000 tuner benchmark]\n"
 #ifndef _WIN32
 		"\t[-p[seconds] enable PPM error measurement (default: 10 seconds)]\n"
@@ -310,8 +310,7 @@ int main(int argc, char **argv)
 	int n_read, r, opt, i;
 	int sync_mode = 0;
 	uint8_t *buffer;
-	int dev_index = 0;
-	int dev_given = 0;
+	char *dev_str = "0";
 	uint32_t out_block_size = DEFAULT_BUF_LENGTH;
 	int count;
 	int gains[100];
@@ -319,8 +318,7 @@ int main(int argc, char **argv)
 	while ((opt = getopt(argc, argv, "d:s:b:tp::Sh")) != -1) {
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_str = optarg;
 			break;
 		case 's':
 			samp_rate = (uint32_t)atof(optarg);
@@ -359,17 +357,8 @@ int main(int argc, char **argv)
 
 	buffer = malloc(out_block_size * sizeof(uint8_t));
 
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
-		exit(1);
-	}
-
-	r = rtlsdr_open(&dev, (uint32_t)dev_index);
+	r = verbose_device_open(&dev, dev_str);
 	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
 		exit(1);
 	}
 #ifndef _WIN32
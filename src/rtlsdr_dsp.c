@@ -0,0 +1,1400 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * Sample processing shared by the applications: conversion of the 8 bit
+ * unsigned I/Q samples of the dongle, correction of DC offset and I/Q
+ * imbalance, digital down-conversion and channelization, vectorized for
+ * SSE2, AVX2 and NEON with the implementation picked at runtime.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+#define _USE_MATH_DEFINES
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "rtl-sdr.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DSP_X86
+#define DSP_AVX2
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <emmintrin.h>
+#define DSP_X86
+#define TARGET_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DSP_NEON
+#endif
+
+/* the samples are centered at 127.5, float output is scaled to +-1.0 */
+#define CONV_SCALE	(1.0f / 127.5f)
+#define CONV_OFFSET	(-1.0f)
+
+/* I/Q pairs summed up in float before adding to the double totals */
+#define CORR_CHUNK	4096
+
+/* sums of a run of I/Q pairs */
+enum { SUM_I, SUM_Q, SUM_II, SUM_QQ, SUM_IQ, SUM_NUM };
+
+/* correction of a pair: I' = I - dc_i, Q' = c1 * (Q - dc_q) + c2 * I' */
+enum { K_DC_I, K_DC_Q, K_C1, K_C2 };
+
+struct rtlsdr_convert_impl {
+	const char *name;
+	void (*s16)(const unsigned char *in, int16_t *out, uint32_t len);
+	void (*f32)(const unsigned char *in, float *out, uint32_t len);
+	void (*stats)(const float *iq, uint32_t pairs, float *sum);
+	void (*apply)(float *iq, uint32_t pairs, const float *k);
+	void (*mix)(const float *in, float *out, uint32_t pairs,
+		    double phase, double step);
+	void (*dot)(const float *x, const float *h, uint32_t len, float *res);
+	void (*macc)(const float *x, const float *h, uint32_t len, float *acc);
+	void (*cdot)(const float *x, const float *w, uint32_t pairs,
+		     float *res);
+};
+
+static void convert_s16_scalar(const unsigned char *in, int16_t *out,
+			       uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		out[i] = (int16_t)in[i] - 127;
+}
+
+static void convert_f32_scalar(const unsigned char *in, float *out,
+			       uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++)
+		out[i] = (float)in[i] * CONV_SCALE + CONV_OFFSET;
+}
+
+static void corr_stats_scalar(const float *iq, uint32_t pairs, float *sum)
+{
+	float i, q;
+	uint32_t n;
+
+	for (n = 0; n < pairs; n++) {
+		i = iq[2 * n];
+		q = iq[2 * n + 1];
+		sum[SUM_I] += i;
+		sum[SUM_Q] += q;
+		sum[SUM_II] += i * i;
+		sum[SUM_QQ] += q * q;
+		sum[SUM_IQ] += i * q;
+	}
+}
+
+static void corr_apply_scalar(float *iq, uint32_t pairs, const float *k)
+{
+	float i;
+	uint32_t n;
+
+	for (n = 0; n < pairs; n++) {
+		i = iq[2 * n] - k[K_DC_I];
+		iq[2 * n] = i;
+		iq[2 * n + 1] = (iq[2 * n + 1] - k[K_DC_Q]) * k[K_C1] +
+				i * k[K_C2];
+	}
+}
+
+/* phasors of the first lanes pairs from phase on, and the one advancing
+ * them by lanes pairs at once */
+static void ddc_lanes(double phase, double step, int lanes, float *p,
+		      float *adv)
+{
+	int k;
+
+	for (k = 0; k < lanes; k++) {
+		p[2 * k] = (float)cos(phase + k * step);
+		p[2 * k + 1] = (float)sin(phase + k * step);
+	}
+
+	adv[0] = (float)cos(lanes * step);
+	adv[1] = (float)sin(lanes * step);
+}
+
+static void ddc_mix_scalar(const float *in, float *out, uint32_t pairs,
+			   double phase, double step)
+{
+	float p[2], adv[2], i, q, t;
+	uint32_t n;
+
+	ddc_lanes(phase, step, 1, p, adv);
+
+	for (n = 0; n < pairs; n++) {
+		i = in[2 * n];
+		q = in[2 * n + 1];
+		out[2 * n] = i * p[0] - q * p[1];
+		out[2 * n + 1] = i * p[1] + q * p[0];
+		t = p[0] * adv[0] - p[1] * adv[1];
+		p[1] = p[0] * adv[1] + p[1] * adv[0];
+		p[0] = t;
+	}
+}
+
+static void ddc_dot_scalar(const float *x, const float *h, uint32_t len,
+			   float *res)
+{
+	float i = 0.0f, q = 0.0f;
+	uint32_t n;
+
+	for (n = 0; n + 2 <= len; n += 2) {
+		i += x[n] * h[n];
+		q += x[n + 1] * h[n + 1];
+	}
+
+	res[0] += i;
+	res[1] += q;
+}
+
+static void pfb_macc_scalar(const float *x, const float *h, uint32_t len,
+			    float *acc)
+{
+	uint32_t n;
+
+	for (n = 0; n < len; n++)
+		acc[n] += x[n] * h[n];
+}
+
+static void pfb_cdot_scalar(const float *x, const float *w, uint32_t pairs,
+			    float *res)
+{
+	float i = 0.0f, q = 0.0f;
+	uint32_t n;
+
+	for (n = 0; n < pairs; n++) {
+		i += x[2 * n] * w[2 * n] - x[2 * n + 1] * w[2 * n + 1];
+		q += x[2 * n] * w[2 * n + 1] + x[2 * n + 1] * w[2 * n];
+	}
+
+	res[0] += i;
+	res[1] += q;
+}
+
+#ifdef DSP_X86
+TARGET_SSE2
+static void convert_s16_sse2(const unsigned char *in, int16_t *out,
+			     uint32_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offs = _mm_set1_epi16(127);
+	__m128i v;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i),
+				 _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), offs));
+		_mm_storeu_si128((__m128i *)(out + i + 8),
+				 _mm_sub_epi16(_mm_unpackhi_epi8(v, zero), offs));
+	}
+
+	convert_s16_scalar(in + i, out + i, len - i);
+}
+
+TARGET_SSE2
+static void convert_f32_sse2(const unsigned char *in, float *out,
+			     uint32_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(CONV_SCALE);
+	const __m128 offs = _mm_set1_ps(CONV_OFFSET);
+	__m128i v, w;
+	__m128 f;
+	uint32_t i;
+	int j;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		for (j = 0; j < 2; j++) {
+			w = j ? _mm_unpackhi_epi8(v, zero) :
+				_mm_unpacklo_epi8(v, zero);
+
+			f = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w, zero));
+			f = _mm_add_ps(_mm_mul_ps(f, scale), offs);
+			_mm_storeu_ps(out + i + 8 * j, f);
+
+			f = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w, zero));
+			f = _mm_add_ps(_mm_mul_ps(f, scale), offs);
+			_mm_storeu_ps(out + i + 8 * j + 4, f);
+		}
+	}
+
+	convert_f32_scalar(in + i, out + i, len - i);
+}
+
+/* the vectors hold whole pairs, I in the even and Q in the odd lanes */
+TARGET_SSE2
+static void corr_stats_sse2(const float *iq, uint32_t pairs, float *sum)
+{
+	__m128 s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps();
+	__m128 sx = _mm_setzero_ps();
+	__m128 v;
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		v = _mm_loadu_ps(iq + 2 * n);
+		s1 = _mm_add_ps(s1, v);
+		s2 = _mm_add_ps(s2, _mm_mul_ps(v, v));
+		sx = _mm_add_ps(sx, _mm_mul_ps(v, _mm_shuffle_ps(v, v,
+					_MM_SHUFFLE(2, 3, 0, 1))));
+	}
+
+	_mm_storeu_ps(t, s1);
+	sum[SUM_I] += t[0] + t[2];
+	sum[SUM_Q] += t[1] + t[3];
+	_mm_storeu_ps(t, s2);
+	sum[SUM_II] += t[0] + t[2];
+	sum[SUM_QQ] += t[1] + t[3];
+	_mm_storeu_ps(t, sx);
+	sum[SUM_IQ] += t[0] + t[2];
+
+	corr_stats_scalar(iq + 2 * n, pairs - n, sum);
+}
+
+TARGET_SSE2
+static void corr_apply_sse2(float *iq, uint32_t pairs, const float *k)
+{
+	const __m128 dc = _mm_setr_ps(k[K_DC_I], k[K_DC_Q],
+				      k[K_DC_I], k[K_DC_Q]);
+	const __m128 m1 = _mm_setr_ps(1.0f, k[K_C1], 1.0f, k[K_C1]);
+	const __m128 m2 = _mm_setr_ps(0.0f, k[K_C2], 0.0f, k[K_C2]);
+	__m128 d;
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		d = _mm_sub_ps(_mm_loadu_ps(iq + 2 * n), dc);
+		d = _mm_add_ps(_mm_mul_ps(d, m1),
+			       _mm_mul_ps(_mm_shuffle_ps(d, d,
+					  _MM_SHUFFLE(2, 2, 0, 0)), m2));
+		_mm_storeu_ps(iq + 2 * n, d);
+	}
+
+	corr_apply_scalar(iq + 2 * n, pairs - n, k);
+}
+
+/* complex product of the pairs in a and b */
+TARGET_SSE2
+static inline __m128 cmul_sse2(__m128 a, __m128 b)
+{
+	const __m128 sign = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+	__m128 re = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+	__m128 im = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+	__m128 sw = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+
+	return _mm_add_ps(_mm_mul_ps(a, re),
+			  _mm_mul_ps(_mm_mul_ps(sw, im), sign));
+}
+
+TARGET_SSE2
+static void ddc_mix_sse2(const float *in, float *out, uint32_t pairs,
+			 double phase, double step)
+{
+	float p_v[4], adv_v[2];
+	__m128 p, adv;
+	uint32_t n;
+
+	ddc_lanes(phase, step, 2, p_v, adv_v);
+	p = _mm_loadu_ps(p_v);
+	adv = _mm_setr_ps(adv_v[0], adv_v[1], adv_v[0], adv_v[1]);
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		_mm_storeu_ps(out + 2 * n, cmul_sse2(_mm_loadu_ps(in + 2 * n), p));
+		p = cmul_sse2(p, adv);
+	}
+
+	_mm_storeu_ps(p_v, p);
+	if (n < pairs)
+		ddc_mix_scalar(in + 2 * n, out + 2 * n, pairs - n,
+			       atan2(p_v[1], p_v[0]), step);
+}
+
+TARGET_SSE2
+static void ddc_dot_sse2(const float *x, const float *h, uint32_t len,
+			 float *res)
+{
+	__m128 acc = _mm_setzero_ps();
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 4 <= len; n += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + n),
+						 _mm_loadu_ps(h + n)));
+
+	_mm_storeu_ps(t, acc);
+	res[0] += t[0] + t[2];
+	res[1] += t[1] + t[3];
+
+	ddc_dot_scalar(x + n, h + n, len - n, res);
+}
+
+TARGET_SSE2
+static void pfb_macc_sse2(const float *x, const float *h, uint32_t len,
+			  float *acc)
+{
+	uint32_t n;
+
+	for (n = 0; n + 4 <= len; n += 4)
+		_mm_storeu_ps(acc + n, _mm_add_ps(_mm_loadu_ps(acc + n),
+			      _mm_mul_ps(_mm_loadu_ps(x + n),
+					 _mm_loadu_ps(h + n))));
+
+	pfb_macc_scalar(x + n, h + n, len - n, acc + n);
+}
+
+TARGET_SSE2
+static void pfb_cdot_sse2(const float *x, const float *w, uint32_t pairs,
+			  float *res)
+{
+	__m128 acc = _mm_setzero_ps();
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2)
+		acc = _mm_add_ps(acc, cmul_sse2(_mm_loadu_ps(x + 2 * n),
+						_mm_loadu_ps(w + 2 * n)));
+
+	_mm_storeu_ps(t, acc);
+	res[0] += t[0] + t[2];
+	res[1] += t[1] + t[3];
+
+	pfb_cdot_scalar(x + 2 * n, w + 2 * n, pairs - n, res);
+}
+#endif
+
+#ifdef DSP_AVX2
+TARGET_AVX2
+static void convert_s16_avx2(const unsigned char *in, int16_t *out,
+			     uint32_t len)
+{
+	const __m256i offs = _mm256_set1_epi16(127);
+	__m256i v;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in + i)));
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_sub_epi16(v, offs));
+	}
+
+	convert_s16_scalar(in + i, out + i, len - i);
+}
+
+TARGET_AVX2
+static void convert_f32_avx2(const unsigned char *in, float *out,
+			     uint32_t len)
+{
+	const __m256 scale = _mm256_set1_ps(CONV_SCALE);
+	const __m256 offs = _mm256_set1_ps(CONV_OFFSET);
+	__m256i v;
+	__m256 f;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i)));
+		f = _mm256_cvtepi32_ps(v);
+		f = _mm256_add_ps(_mm256_mul_ps(f, scale), offs);
+		_mm256_storeu_ps(out + i, f);
+	}
+
+	convert_f32_scalar(in + i, out + i, len - i);
+}
+
+TARGET_AVX2
+static void corr_stats_avx2(const float *iq, uint32_t pairs, float *sum)
+{
+	__m256 s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps();
+	__m256 sx = _mm256_setzero_ps();
+	__m256 v;
+	float t[8];
+	uint32_t n;
+
+	for (n = 0; n + 4 <= pairs; n += 4) {
+		v = _mm256_loadu_ps(iq + 2 * n);
+		s1 = _mm256_add_ps(s1, v);
+		s2 = _mm256_add_ps(s2, _mm256_mul_ps(v, v));
+		sx = _mm256_add_ps(sx, _mm256_mul_ps(v,
+					_mm256_permute_ps(v, 0xb1)));
+	}
+
+	_mm256_storeu_ps(t, s1);
+	sum[SUM_I] += t[0] + t[2] + t[4] + t[6];
+	sum[SUM_Q] += t[1] + t[3] + t[5] + t[7];
+	_mm256_storeu_ps(t, s2);
+	sum[SUM_II] += t[0] + t[2] + t[4] + t[6];
+	sum[SUM_QQ] += t[1] + t[3] + t[5] + t[7];
+	_mm256_storeu_ps(t, sx);
+	sum[SUM_IQ] += t[0] + t[2] + t[4] + t[6];
+
+	corr_stats_scalar(iq + 2 * n, pairs - n, sum);
+}
+
+TARGET_AVX2
+static void corr_apply_avx2(float *iq, uint32_t pairs, const float *k)
+{
+	const __m256 dc = _mm256_setr_ps(k[K_DC_I], k[K_DC_Q],
+					 k[K_DC_I], k[K_DC_Q],
+					 k[K_DC_I], k[K_DC_Q],
+					 k[K_DC_I], k[K_DC_Q]);
+	const __m256 m1 = _mm256_setr_ps(1.0f, k[K_C1], 1.0f, k[K_C1],
+					 1.0f, k[K_C1], 1.0f, k[K_C1]);
+	const __m256 m2 = _mm256_setr_ps(0.0f, k[K_C2], 0.0f, k[K_C2],
+					 0.0f, k[K_C2], 0.0f, k[K_C2]);
+	__m256 d;
+	uint32_t n;
+
+	for (n = 0; n + 4 <= pairs; n += 4) {
+		d = _mm256_sub_ps(_mm256_loadu_ps(iq + 2 * n), dc);
+		d = _mm256_add_ps(_mm256_mul_ps(d, m1),
+				  _mm256_mul_ps(_mm256_moveldup_ps(d), m2));
+		_mm256_storeu_ps(iq + 2 * n, d);
+	}
+
+	corr_apply_scalar(iq + 2 * n, pairs - n, k);
+}
+
+TARGET_AVX2
+static void ddc_mix_avx2(const float *in, float *out, uint32_t pairs,
+			 double phase, double step)
+{
+	float p_v[8], adv_v[2];
+	__m256 p, adv, a;
+	uint32_t n;
+
+	ddc_lanes(phase, step, 4, p_v, adv_v);
+	p = _mm256_loadu_ps(p_v);
+	adv = _mm256_setr_ps(adv_v[0], adv_v[1], adv_v[0], adv_v[1],
+			     adv_v[0], adv_v[1], adv_v[0], adv_v[1]);
+
+	for (n = 0; n + 4 <= pairs; n += 4) {
+		a = _mm256_loadu_ps(in + 2 * n);
+		_mm256_storeu_ps(out + 2 * n, _mm256_addsub_ps(
+			_mm256_mul_ps(a, _mm256_moveldup_ps(p)),
+			_mm256_mul_ps(_mm256_permute_ps(a, 0xb1),
+				      _mm256_movehdup_ps(p))));
+		p = _mm256_addsub_ps(
+			_mm256_mul_ps(p, _mm256_moveldup_ps(adv)),
+			_mm256_mul_ps(_mm256_permute_ps(p, 0xb1),
+				      _mm256_movehdup_ps(adv)));
+	}
+
+	_mm256_storeu_ps(p_v, p);
+	if (n < pairs)
+		ddc_mix_scalar(in + 2 * n, out + 2 * n, pairs - n,
+			       atan2(p_v[1], p_v[0]), step);
+}
+
+TARGET_AVX2
+static void ddc_dot_avx2(const float *x, const float *h, uint32_t len,
+			 float *res)
+{
+	__m256 acc = _mm256_setzero_ps();
+	float t[8];
+	uint32_t n;
+
+	for (n = 0; n + 8 <= len; n += 8)
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + n),
+						       _mm256_loadu_ps(h + n)));
+
+	_mm256_storeu_ps(t, acc);
+	res[0] += t[0] + t[2] + t[4] + t[6];
+	res[1] += t[1] + t[3] + t[5] + t[7];
+
+	ddc_dot_scalar(x + n, h + n, len - n, res);
+}
+
+TARGET_AVX2
+static void pfb_macc_avx2(const float *x, const float *h, uint32_t len,
+			  float *acc)
+{
+	uint32_t n;
+
+	for (n = 0; n + 8 <= len; n += 8)
+		_mm256_storeu_ps(acc + n, _mm256_add_ps(_mm256_loadu_ps(acc + n),
+				 _mm256_mul_ps(_mm256_loadu_ps(x + n),
+					       _mm256_loadu_ps(h + n))));
+
+	pfb_macc_scalar(x + n, h + n, len - n, acc + n);
+}
+
+TARGET_AVX2
+static void pfb_cdot_avx2(const float *x, const float *w, uint32_t pairs,
+			  float *res)
+{
+	__m256 acc = _mm256_setzero_ps(), a, b;
+	float t[8];
+	uint32_t n;
+
+	for (n = 0; n + 4 <= pairs; n += 4) {
+		a = _mm256_loadu_ps(x + 2 * n);
+		b = _mm256_loadu_ps(w + 2 * n);
+		acc = _mm256_add_ps(acc, _mm256_addsub_ps(
+			_mm256_mul_ps(a, _mm256_moveldup_ps(b)),
+			_mm256_mul_ps(_mm256_permute_ps(a, 0xb1),
+				      _mm256_movehdup_ps(b))));
+	}
+
+	_mm256_storeu_ps(t, acc);
+	res[0] += t[0] + t[2] + t[4] + t[6];
+	res[1] += t[1] + t[3] + t[5] + t[7];
+
+	pfb_cdot_scalar(x + 2 * n, w + 2 * n, pairs - n, res);
+}
+#endif
+
+#ifdef DSP_NEON
+static void convert_s16_neon(const unsigned char *in, int16_t *out,
+			     uint32_t len)
+{
+	const int16x8_t offs = vdupq_n_s16(127);
+	uint8x16_t v;
+	uint32_t i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = vld1q_u8(in + i);
+		vst1q_s16(out + i, vsubq_s16(
+			vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v))), offs));
+		vst1q_s16(out + i + 8, vsubq_s16(
+			vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v))), offs));
+	}
+
+	convert_s16_scalar(in + i, out + i, len - i);
+}
+
+static void convert_f32_neon(const unsigned char *in, float *out,
+			     uint32_t len)
+{
+	const float32x4_t scale = vdupq_n_f32(CONV_SCALE);
+	const float32x4_t offs = vdupq_n_f32(CONV_OFFSET);
+	uint16x8_t w;
+	float32x4_t f;
+	uint32_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		w = vmovl_u8(vld1_u8(in + i));
+
+		f = vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+		vst1q_f32(out + i, vaddq_f32(vmulq_f32(f, scale), offs));
+
+		f = vcvtq_f32_u32(vmovl_u16(vget_high_u16(w)));
+		vst1q_f32(out + i + 4, vaddq_f32(vmulq_f32(f, scale), offs));
+	}
+
+	convert_f32_scalar(in + i, out + i, len - i);
+}
+
+static void corr_stats_neon(const float *iq, uint32_t pairs, float *sum)
+{
+	float32x4_t s1 = vdupq_n_f32(0.0f), s2 = vdupq_n_f32(0.0f);
+	float32x4_t sx = vdupq_n_f32(0.0f);
+	float32x4_t v;
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		v = vld1q_f32(iq + 2 * n);
+		s1 = vaddq_f32(s1, v);
+		s2 = vaddq_f32(s2, vmulq_f32(v, v));
+		sx = vaddq_f32(sx, vmulq_f32(v, vrev64q_f32(v)));
+	}
+
+	vst1q_f32(t, s1);
+	sum[SUM_I] += t[0] + t[2];
+	sum[SUM_Q] += t[1] + t[3];
+	vst1q_f32(t, s2);
+	sum[SUM_II] += t[0] + t[2];
+	sum[SUM_QQ] += t[1] + t[3];
+	vst1q_f32(t, sx);
+	sum[SUM_IQ] += t[0] + t[2];
+
+	corr_stats_scalar(iq + 2 * n, pairs - n, sum);
+}
+
+static void corr_apply_neon(float *iq, uint32_t pairs, const float *k)
+{
+	const float dc_v[4] = { k[K_DC_I], k[K_DC_Q], k[K_DC_I], k[K_DC_Q] };
+	const float m1_v[4] = { 1.0f, k[K_C1], 1.0f, k[K_C1] };
+	const float m2_v[4] = { 0.0f, k[K_C2], 0.0f, k[K_C2] };
+	const float32x4_t dc = vld1q_f32(dc_v);
+	const float32x4_t m1 = vld1q_f32(m1_v);
+	const float32x4_t m2 = vld1q_f32(m2_v);
+	float32x4_t d;
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		d = vsubq_f32(vld1q_f32(iq + 2 * n), dc);
+		d = vaddq_f32(vmulq_f32(d, m1),
+			      vmulq_f32(vtrnq_f32(d, d).val[0], m2));
+		vst1q_f32(iq + 2 * n, d);
+	}
+
+	corr_apply_scalar(iq + 2 * n, pairs - n, k);
+}
+
+static inline float32x4_t cmul_neon(float32x4_t a, float32x4_t b)
+{
+	const float sign_v[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+	float32x4x2_t t = vtrnq_f32(b, b);
+
+	return vaddq_f32(vmulq_f32(a, t.val[0]),
+			 vmulq_f32(vmulq_f32(vrev64q_f32(a), t.val[1]),
+				   vld1q_f32(sign_v)));
+}
+
+static void ddc_mix_neon(const float *in, float *out, uint32_t pairs,
+			 double phase, double step)
+{
+	float p_v[4], adv_v[2];
+	float32x4_t p, adv;
+	uint32_t n;
+
+	ddc_lanes(phase, step, 2, p_v, adv_v);
+	p = vld1q_f32(p_v);
+	adv = vcombine_f32(vld1_f32(adv_v), vld1_f32(adv_v));
+
+	for (n = 0; n + 2 <= pairs; n += 2) {
+		vst1q_f32(out + 2 * n, cmul_neon(vld1q_f32(in + 2 * n), p));
+		p = cmul_neon(p, adv);
+	}
+
+	vst1q_f32(p_v, p);
+	if (n < pairs)
+		ddc_mix_scalar(in + 2 * n, out + 2 * n, pairs - n,
+			       atan2(p_v[1], p_v[0]), step);
+}
+
+static void ddc_dot_neon(const float *x, const float *h, uint32_t len,
+			 float *res)
+{
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 4 <= len; n += 4)
+		acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(x + n),
+					       vld1q_f32(h + n)));
+
+	vst1q_f32(t, acc);
+	res[0] += t[0] + t[2];
+	res[1] += t[1] + t[3];
+
+	ddc_dot_scalar(x + n, h + n, len - n, res);
+}
+
+static void pfb_macc_neon(const float *x, const float *h, uint32_t len,
+			  float *acc)
+{
+	uint32_t n;
+
+	for (n = 0; n + 4 <= len; n += 4)
+		vst1q_f32(acc + n, vaddq_f32(vld1q_f32(acc + n),
+			  vmulq_f32(vld1q_f32(x + n), vld1q_f32(h + n))));
+
+	pfb_macc_scalar(x + n, h + n, len - n, acc + n);
+}
+
+static void pfb_cdot_neon(const float *x, const float *w, uint32_t pairs,
+			  float *res)
+{
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	float t[4];
+	uint32_t n;
+
+	for (n = 0; n + 2 <= pairs; n += 2)
+		acc = vaddq_f32(acc, cmul_neon(vld1q_f32(x + 2 * n),
+					       vld1q_f32(w + 2 * n)));
+
+	vst1q_f32(t, acc);
+	res[0] += t[0] + t[2];
+	res[1] += t[1] + t[3];
+
+	pfb_cdot_scalar(x + 2 * n, w + 2 * n, pairs - n, res);
+}
+#endif
+
+static const struct rtlsdr_convert_impl convert_scalar = {
+	"scalar", convert_s16_scalar, convert_f32_scalar,
+	corr_stats_scalar, corr_apply_scalar,
+	ddc_mix_scalar, ddc_dot_scalar,
+	pfb_macc_scalar, pfb_cdot_scalar
+};
+
+#ifdef DSP_X86
+static const struct rtlsdr_convert_impl convert_sse2 = {
+	"sse2", convert_s16_sse2, convert_f32_sse2,
+	corr_stats_sse2, corr_apply_sse2,
+	ddc_mix_sse2, ddc_dot_sse2,
+	pfb_macc_sse2, pfb_cdot_sse2
+};
+#endif
+
+#ifdef DSP_AVX2
+static const struct rtlsdr_convert_impl convert_avx2 = {
+	"avx2", convert_s16_avx2, convert_f32_avx2,
+	corr_stats_avx2, corr_apply_avx2,
+	ddc_mix_avx2, ddc_dot_avx2,
+	pfb_macc_avx2, pfb_cdot_avx2
+};
+#endif
+
+#ifdef DSP_NEON
+static const struct rtlsdr_convert_impl convert_neon = {
+	"neon", convert_s16_neon, convert_f32_neon,
+	corr_stats_neon, corr_apply_neon,
+	ddc_mix_neon, ddc_dot_neon,
+	pfb_macc_neon, pfb_cdot_neon
+};
+#endif
+
+static const struct rtlsdr_convert_impl *convert = &convert_scalar;
+static pthread_once_t convert_once = PTHREAD_ONCE_INIT;
+
+/* pick the best implementation the CPU we are running on supports */
+static void convert_select(void)
+{
+#if defined(DSP_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		convert = &convert_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		convert = &convert_sse2;
+#elif defined(DSP_X86)
+	convert = &convert_sse2;
+#elif defined(DSP_NEON)
+	convert = &convert_neon;
+#endif
+}
+
+void rtlsdr_convert_s16(const unsigned char *in, int16_t *out, uint32_t len)
+{
+	pthread_once(&convert_once, convert_select);
+	convert->s16(in, out, len);
+}
+
+void rtlsdr_convert_f32(const unsigned char *in, float *out, uint32_t len)
+{
+	pthread_once(&convert_once, convert_select);
+	convert->f32(in, out, len);
+}
+
+const char *rtlsdr_get_convert_impl(void)
+{
+	pthread_once(&convert_once, convert_select);
+	return convert->name;
+}
+
+/* running estimates of DC offset and I/Q imbalance */
+struct rtlsdr_iq_corr {
+	uint32_t flags;
+	uint32_t time_const;	/* I/Q pairs */
+	int primed;
+	double dc_i, dc_q;
+	double ii, qq, iq;	/* second moments around the DC offset */
+};
+
+rtlsdr_iq_corr_t *rtlsdr_iq_corr_create(uint32_t flags, uint32_t time_const)
+{
+	rtlsdr_iq_corr_t *corr;
+
+	corr = calloc(1, sizeof(rtlsdr_iq_corr_t));
+	if (!corr)
+		return NULL;
+
+	corr->flags = flags;
+	corr->time_const = time_const ? time_const : RTLSDR_CORR_TIME_CONST;
+
+	return corr;
+}
+
+void rtlsdr_iq_corr_destroy(rtlsdr_iq_corr_t *corr)
+{
+	free(corr);
+}
+
+void rtlsdr_iq_corr_reset(rtlsdr_iq_corr_t *corr)
+{
+	if (corr)
+		corr->primed = 0;
+}
+
+/* Q is modeled as g * sin(wt + phi) against I = cos(wt), the imbalance
+ * shows in the second moments: qq / ii = g^2, iq / sqrt(ii * qq) = sin(phi) */
+static int corr_imbalance(const rtlsdr_iq_corr_t *corr, double *g,
+			  double *sin_phi)
+{
+	if (corr->ii <= 0.0 || corr->qq <= 0.0)
+		return -1;
+
+	*g = sqrt(corr->qq / corr->ii);
+	*sin_phi = corr->iq / sqrt(corr->ii * corr->qq);
+
+	/* no sane receiver is off by 30 degrees, don't follow noise */
+	return fabs(*sin_phi) < 0.5 ? 0 : -1;
+}
+
+void rtlsdr_iq_corr_process(rtlsdr_iq_corr_t *corr, float *iq, uint32_t len)
+{
+	float chunk[SUM_NUM], k[4];
+	double sum[SUM_NUM], w, mi, mq, g, sin_phi, cos_phi;
+	uint32_t pairs = len / 2, done, n;
+	int i;
+
+	if (!corr || !pairs)
+		return;
+
+	pthread_once(&convert_once, convert_select);
+
+	memset(sum, 0, sizeof(sum));
+	for (done = 0; done < pairs; done += n) {
+		n = pairs - done < CORR_CHUNK ? pairs - done : CORR_CHUNK;
+		memset(chunk, 0, sizeof(chunk));
+		convert->stats(iq + 2 * done, n, chunk);
+		for (i = 0; i < SUM_NUM; i++)
+			sum[i] += chunk[i];
+	}
+
+	/* a buffer counts by its length, the first one takes over fully */
+	w = corr->primed ? (double)pairs / corr->time_const : 1.0;
+	if (w > 1.0)
+		w = 1.0;
+
+	mi = sum[SUM_I] / pairs;
+	mq = sum[SUM_Q] / pairs;
+	corr->dc_i += w * (mi - corr->dc_i);
+	corr->dc_q += w * (mq - corr->dc_q);
+
+	corr->ii += w * (sum[SUM_II] / pairs - 2.0 * corr->dc_i * mi +
+			 corr->dc_i * corr->dc_i - corr->ii);
+	corr->qq += w * (sum[SUM_QQ] / pairs - 2.0 * corr->dc_q * mq +
+			 corr->dc_q * corr->dc_q - corr->qq);
+	corr->iq += w * (sum[SUM_IQ] / pairs - corr->dc_i * mq -
+			 corr->dc_q * mi + corr->dc_i * corr->dc_q - corr->iq);
+	corr->primed = 1;
+
+	k[K_DC_I] = k[K_DC_Q] = 0.0f;
+	k[K_C1] = 1.0f;
+	k[K_C2] = 0.0f;
+
+	/* the imbalance can only be corrected around the DC offset */
+	if (corr->flags & (RTLSDR_CORR_DC | RTLSDR_CORR_IQ)) {
+		k[K_DC_I] = (float)corr->dc_i;
+		k[K_DC_Q] = (float)corr->dc_q;
+	}
+
+	if ((corr->flags & RTLSDR_CORR_IQ) &&
+	    !corr_imbalance(corr, &g, &sin_phi)) {
+		cos_phi = sqrt(1.0 - sin_phi * sin_phi);
+		k[K_C1] = (float)(1.0 / (g * cos_phi));
+		k[K_C2] = (float)(-sin_phi / cos_phi);
+	}
+
+	convert->apply(iq, pairs, k);
+}
+
+int rtlsdr_iq_corr_get_estimate(rtlsdr_iq_corr_t *corr, float *dc_i,
+				float *dc_q, float *gain, float *phase)
+{
+	double g, sin_phi;
+
+	if (!corr || !corr->primed)
+		return -1;
+
+	if (dc_i)
+		*dc_i = (float)corr->dc_i;
+	if (dc_q)
+		*dc_q = (float)corr->dc_q;
+
+	/* no signal, or statistics no receiver produces */
+	if (corr_imbalance(corr, &g, &sin_phi))
+		return -2;
+
+	if (gain)
+		*gain = (float)g;
+	if (phase)
+		*phase = (float)asin(sin_phi);
+
+	return 0;
+}
+
+/* I/Q pairs mixed with the phasors of one accurate starting phase, keeps
+ * the rounding errors of the recursive NCO from adding up */
+#define DDC_BLOCK	1024
+
+/* the CIC runs on 16 bit samples in wrapping 64 bit integers, which stay
+ * exact as long as 16 + DDC_CIC_ORDER * log2(decimation) bits fit */
+#define DDC_CIC_ORDER	4
+#define DDC_CIC_MAX	2048
+#define DDC_CIC_SCALE	32768.0
+
+/* taps of the compensation FIR per output sample it decimates by */
+#define DDC_FIR_TAPS	32
+
+/* points of the frequency response the FIR is designed from */
+#define DDC_GRID	512
+
+struct rtlsdr_ddc {
+	uint32_t rate;
+	uint32_t decim;
+	uint32_t cic_decim, fir_decim;
+	double phase, step;	/* NCO, radians per I/Q pair */
+	uint64_t integ[DDC_CIC_ORDER][2];
+	uint64_t comb[DDC_CIC_ORDER][2];
+	uint32_t cic_count;
+	double cic_scale;
+	uint32_t fir_len;	/* taps */
+	uint32_t fir_count;
+	float *taps;		/* each twice, for I and Q */
+	float *fir_buf;		/* fir_len - 1 pairs of history + a block */
+	float mix[2 * DDC_BLOCK];
+};
+
+/* magnitude of the normalized CIC response, f in cycles per output sample
+ * of the CIC */
+static double ddc_cic_response(const rtlsdr_ddc_t *ddc, double f)
+{
+	double r = ddc->cic_decim, x = M_PI * f / r;
+
+	if (x < 1e-9)
+		return 1.0;
+
+	return pow(fabs(sin(x * r) / (r * sin(x))), DDC_CIC_ORDER);
+}
+
+/* windowed frequency sampling design of the FIR behind the CIC: inverse of
+ * the CIC droop up to 80% of the output bandwidth, rolling off towards the
+ * output Nyquist frequency, frequencies in cycles per input sample */
+static int ddc_design(rtlsdr_ddc_t *ddc)
+{
+	double pass = 0.4 / ddc->fir_decim, stop = 0.5 / ddc->fir_decim;
+	double c = (ddc->fir_len - 1) / 2.0, f, a, acc, w, sum = 0.0;
+	double *h;
+	uint32_t n, g;
+
+	h = calloc(ddc->fir_len, sizeof(double));
+	if (!h)
+		return -1;
+
+	for (n = 0; n < ddc->fir_len; n++) {
+		acc = 0.0;
+		for (g = 0; g < DDC_GRID; g++) {
+			f = (g + 0.5) * 0.5 / DDC_GRID;
+			if (f <= pass)
+				a = 1.0 / ddc_cic_response(ddc, f);
+			else if (f < stop)
+				a = (stop - f) / (stop - pass) /
+				    ddc_cic_response(ddc, pass);
+			else
+				break;
+			acc += a * cos(2.0 * M_PI * f * (n - c));
+		}
+
+		/* Blackman window */
+		w = 0.42 - 0.5 * cos(2.0 * M_PI * n / (ddc->fir_len - 1)) +
+		    0.08 * cos(4.0 * M_PI * n / (ddc->fir_len - 1));
+		h[n] = acc * w;
+		sum += h[n];
+	}
+
+	/* unity gain at DC, the taps are symmetric so no need to reverse */
+	for (n = 0; n < ddc->fir_len; n++)
+		ddc->taps[2 * n] = ddc->taps[2 * n + 1] = (float)(h[n] / sum);
+
+	free(h);
+
+	return 0;
+}
+
+rtlsdr_ddc_t *rtlsdr_ddc_create(uint32_t rate, int32_t offset, uint32_t decim)
+{
+	rtlsdr_ddc_t *ddc;
+
+	if (!rate || !decim || decim > 2 * DDC_CIC_MAX)
+		return NULL;
+
+	ddc = calloc(1, sizeof(rtlsdr_ddc_t));
+	if (!ddc)
+		return NULL;
+
+	ddc->rate = rate;
+	ddc->decim = decim;
+	if (rtlsdr_ddc_set_offset(ddc, offset) < 0)
+		goto err;
+
+	if (decim == 1)
+		return ddc;
+
+	/* the last factor of 2 is left to the FIR, which can then cut off
+	 * what the CIC would alias into the band, for a ratio of 2 the CIC
+	 * runs at a ratio of 1 and passes the mixed samples on unchanged */
+	ddc->fir_decim = (decim & 1) ? 1 : 2;
+	ddc->cic_decim = decim / ddc->fir_decim;
+	if (ddc->cic_decim > DDC_CIC_MAX)
+		goto err;
+
+	ddc->cic_scale = 1.0 / (DDC_CIC_SCALE *
+				pow(ddc->cic_decim, DDC_CIC_ORDER));
+
+	ddc->fir_len = DDC_FIR_TAPS * ddc->fir_decim - 1;
+	ddc->taps = calloc(2 * ddc->fir_len, sizeof(float));
+	ddc->fir_buf = calloc(2 * (ddc->fir_len - 1 + DDC_BLOCK),
+			      sizeof(float));
+	if (!ddc->taps || !ddc->fir_buf || ddc_design(ddc) < 0)
+		goto err;
+
+	return ddc;
+err:
+	rtlsdr_ddc_destroy(ddc);
+	return NULL;
+}
+
+void rtlsdr_ddc_destroy(rtlsdr_ddc_t *ddc)
+{
+	if (!ddc)
+		return;
+
+	free(ddc->taps);
+	free(ddc->fir_buf);
+	free(ddc);
+}
+
+int rtlsdr_ddc_set_offset(rtlsdr_ddc_t *ddc, int32_t offset)
+{
+	if (!ddc || 2 * llabs(offset) > (long long)ddc->rate)
+		return -1;
+
+	/* mix the offset down to zero, the phase carries on */
+	ddc->step = -2.0 * M_PI * offset / ddc->rate;
+
+	return 0;
+}
+
+void rtlsdr_ddc_reset(rtlsdr_ddc_t *ddc)
+{
+	if (!ddc)
+		return;
+
+	ddc->phase = 0.0;
+	memset(ddc->integ, 0, sizeof(ddc->integ));
+	memset(ddc->comb, 0, sizeof(ddc->comb));
+	ddc->cic_count = 0;
+	ddc->fir_count = 0;
+	if (ddc->fir_buf)
+		memset(ddc->fir_buf, 0,
+		       2 * (ddc->fir_len - 1) * sizeof(float));
+}
+
+/* integrate a block of mixed pairs, returns the pairs put out by the combs
+ * to the FIR buffer */
+static uint32_t ddc_cic(rtlsdr_ddc_t *ddc, const float *iq, uint32_t pairs,
+			float *out)
+{
+	uint64_t v, t;
+	uint32_t n, m = 0;
+	int c, k;
+
+	for (n = 0; n < pairs; n++) {
+		for (c = 0; c < 2; c++) {
+			v = (uint64_t)(int64_t)lrintf(iq[2 * n + c] *
+						      (float)DDC_CIC_SCALE);
+			for (k = 0; k < DDC_CIC_ORDER; k++)
+				v = ddc->integ[k][c] += v;
+		}
+
+		if (++ddc->cic_count < ddc->cic_decim)
+			continue;
+		ddc->cic_count = 0;
+
+		for (c = 0; c < 2; c++) {
+			v = ddc->integ[DDC_CIC_ORDER - 1][c];
+			for (k = 0; k < DDC_CIC_ORDER; k++) {
+				t = v - ddc->comb[k][c];
+				ddc->comb[k][c] = v;
+				v = t;
+			}
+			out[2 * m + c] = (float)((int64_t)v * ddc->cic_scale);
+		}
+		m++;
+	}
+
+	return m;
+}
+
+uint32_t rtlsdr_ddc_process(rtlsdr_ddc_t *ddc, const float *in, uint32_t len,
+			    float *out)
+{
+	uint32_t pairs = len / 2, hist, done, n, m, j, o = 0;
+	float *buf;
+
+	if (!ddc)
+		return 0;
+
+	pthread_once(&convert_once, convert_select);
+
+	hist = ddc->fir_len ? ddc->fir_len - 1 : 0;
+
+	for (done = 0; done < pairs; done += n) {
+		n = pairs - done < DDC_BLOCK ? pairs - done : DDC_BLOCK;
+
+		convert->mix(in + 2 * done, ddc->mix, n, ddc->phase, ddc->step);
+		ddc->phase = fmod(ddc->phase + n * ddc->step, 2.0 * M_PI);
+
+		if (ddc->decim == 1) {
+			memmove(out + 2 * o, ddc->mix, n * 2 * sizeof(float));
+			o += n;
+			continue;
+		}
+
+		buf = ddc->fir_buf;
+		m = ddc_cic(ddc, ddc->mix, n, buf + 2 * hist);
+
+		for (j = 0; j < m; j++) {
+			if (ddc->fir_count++ % ddc->fir_decim)
+				continue;
+			out[2 * o] = out[2 * o + 1] = 0.0f;
+			convert->dot(buf + 2 * j, ddc->taps, 2 * ddc->fir_len,
+				     out + 2 * o);
+			o++;
+		}
+		ddc->fir_count %= ddc->fir_decim;
+
+		memmove(buf, buf + 2 * m, 2 * hist * sizeof(float));
+	}
+
+	return 2 * o;
+}
+
+uint32_t rtlsdr_ddc_get_decimation(rtlsdr_ddc_t *ddc)
+{
+	return ddc ? ddc->decim : 0;
+}
+
+/* prototype filter taps per channel, and the limit of channels */
+#define PFB_TAPS	16
+#define PFB_MAX		4096
+
+/* blocks of input buffered at once */
+#define PFB_BLOCKS	64
+
+struct rtlsdr_pfb {
+	uint32_t channels;
+	uint32_t taps;		/* per branch */
+	float *coef;		/* a row of channels taps per block of history,
+				   each twice, for I and Q */
+	float *roots;		/* roots of unity */
+	float *buf;		/* taps - 1 blocks of history + input */
+	uint32_t fill;		/* pairs behind the history */
+};
+
+/* windowed sinc lowpass cutting off at half the channel spacing, row p
+ * holds the taps of the block p blocks back, in the order of its samples */
+static int pfb_design(rtlsdr_pfb_t *pfb)
+{
+	uint32_t m = pfb->channels, len = m * pfb->taps, i, p, r;
+	double c = (len - 1) / 2.0, x, w, sum = 0.0;
+	double *h;
+
+	h = calloc(len, sizeof(double));
+	if (!h)
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		x = M_PI * (i - c) / m;
+		w = 0.42 - 0.5 * cos(2.0 * M_PI * i / (len - 1)) +
+		    0.08 * cos(4.0 * M_PI * i / (len - 1));
+		h[i] = (fabs(x) < 1e-9 ? 1.0 : sin(x) / x) * w;
+		sum += h[i];
+	}
+
+	for (p = 0; p < pfb->taps; p++) {
+		for (r = 0; r < m; r++) {
+			i = 2 * (p * m + r);
+			pfb->coef[i] = pfb->coef[i + 1] =
+				(float)(h[p * m + m - 1 - r] / sum);
+		}
+	}
+
+	free(h);
+
+	return 0;
+}
+
+rtlsdr_pfb_t *rtlsdr_pfb_create(uint32_t channels, uint32_t taps)
+{
+	rtlsdr_pfb_t *pfb;
+	uint32_t k;
+
+	if (channels < 2 || channels > PFB_MAX)
+		return NULL;
+
+	pfb = calloc(1, sizeof(rtlsdr_pfb_t));
+	if (!pfb)
+		return NULL;
+
+	pfb->channels = channels;
+	pfb->taps = taps ? taps : PFB_TAPS;
+
+	pfb->coef = calloc(2 * (size_t)channels * pfb->taps, sizeof(float));
+	pfb->roots = calloc(2 * channels, sizeof(float));
+	pfb->buf = calloc(2 * (size_t)channels * (pfb->taps - 1 + PFB_BLOCKS),
+			  sizeof(float));
+	if (!pfb->coef || !pfb->roots || !pfb->buf || pfb_design(pfb) < 0) {
+		rtlsdr_pfb_destroy(pfb);
+		return NULL;
+	}
+
+	for (k = 0; k < channels; k++) {
+		pfb->roots[2 * k] = (float)cos(2.0 * M_PI * k / channels);
+		pfb->roots[2 * k + 1] = (float)sin(2.0 * M_PI * k / channels);
+	}
+
+	return pfb;
+}
+
+void rtlsdr_pfb_destroy(rtlsdr_pfb_t *pfb)
+{
+	if (!pfb)
+		return;
+
+	free(pfb->coef);
+	free(pfb->roots);
+	free(pfb->buf);
+	free(pfb);
+}
+
+uint32_t rtlsdr_pfb_process(rtlsdr_pfb_t *pfb, const float *in, uint32_t len,
+			    float *branches)
+{
+	uint32_t m, hist, pairs = len / 2, done, n, b, p, blocks = 0;
+	float *v;
+
+	if (!pfb)
+		return 0;
+
+	pthread_once(&convert_once, convert_select);
+
+	m = pfb->channels;
+	hist = (pfb->taps - 1) * m;
+
+	for (done = 0; done < pairs; done += n) {
+		n = PFB_BLOCKS * m - pfb->fill;
+		if (n > pairs - done)
+			n = pairs - done;
+		memcpy(pfb->buf + 2 * (hist + pfb->fill), in + 2 * done,
+		       n * 2 * sizeof(float));
+		pfb->fill += n;
+
+		/* every branch sums the samples of its phase over the
+		 * history, a block of them at once */
+		for (b = 0; (b + 1) * m <= pfb->fill; b++, blocks++) {
+			v = branches + 2 * (size_t)m * blocks;
+			memset(v, 0, 2 * m * sizeof(float));
+			for (p = 0; p < pfb->taps; p++)
+				convert->macc(pfb->buf + 2 * (hist + b * m - p * m),
+					      pfb->coef + 2 * p * m, 2 * m, v);
+		}
+
+		memmove(pfb->buf, pfb->buf + 2 * b * m,
+			2 * (hist + pfb->fill - b * m) * sizeof(float));
+		pfb->fill -= b * m;
+	}
+
+	return blocks;
+}
+
+int rtlsdr_pfb_channel_weights(rtlsdr_pfb_t *pfb, int32_t channel,
+			       float *weights)
+{
+	uint32_t m, c, r;
+
+	if (!pfb)
+		return -1;
+
+	m = pfb->channels;
+	if (channel <= -(int32_t)m || channel >= (int32_t)m)
+		return -1;
+	c = (uint32_t)(channel + (int32_t)m) % m;
+
+	/* the DFT bin of the channel, branches are in sample order */
+	for (r = 0; r < m; r++) {
+		memcpy(weights + 2 * r,
+		       pfb->roots + 2 * ((c * (m - 1 - r)) % m),
+		       2 * sizeof(float));
+	}
+
+	return 0;
+}
+
+void rtlsdr_pfb_extract_weights(rtlsdr_pfb_t *pfb, const float *branches,
+				uint32_t blocks, const float *weights,
+				float *out)
+{
+	uint32_t m, b;
+
+	if (!pfb)
+		return;
+
+	pthread_once(&convert_once, convert_select);
+
+	m = pfb->channels;
+	for (b = 0; b < blocks; b++) {
+		out[2 * b] = out[2 * b + 1] = 0.0f;
+		convert->cdot(branches + 2 * (size_t)m * b, weights, m,
+			      out + 2 * b);
+	}
+}
+
+int rtlsdr_pfb_extract(rtlsdr_pfb_t *pfb, const float *branches,
+		       uint32_t blocks, int32_t channel, float *out)
+{
+	float *w;
+
+	if (!pfb)
+		return -1;
+
+	w = malloc(2 * pfb->channels * sizeof(float));
+	if (!w)
+		return -ENOMEM;
+
+	if (rtlsdr_pfb_channel_weights(pfb, channel, w) < 0) {
+		free(w);
+		return -1;
+	}
+
+	rtlsdr_pfb_extract_weights(pfb, branches, blocks, w, out);
+	free(w);
+
+	return 0;
+}
+
+uint32_t rtlsdr_pfb_get_channels(rtlsdr_pfb_t *pfb)
+{
+	return pfb ? pfb->channels : 0;
+}
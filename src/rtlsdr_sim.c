@@ -0,0 +1,654 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * Simulated RTL2832U with an R820T tuner, a transport that models the
+ * register files of the demodulator and the tuner and produces IQ samples
+ * from a signal generator or a file, paced to the programmed sample rate.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#include <pthread.h>
+#include <libusb.h>
+
+#include "rtlsdr_transport.h"
+
+#define SIM_XTAL		28800000
+#define SIM_DEF_RATE		2048000
+#define SIM_BLOCKS		7	/* DEMODB to IICB */
+#define SIM_BLOCK_LEN		0x10000
+#define SIM_USBB		1
+#define SIM_IICB		6
+#define SIM_USB_EPA_CTL		0x2148
+#define SIM_DEMOD_PAGES		16
+#define SIM_TUNER_ADDR		0x34	/* R820T */
+#define SIM_TUNER_REGS		32
+#define SIM_MAX_XFERS		64
+#define SIM_NCO_LEN		1024
+#define SIM_NCO_SHIFT		22	/* 32 bit phase to table index */
+#define SIM_MAX_LAG_NS		100000000ULL
+
+struct rtlsdr_sim {
+	/* register files */
+	uint8_t *usb; /* SIM_BLOCKS blocks of SIM_BLOCK_LEN */
+	uint8_t demod[SIM_DEMOD_PAGES][256];
+	uint8_t tuner[SIM_TUNER_REGS];
+	uint8_t tuner_ptr;
+	char serial[256];
+	/* signal source */
+	int tone; /* Hz off the center frequency */
+	int amp;
+	int noise;
+	FILE *file;
+	int loop; /* rewind at the end of the file, or end the stream */
+	int ended;
+	int8_t nco[SIM_NCO_LEN];
+	uint32_t phase;
+	uint32_t lcg;
+	/* sample clock, time the samples delivered so far were received */
+	int pace;
+	uint64_t clk_ns;
+	/* submitted transfers, completed in order from handle_events() */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct libusb_transfer *queue[SIM_MAX_XFERS];
+	int canceled[SIM_MAX_XFERS];
+	int queue_num;
+	int interrupted;
+};
+
+static uint64_t sim_now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER cnt, freq;
+
+	QueryPerformanceCounter(&cnt);
+	QueryPerformanceFrequency(&freq);
+
+	return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000000ULL +
+	       (uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000000ULL /
+	       freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void sim_abstime(struct timespec *ts, uint64_t wait_ns)
+{
+#ifdef _WIN32
+	timespec_get(ts, TIME_UTC);
+#else
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	ts->tv_sec = now.tv_sec;
+	ts->tv_nsec = now.tv_usec * 1000;
+#endif
+	ts->tv_sec += wait_ns / 1000000000ULL;
+	ts->tv_nsec += wait_ns % 1000000000ULL;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static void sim_sleep_ns(uint64_t ns)
+{
+#ifdef _WIN32
+	Sleep((DWORD)(ns / 1000000));
+#else
+	usleep(ns / 1000);
+#endif
+}
+
+/* sample rate programmed into the resampler, see rtlsdr_set_sample_rate() */
+static uint32_t sim_rate(struct rtlsdr_sim *sim)
+{
+	const uint8_t *p = &sim->demod[1][0x9f];
+	uint32_t ratio;
+
+	ratio = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | p[3];
+	ratio |= (ratio & 0x08000000) << 1;
+
+	if (!ratio)
+		return SIM_DEF_RATE;
+
+	return (uint32_t)((double)SIM_XTAL * (1 << 22) / ratio);
+}
+
+/* completion time of the next len bytes, call with the lock held */
+static uint64_t sim_due(struct rtlsdr_sim *sim, int len, uint64_t now)
+{
+	uint64_t period;
+
+	if (!sim->pace)
+		return now;
+
+	period = (uint64_t)(len / 2) * 1000000000ULL / sim_rate(sim);
+
+	/* don't burst to catch up after the stream was idle */
+	if (sim->clk_ns + period + SIM_MAX_LAG_NS < now)
+		sim->clk_ns = now;
+
+	return sim->clk_ns + period;
+}
+
+static int sim_noise(struct rtlsdr_sim *sim)
+{
+	sim->lcg = sim->lcg * 1664525 + 1013904223;
+
+	return (int)((sim->lcg >> 16) % (2 * sim->noise + 1)) - sim->noise;
+}
+
+static uint8_t sim_clamp(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* returns the number of bytes filled, short only at the end of a file */
+static int sim_fill(struct rtlsdr_sim *sim, unsigned char *buf, int len)
+{
+	uint32_t step, idx;
+	int i, n;
+
+	if (sim->file) {
+		for (i = 0; i < len; i += n) {
+			n = (int)fread(buf + i, 1, len - i, sim->file);
+			if (n > 0)
+				continue;
+
+			if (!sim->loop) {
+				if (!sim->ended)
+					fprintf(stderr, "Replay finished\n");
+				sim->ended = 1;
+				return i;
+			}
+
+			/* loop, an empty file reads as silence */
+			rewind(sim->file);
+			n = (int)fread(buf + i, 1, len - i, sim->file);
+			if (n <= 0) {
+				memset(buf + i, 127, len - i);
+				break;
+			}
+		}
+		return len;
+	}
+
+	step = (uint32_t)(int64_t)((double)sim->tone * 4294967296.0 /
+				   sim_rate(sim));
+
+	for (i = 0; i + 1 < len; i += 2) {
+		idx = sim->phase >> SIM_NCO_SHIFT;
+		buf[i] = sim_clamp(127 + sim->nco[idx] * sim->amp / 127 +
+				   sim_noise(sim));
+		idx = (idx - SIM_NCO_LEN / 4) & (SIM_NCO_LEN - 1);
+		buf[i + 1] = sim_clamp(127 + sim->nco[idx] * sim->amp / 127 +
+				       sim_noise(sim));
+		sim->phase += step;
+	}
+
+	return len;
+}
+
+static uint8_t sim_bitrev(uint8_t byte)
+{
+	const uint8_t lut[16] = { 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+				  0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf };
+
+	return (lut[byte & 0xf] << 4) | lut[byte >> 4];
+}
+
+/* the R820T status registers report a locked PLL and a valid filter
+ * calibration, the others read back what was written */
+static uint8_t sim_tuner_reg(struct rtlsdr_sim *sim, int reg)
+{
+	switch (reg) {
+	case 0:
+		return sim_bitrev(0x69); /* chip id, R82XX_CHECK_VAL */
+	case 2:
+		return 0x40; /* PLL locked */
+	case 4:
+		return 0x28; /* VCO fine tune 2, filter cal code 8 */
+	default:
+		return sim->tuner[reg];
+	}
+}
+
+static int sim_i2c(struct rtlsdr_sim *sim, uint16_t addr, int in,
+		   unsigned char *data, uint16_t len)
+{
+	int i;
+
+	/* there is only the tuner, and only behind the I2C repeater */
+	if (addr != SIM_TUNER_ADDR || !(sim->demod[1][0x01] & 0x08))
+		return LIBUSB_ERROR_PIPE;
+
+	if (in) {
+		/* the R820T sends its registers bit reversed */
+		for (i = 0; i < len; i++)
+			data[i] = sim_bitrev(sim_tuner_reg(sim,
+				(sim->tuner_ptr + i) % SIM_TUNER_REGS));
+	} else if (len) {
+		sim->tuner_ptr = data[0] % SIM_TUNER_REGS;
+		for (i = 1; i < len; i++)
+			sim->tuner[(sim->tuner_ptr + i - 1) % SIM_TUNER_REGS] =
+				data[i];
+	}
+
+	return len;
+}
+
+static int sim_control(void *priv, uint8_t request_type, uint8_t request,
+		       uint16_t value, uint16_t index, unsigned char *data,
+		       uint16_t len, unsigned int timeout)
+{
+	struct rtlsdr_sim *sim = priv;
+	int in = request_type & LIBUSB_ENDPOINT_IN;
+	uint8_t block = index >> 8;
+	uint8_t *reg;
+
+	if (block == SIM_IICB)
+		return sim_i2c(sim, value, in, data, len);
+
+	if (block == 0) {
+		/* demod page access, the address is in the upper byte */
+		if ((value >> 8) + len > 256)
+			return LIBUSB_ERROR_PIPE;
+
+		reg = &sim->demod[index & 0x0f][value >> 8];
+	} else if (block < SIM_BLOCKS) {
+		if (value + len > SIM_BLOCK_LEN)
+			return LIBUSB_ERROR_PIPE;
+
+		reg = sim->usb + block * SIM_BLOCK_LEN + value;
+	} else {
+		return LIBUSB_ERROR_PIPE;
+	}
+
+	if (in) {
+		memcpy(data, reg, len);
+	} else {
+		memcpy(reg, data, len);
+
+		/* flushing the endpoint restarts the sample clock */
+		if (block == SIM_USBB && value == SIM_USB_EPA_CTL) {
+			pthread_mutex_lock(&sim->lock);
+			sim->clk_ns = sim_now_ns();
+			pthread_mutex_unlock(&sim->lock);
+		}
+	}
+
+	return len;
+}
+
+static int sim_write_batch(void *priv, const rtlsdr_ctrl_write_t *writes,
+			   int num, unsigned int timeout)
+{
+	unsigned char scratch[RTLSDR_CTRL_WRITE_MAX];
+	int i, r, err = 0;
+
+	for (i = 0; i < num; i++) {
+		if (writes[i].in)
+			r = sim_control(priv, LIBUSB_REQUEST_TYPE_VENDOR |
+					LIBUSB_ENDPOINT_IN, 0, writes[i].value,
+					writes[i].index, scratch, writes[i].len,
+					timeout);
+		else
+			r = sim_control(priv, LIBUSB_REQUEST_TYPE_VENDOR |
+					LIBUSB_ENDPOINT_OUT, 0, writes[i].value,
+					writes[i].index,
+					(unsigned char *)writes[i].data,
+					writes[i].len, timeout);
+		if (r < 0 && !err)
+			err = r;
+	}
+
+	return err;
+}
+
+static int sim_bulk(void *priv, unsigned char endpoint, unsigned char *data,
+		    int len, int *actual_len, unsigned int timeout)
+{
+	struct rtlsdr_sim *sim = priv;
+	uint64_t now, due;
+
+	now = sim_now_ns();
+
+	pthread_mutex_lock(&sim->lock);
+	due = sim_due(sim, len, now);
+	sim->clk_ns = due;
+	pthread_mutex_unlock(&sim->lock);
+
+	if (due > now)
+		sim_sleep_ns(due - now);
+
+	/* a replayed file ends like a device that was unplugged after
+	 * the last sample */
+	len = sim_fill(sim, data, len);
+	if (actual_len)
+		*actual_len = len;
+
+	return len ? 0 : LIBUSB_ERROR_NO_DEVICE;
+}
+
+static int sim_submit(void *priv, struct libusb_transfer *xfer)
+{
+	struct rtlsdr_sim *sim = priv;
+	int r = 0;
+
+	pthread_mutex_lock(&sim->lock);
+	if (sim->queue_num < SIM_MAX_XFERS) {
+		sim->canceled[sim->queue_num] = 0;
+		sim->queue[sim->queue_num++] = xfer;
+		pthread_cond_signal(&sim->cond);
+	} else {
+		r = LIBUSB_ERROR_BUSY;
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	return r;
+}
+
+static int sim_cancel(void *priv, struct libusb_transfer *xfer)
+{
+	struct rtlsdr_sim *sim = priv;
+	int i, r = LIBUSB_ERROR_NOT_FOUND;
+
+	pthread_mutex_lock(&sim->lock);
+	for (i = 0; i < sim->queue_num; i++) {
+		if (sim->queue[i] == xfer && !sim->canceled[i]) {
+			sim->canceled[i] = 1;
+			pthread_cond_signal(&sim->cond);
+			r = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sim->lock);
+
+	return r;
+}
+
+/* complete at most one transfer, canceled ones first, then the oldest
+ * once its samples are due */
+static int sim_handle_events(void *priv, struct timeval *tv, int *completed)
+{
+	struct rtlsdr_sim *sim = priv;
+	struct libusb_transfer *xfer = NULL;
+	struct timespec ts;
+	uint64_t now, deadline, wake, due = 0;
+	int i, canceled = 0;
+
+	now = sim_now_ns();
+	deadline = now + (uint64_t)tv->tv_sec * 1000000000ULL +
+		   (uint64_t)tv->tv_usec * 1000;
+
+	pthread_mutex_lock(&sim->lock);
+	while (!completed || !*completed) {
+		for (i = 0; i < sim->queue_num && !sim->canceled[i]; i++);
+
+		if (i < sim->queue_num) {
+			canceled = 1;
+		} else if (sim->queue_num) {
+			due = sim_due(sim, sim->queue[0]->length, now);
+			if (due <= now)
+				i = 0;
+		}
+
+		if (i < sim->queue_num) {
+			xfer = sim->queue[i];
+			sim->queue_num--;
+			memmove(&sim->queue[i], &sim->queue[i + 1],
+				(sim->queue_num - i) * sizeof(sim->queue[0]));
+			memmove(&sim->canceled[i], &sim->canceled[i + 1],
+				(sim->queue_num - i) * sizeof(sim->canceled[0]));
+			if (!canceled)
+				sim->clk_ns = due;
+			break;
+		}
+
+		if (sim->interrupted || now >= deadline)
+			break;
+
+		wake = deadline;
+		if (sim->queue_num && due < wake)
+			wake = due;
+
+		sim_abstime(&ts, wake - now);
+		pthread_cond_timedwait(&sim->cond, &sim->lock, &ts);
+		now = sim_now_ns();
+	}
+	sim->interrupted = 0;
+	pthread_mutex_unlock(&sim->lock);
+
+	if (!xfer)
+		return 0;
+
+	if (canceled) {
+		xfer->status = LIBUSB_TRANSFER_CANCELLED;
+		xfer->actual_length = 0;
+	} else {
+		xfer->actual_length = sim_fill(sim, xfer->buffer,
+					       xfer->length);
+		xfer->status = xfer->actual_length ?
+			       LIBUSB_TRANSFER_COMPLETED :
+			       LIBUSB_TRANSFER_NO_DEVICE;
+	}
+
+	xfer->callback(xfer);
+
+	return 0;
+}
+
+static void sim_interrupt(void *priv)
+{
+	struct rtlsdr_sim *sim = priv;
+
+	pthread_mutex_lock(&sim->lock);
+	sim->interrupted = 1;
+	pthread_cond_signal(&sim->cond);
+	pthread_mutex_unlock(&sim->lock);
+}
+
+static int sim_get_strings(void *priv, char *manufact, char *product,
+			   char *serial)
+{
+	struct rtlsdr_sim *sim = priv;
+	const int buf_max = 256;
+
+	if (manufact) {
+		memset(manufact, 0, buf_max);
+		strcpy(manufact, "Realtek");
+	}
+
+	if (product) {
+		memset(product, 0, buf_max);
+		strcpy(product, "RTL2838UHIDIR");
+	}
+
+	if (serial)
+		memcpy(serial, sim->serial, buf_max);
+
+	return 0;
+}
+
+static void sim_close(void *priv)
+{
+	struct rtlsdr_sim *sim = priv;
+
+	if (sim->file)
+		fclose(sim->file);
+
+	pthread_cond_destroy(&sim->cond);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim->usb);
+	free(sim);
+}
+
+const rtlsdr_transport_t rtlsdr_sim_transport = {
+	sim_control,
+	sim_write_batch,
+	sim_bulk,
+	sim_submit,
+	sim_cancel,
+	sim_handle_events,
+	sim_interrupt,
+	sim_get_strings,
+	sim_close,
+};
+
+/* cosine table, built by rotating a unit vector to get by without libm */
+static void sim_init_nco(struct rtlsdr_sim *sim)
+{
+	const double w = 2 * 3.14159265358979323846 / SIM_NCO_LEN;
+	const double c = 1 - w * w / 2 + w * w * w * w / 24;
+	const double s = w - w * w * w / 6 + w * w * w * w * w / 120;
+	double x = 1, y = 0, t;
+	int i;
+
+	for (i = 0; i < SIM_NCO_LEN; i++) {
+		sim->nco[i] = (int8_t)(x * 127 + (x < 0 ? -0.5 : 0.5));
+		t = x * c - y * s;
+		y = x * s + y * c;
+		x = t;
+	}
+}
+
+static struct rtlsdr_sim *sim_alloc(void)
+{
+	struct rtlsdr_sim *sim;
+
+	sim = calloc(1, sizeof(struct rtlsdr_sim));
+	if (!sim)
+		return NULL;
+
+	sim->usb = calloc(SIM_BLOCKS, SIM_BLOCK_LEN);
+	if (!sim->usb) {
+		free(sim);
+		return NULL;
+	}
+
+	sim->tone = 100000;
+	sim->amp = 64;
+	sim->noise = 4;
+	sim->pace = 1;
+	sim->lcg = 1;
+	strcpy(sim->serial, "SIM00001");
+	sim_init_nco(sim);
+
+	pthread_mutex_init(&sim->lock, NULL);
+	pthread_cond_init(&sim->cond, NULL);
+
+	return sim;
+}
+
+/* options: tone=<Hz>,amp=<0-127>,noise=<0-127>,file=<path>,pace=<0|1>,
+ * serial=<string> */
+void *rtlsdr_sim_create(const char *args)
+{
+	struct rtlsdr_sim *sim;
+	char *opts = NULL, *tok, *val, *next;
+
+	sim = sim_alloc();
+	if (!sim)
+		return NULL;
+
+	if (args) {
+		opts = strdup(args);
+		if (!opts)
+			goto err;
+	}
+
+	for (tok = opts; tok && *tok; tok = next) {
+		next = strchr(tok, ',');
+		if (next)
+			*next++ = '\0';
+
+		val = strchr(tok, '=');
+		if (val)
+			*val++ = '\0';
+		else
+			val = "";
+
+		if (!strcmp(tok, "tone")) {
+			sim->tone = atoi(val);
+		} else if (!strcmp(tok, "amp")) {
+			sim->amp = atoi(val) & 0x7f;
+		} else if (!strcmp(tok, "noise")) {
+			sim->noise = atoi(val) & 0x7f;
+		} else if (!strcmp(tok, "pace")) {
+			sim->pace = atoi(val) != 0;
+		} else if (!strcmp(tok, "serial")) {
+			strncpy(sim->serial, val, sizeof(sim->serial) - 1);
+		} else if (!strcmp(tok, "file")) {
+			sim->file = fopen(val, "rb");
+			sim->loop = 1;
+			if (!sim->file) {
+				fprintf(stderr, "Failed to open %s\n", val);
+				goto err;
+			}
+		} else {
+			fprintf(stderr, "Unknown simulator option %s\n", tok);
+			goto err;
+		}
+	}
+
+	free(opts);
+
+	return sim;
+err:
+	free(opts);
+	sim_close(sim);
+
+	return NULL;
+}
+
+/* replay a capture once, the stream ends with the file */
+void *rtlsdr_sim_create_file(const char *path, int pace)
+{
+	struct rtlsdr_sim *sim;
+
+	sim = sim_alloc();
+	if (!sim)
+		return NULL;
+
+	sim->file = fopen(path, "rb");
+	if (!sim->file) {
+		sim_close(sim);
+		return NULL;
+	}
+
+	sim->pace = pace;
+	snprintf(sim->serial, sizeof(sim->serial), "file:%s", path);
+
+	return sim;
+}
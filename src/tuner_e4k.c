@@ -771,6 +771,39 @@ int e4k_mixer_gain_set(struct e4k_state *e4k, int8_t value)
 	return e4k_reg_set_mask(e4k, E4K_REG_GAIN2, 1, bit);
 }
 
+/*! \brief Compute the register image of an LNA and mixer gain setting
+ *  \param [img] image to fill, nothing is written to the tuner
+ *  \param [lna_gain] LNA gain in tenths of a dB, as for e4k_set_lna_gain()
+ *  \param [mixer_gain] mixer gain in dB, 4 or 12
+ *  \returns 0 on success, negative in case of error
+ */
+int e4k_gain_image(struct tuner_reg_image *img, int32_t lna_gain,
+		   int8_t mixer_gain)
+{
+	uint32_t i;
+
+	if (mixer_gain != 4 && mixer_gain != 12)
+		return -EINVAL;
+
+	for (i = 0; i < ARRAY_SIZE(lnagain)/2; ++i) {
+		if (lnagain[i*2] == lna_gain)
+			break;
+	}
+	if (i == ARRAY_SIZE(lnagain)/2)
+		return -EINVAL;
+
+	img->i2c_addr = E4K_I2C_ADDR;
+	img->num = 2;
+	img->reg[0] = E4K_REG_GAIN1;
+	img->val[0] = lnagain[i*2+1];
+	img->mask[0] = 0xf;
+	img->reg[1] = E4K_REG_GAIN2;
+	img->val[1] = (mixer_gain == 12);
+	img->mask[1] = 1;
+
+	return 0;
+}
+
 int e4k_commonmode_set(struct e4k_state *e4k, int8_t value)
 {
 	if(value < 0)
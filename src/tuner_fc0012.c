@@ -311,23 +311,39 @@ exit:
 	return ret;
 }
 
+int fc0012_gain_image(struct tuner_reg_image *img, int gain)
+{
+	uint8_t val;
+
+	if (gain < -40) val = 0x02;      /* -9.9 dB */
+	else if (gain < 71) val = 0x00;  /* -4.0 dB */
+	else if (gain < 179) val = 0x08; /*  7.1 dB */
+	else if (gain < 192) val = 0x17; /* 17.9 dB */
+	else val = 0x10;	             /* 19.2 dB */
+
+	img->i2c_addr = FC0012_I2C_ADDR;
+	img->num = 1;
+	img->reg[0] = 0x13;
+	img->val[0] = val;
+	img->mask[0] = 0x1f;
+
+	return 0;
+}
+
 int fc0012_set_gain(void *dev, int gain)
 {
+	struct tuner_reg_image img;
 	int ret;
 	uint8_t tmp = 0;
 
-	ret = fc0012_readreg(dev, 0x13, &tmp);
+	fc0012_gain_image(&img, gain);
 
-	/* mask bits off */
-	tmp &= 0xe0;
+	ret = fc0012_readreg(dev, img.reg[0], &tmp);
 
-	if (gain < -40) tmp |= 0x02;      /* -9.9 dB */
-	else if (gain < 71) tmp |= 0x00;  /* -4.0 dB */
-	else if (gain < 179) tmp |= 0x08; /*  7.1 dB */
-	else if (gain < 192) tmp |= 0x17; /* 17.9 dB */
-	else tmp |= 0x10;	              /* 19.2 dB */
+	/* mask bits off */
+	tmp = (tmp & ~img.mask[0]) | img.val[0];
 
-	ret = fc0012_writereg(dev, 0x13, tmp);
+	ret = fc0012_writereg(dev, img.reg[0], tmp);
 
 	return ret;
 }
@@ -475,26 +475,39 @@ int fc0013_lna_gains[] ={
 
 #define GAIN_CNT	(sizeof(fc0013_lna_gains) / sizeof(int) / 2)
 
+int fc0013_lna_gain_image(struct tuner_reg_image *img, int gain)
+{
+	unsigned int i;
+
+	for (i = 0; i < GAIN_CNT; i++) {
+		if ((fc0013_lna_gains[i*2] >= gain) || (i+1 == GAIN_CNT))
+			break;
+	}
+
+	img->i2c_addr = FC0013_I2C_ADDR;
+	img->num = 1;
+	img->reg[0] = 0x14;
+	img->val[0] = fc0013_lna_gains[i*2 + 1];
+	img->mask[0] = 0x1f;
+
+	return 0;
+}
+
 int fc0013_set_lna_gain(void *dev, int gain)
 {
+	struct tuner_reg_image img;
 	int ret = 0;
-	unsigned int i;
 	uint8_t tmp = 0;
 
-	ret |= fc0013_readreg(dev, 0x14, &tmp);
+	fc0013_lna_gain_image(&img, gain);
 
-	/* mask bits off */
-	tmp &= 0xe0;
+	ret |= fc0013_readreg(dev, img.reg[0], &tmp);
 
-	for (i = 0; i < GAIN_CNT; i++) {
-		if ((fc0013_lna_gains[i*2] >= gain) || (i+1 == GAIN_CNT)) {
-			tmp |= fc0013_lna_gains[i*2 + 1];
-			break;
-		}
-	}
+	/* mask bits off */
+	tmp = (tmp & ~img.mask[0]) | img.val[0];
 
 	/* set gain */
-	ret |= fc0013_writereg(dev, 0x14, tmp);
+	ret |= fc0013_writereg(dev, img.reg[0], tmp);
 
 	return ret;
 }
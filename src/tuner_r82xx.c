@@ -384,12 +384,9 @@ static int r82xx_read(struct r82xx_priv *priv, uint8_t reg, uint8_t *val, int le
  * r82xx tuning logic
  */
 
-static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
+static const struct r82xx_freq_range *r82xx_get_range(uint32_t freq)
 {
-	const struct r82xx_freq_range *range;
-	int rc;
 	unsigned int i;
-	uint8_t val;
 
 	/* Get the proper frequency range */
 	freq = freq / 1000000;
@@ -397,7 +394,31 @@ static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 		if (freq < freq_ranges[i + 1].freq)
 			break;
 	}
-	range = &freq_ranges[i];
+
+	return &freq_ranges[i];
+}
+
+static uint8_t r82xx_get_xtal_cap(struct r82xx_priv *priv,
+				  const struct r82xx_freq_range *range)
+{
+	switch (priv->xtal_cap_sel) {
+	case XTAL_LOW_CAP_30P:
+	case XTAL_LOW_CAP_20P:
+		return range->xtal_cap20p | 0x08;
+	case XTAL_LOW_CAP_10P:
+		return range->xtal_cap10p | 0x08;
+	case XTAL_HIGH_CAP_0P:
+		return range->xtal_cap0p | 0x00;
+	default:
+	case XTAL_LOW_CAP_0P:
+		return range->xtal_cap0p | 0x08;
+	}
+}
+
+static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
+{
+	const struct r82xx_freq_range *range = r82xx_get_range(freq);
+	int rc;
 
 	/* Open Drain */
 	rc = r82xx_write_reg_mask(priv, 0x17, range->open_d, 0x08);
@@ -415,23 +436,7 @@ static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 		return rc;
 
 	/* XTAL CAP & Drive */
-	switch (priv->xtal_cap_sel) {
-	case XTAL_LOW_CAP_30P:
-	case XTAL_LOW_CAP_20P:
-		val = range->xtal_cap20p | 0x08;
-		break;
-	case XTAL_LOW_CAP_10P:
-		val = range->xtal_cap10p | 0x08;
-		break;
-	case XTAL_HIGH_CAP_0P:
-		val = range->xtal_cap0p | 0x00;
-		break;
-	default:
-	case XTAL_LOW_CAP_0P:
-		val = range->xtal_cap0p | 0x08;
-		break;
-	}
-	rc = r82xx_write_reg_mask(priv, 0x10, val, 0x0b);
+	rc = r82xx_write_reg_mask(priv, 0x10, r82xx_get_xtal_cap(priv, range), 0x0b);
 	if (rc < 0)
 		return rc;
 
@@ -449,10 +454,16 @@ static inline uint8_t mask_reg8(uint8_t reg, uint8_t val, uint8_t mask)
 	return (reg & ~mask) | (val & mask);
 }
 
-static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
+/* bits of regs 0x10 to 0x16 set by r82xx_calc_pll() */
+static const uint8_t r82xx_pll_mask[7] = { 0xf0, 0x00, 0xe8, 0x00, 0xff, 0xff, 0xff };
+
+/*
+ * Compute the PLL registers 0x10 to 0x16 for an LO frequency into regs,
+ * vco_fine_tune is bits 5:4 of register 0x04 as read from the tuner.
+ */
+static int r82xx_calc_pll(struct r82xx_priv *priv, uint32_t freq,
+			  uint8_t vco_fine_tune, uint8_t *regs)
 {
-	int rc, i;
-	unsigned sleep_time = 10000;
 	uint64_t vco_freq;
 	uint64_t vco_div;
 	uint32_t vco_min = 1770000; /* kHz */
@@ -464,22 +475,12 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 	uint8_t div_num = 0;
 	uint8_t vco_power_ref = 2;
 	uint8_t refdiv2 = 0;
-	uint8_t ni, si, nint, vco_fine_tune, val;
-	uint8_t data[5];
-	uint8_t regs[7];
+	uint8_t ni, si, nint, val;
 
 	/* Frequency in kHz */
 	freq_khz = (freq + 500) / 1000;
 	pll_ref = priv->cfg->xtal;
 
-	/* set pll autotune = 128kHz */
-	rc = r82xx_write_reg_mask(priv, 0x1a, 0x00, 0x0c);
-	if (rc < 0)
-		return rc;
-
-	/* regs 0x10 to 0x16 */
-	memcpy(regs, &priv->regs[0x10 - REG_SHADOW_START], 7);
-
 	regs[0] = mask_reg8(regs[0], refdiv2, 0x10);
 
 	/* set VCO current = 100 */
@@ -499,15 +500,9 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 		mix_div = mix_div << 1;
 	}
 
-	rc = r82xx_read(priv, 0x00, data, sizeof(data));
-	if (rc < 0)
-		return rc;
-
 	if (priv->cfg->rafael_chip == CHIP_R828D)
 		vco_power_ref = 1;
 
-	vco_fine_tune = (data[4] & 0x30) >> 4;
-
 	if (vco_fine_tune > vco_power_ref)
 		div_num = div_num - 1;
 	else if (vco_fine_tune < vco_power_ref)
@@ -556,36 +551,85 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 	regs[5] = sdm & 0xff;
 	regs[6] = sdm >> 8;
 
-	rc = r82xx_write(priv, 0x10, regs, 7);
-	if (rc < 0)
-		return rc;
+	return 0;
+}
+
+/*
+ * Poll the PLL lock bit until it is set or the lock timeout has passed,
+ * checking at least twice. If the first check fails the VCO current is
+ * increased. The time taken is stored in lock_ns.
+ */
+static int r82xx_wait_lock(struct r82xx_priv *priv)
+{
+	int rc, i;
+	uint64_t start, elapsed;
+	uint8_t data[3];
 
-	for (i = 0; i < 2; i++) {
-//		usleep_range(sleep_time, sleep_time + 1000);
+	start = rtlsdr_get_time_ns();
 
+	for (i = 0; ; i++) {
 		/* Check if PLL has locked */
-		rc = r82xx_read(priv, 0x00, data, 3);
+		rc = r82xx_read(priv, 0x00, data, sizeof(data));
 		if (rc < 0)
 			return rc;
 		if (data[2] & 0x40)
 			break;
 
+		elapsed = rtlsdr_get_time_ns() - start;
+		if (i && elapsed >= (uint64_t)priv->lock_timeout_us * 1000)
+			break;
+
 		if (!i) {
 			/* Didn't lock. Increase VCO current */
 			rc = r82xx_write_reg_mask(priv, 0x12, 0x60, 0xe0);
 			if (rc < 0)
 				return rc;
+		} else if (priv->lock_poll_us) {
+			rtlsdr_sleep_us(priv->lock_poll_us);
 		}
 	}
 
-	if (!(data[2] & 0x40)) {
+	priv->lock_ns = rtlsdr_get_time_ns() - start;
+	priv->has_lock = (data[2] & 0x40) ? 1 : 0;
+
+	return 0;
+}
+
+static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
+{
+	int rc;
+	uint8_t data[5];
+	uint8_t regs[7];
+
+	/* set pll autotune = 128kHz */
+	rc = r82xx_write_reg_mask(priv, 0x1a, 0x00, 0x0c);
+	if (rc < 0)
+		return rc;
+
+	rc = r82xx_read(priv, 0x00, data, sizeof(data));
+	if (rc < 0)
+		return rc;
+
+	/* regs 0x10 to 0x16 */
+	memcpy(regs, &priv->regs[0x10 - REG_SHADOW_START], 7);
+
+	rc = r82xx_calc_pll(priv, freq, (data[4] & 0x30) >> 4, regs);
+	if (rc < 0)
+		return rc;
+
+	rc = r82xx_write(priv, 0x10, regs, 7);
+	if (rc < 0)
+		return rc;
+
+	rc = r82xx_wait_lock(priv);
+	if (rc < 0)
+		return rc;
+
+	if (!priv->has_lock) {
 		fprintf(stderr, "[R82XX] PLL not locked!\n");
-		priv->has_lock = 0;
 		return 0;
 	}
 
-	priv->has_lock = 1;
-
 	/* set pll autotune = 8kHz */
 	rc = r82xx_write_reg_mask(priv, 0x1a, 0x08, 0x08);
 
@@ -1121,51 +1165,53 @@ int r82xx_set_bandwidth(struct r82xx_priv *priv, int bw, uint32_t rate)
 #undef FILT_HP_BW1
 #undef FILT_HP_BW2
 
-int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
+/* notch filter setting of reg 0x17, off when tuned within a notch band */
+static uint8_t r82xx_get_notch(struct r82xx_priv *priv, uint32_t freq)
 {
-	int rc = -1;
-	int is_rtlsdr_blog_v4;
-	uint32_t upconvert_freq;
-	uint32_t lo_freq;
-	uint8_t air_cable1_in;
-	uint8_t open_d;
-	uint8_t band;
-	uint8_t cable_2_in;
-	uint8_t cable_1_in;
-	uint8_t air_in;
-
-	is_rtlsdr_blog_v4 = rtlsdr_check_dongle_model(priv->rtl_dev, "RTLSDRBlog", "Blog V4");
+	const rtlsdr_model_t *model = priv->model;
+	int i;
 
-	/* if it's an RTL-SDR Blog V4, automatically upconvert by 28.8 MHz if we tune to HF
-	 * so that we don't need to manually set any upconvert offset in the SDR software */
-	upconvert_freq = is_rtlsdr_blog_v4 ? ((freq < MHZ(28.8)) ? (freq + MHZ(28.8)) : freq) : freq;
+	for (i = 0; i < model->num_notch; i++) {
+		if (freq >= model->notch[i][0] && freq <= model->notch[i][1])
+			return 0x00;
+	}
 
-	lo_freq = upconvert_freq + priv->int_freq;
+	return 0x08;
+}
 
-	rc = r82xx_set_mux(priv, lo_freq);
-	if (rc < 0)
-		goto err;
+/* LO frequency for a tuned frequency, going through an upconverter on HF */
+static uint32_t r82xx_get_lo_freq(struct r82xx_priv *priv, uint32_t freq)
+{
+	if (freq < priv->model->upconv_below)
+		freq += priv->model->upconv_offs;
 
-	rc = r82xx_set_pll(priv, lo_freq);
-	if (rc < 0 || !priv->has_lock)
-		goto err;
+	return freq + priv->int_freq;
+}
 
-	if (is_rtlsdr_blog_v4) {
-		/* determine if notch filters should be on or off notches are turned OFF
-		 * when tuned within the notch band and ON when tuned outside the notch band.
-		 */
-		open_d = (freq <= MHZ(2.2) || (freq >= MHZ(85) && freq <= MHZ(112)) || (freq >= MHZ(172) && freq <= MHZ(242))) ? 0x00 : 0x08;
-		rc = r82xx_write_reg_mask(priv, 0x17, open_d, 0x08);
+/* select the notch filters and the tuner input for a frequency */
+static int r82xx_set_input(struct r82xx_priv *priv, uint32_t freq)
+{
+	const rtlsdr_model_t *model = priv->model;
+	int rc = 0;
+	uint8_t air_cable1_in;
+	uint8_t band;
+	uint8_t cable_2_in;
+	uint8_t cable_1_in;
+	uint8_t air_in;
 
+	if (model->num_notch) {
+		rc = r82xx_write_reg_mask(priv, 0x17, r82xx_get_notch(priv, freq), 0x08);
 		if (rc < 0)
 			return rc;
+	}
 
+	if (model->uhf_min) {
 		/* select tuner band based on frequency and only switch if there is a band change
 		 *(to avoid excessive register writes when tuning rapidly)
 		 */
-		band = (freq <= MHZ(28.8)) ? HF : ((freq > MHZ(28.8) && freq < MHZ(250)) ? VHF : UHF);
+		band = (freq <= model->hf_max) ? HF : ((freq < model->uhf_min) ? VHF : UHF);
 
-		/* switch between tuner inputs on the RTL-SDR Blog V4 */
+		/* switch between the tuner inputs of the board */
 		if (band != priv->input) {
 			priv->input = band;
 
@@ -1174,27 +1220,26 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 			rc = r82xx_write_reg_mask(priv, 0x06, cable_2_in, 0x08);
 
 			if (rc < 0)
-				goto err;
+				return rc;
 
 			/* Control upconverter GPIO switch on newer batches */
-			rc = rtlsdr_set_bias_tee_gpio(priv->rtl_dev, 5, !cable_2_in);
+			if (model->hf_gpio >= 0) {
+				rc = rtlsdr_set_bias_tee_gpio(priv->rtl_dev, model->hf_gpio, !cable_2_in);
 
-			if (rc < 0)
-				goto err;
+				if (rc < 0)
+					return rc;
+			}
 
 			/* activate cable 1 (VHF input) */
 			cable_1_in = (band == VHF) ? 0x40 : 0x00;
 			rc = r82xx_write_reg_mask(priv, 0x05, cable_1_in, 0x40);
 
 			if (rc < 0)
-				goto err;
+				return rc;
 
 			/* activate air_in (UHF input) */
 			air_in = (band == UHF) ? 0x00 : 0x20;
 			rc = r82xx_write_reg_mask(priv, 0x05, air_in, 0x20);
-
-			if (rc < 0)
-				goto err;
 		}
 	}
 	else /* Standard R828D dongle*/
@@ -1212,6 +1257,171 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 		}
 	}
 
+	return rc;
+}
+
+int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
+{
+	int rc = -1;
+	uint32_t lo_freq = r82xx_get_lo_freq(priv, freq);
+
+	rc = r82xx_set_mux(priv, lo_freq);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_set_pll(priv, lo_freq);
+	if (rc < 0)
+		goto err;
+
+	if (!priv->has_lock) {
+		rc = -1;
+		goto err;
+	}
+
+	rc = r82xx_set_input(priv, freq);
+
+err:
+	if (rc < 0)
+		fprintf(stderr, "%s: failed=%d\n", __FUNCTION__, rc);
+	return rc;
+}
+
+static void plan_set(struct r82xx_freq_plan *plan, uint8_t reg, uint8_t val,
+		     uint8_t mask)
+{
+	reg -= REG_SHADOW_START;
+	plan->img[reg] = (plan->img[reg] & ~mask) | (val & mask);
+	plan->mask[reg] |= mask;
+}
+
+/*
+ * Precompute the registers r82xx_set_freq() would program for each
+ * plan[i].freq. The VCO fine tune status is read once for the whole plan
+ * instead of before every PLL update.
+ */
+int r82xx_make_plan(struct r82xx_priv *priv, struct r82xx_freq_plan *plan,
+		    unsigned int num)
+{
+	const struct r82xx_freq_range *range;
+	int rc;
+	unsigned int i, j;
+	uint32_t freq, lo_freq;
+	uint8_t data[5];
+	uint8_t regs[7];
+
+	rc = r82xx_read(priv, 0x00, data, sizeof(data));
+	if (rc < 0)
+		return rc;
+
+	for (i = 0; i < num; i++) {
+		freq = plan[i].freq;
+		memset(plan[i].img, 0, sizeof(plan[i].img));
+		memset(plan[i].mask, 0, sizeof(plan[i].mask));
+		lo_freq = r82xx_get_lo_freq(priv, freq);
+
+		/* as in r82xx_set_mux() */
+		range = r82xx_get_range(lo_freq);
+		plan_set(&plan[i], 0x17, range->open_d, 0x08);
+		plan_set(&plan[i], 0x1a, range->rf_mux_ploy, 0xc3);
+		plan_set(&plan[i], 0x1b, range->tf_c, 0xff);
+		plan_set(&plan[i], 0x10, r82xx_get_xtal_cap(priv, range), 0x0b);
+		plan_set(&plan[i], 0x08, 0x00, 0x3f);
+		plan_set(&plan[i], 0x09, 0x00, 0x3f);
+
+		/* pll autotune = 128kHz until locked */
+		plan_set(&plan[i], 0x1a, 0x00, 0x0c);
+
+		/* left to r82xx_set_freq() to fail when tuned to */
+		memset(regs, 0, sizeof(regs));
+		plan[i].valid = r82xx_calc_pll(priv, lo_freq, (data[4] & 0x30) >> 4, regs) == 0;
+
+		for (j = 0; j < sizeof(regs); j++)
+			plan_set(&plan[i], 0x10 + j, regs[j], r82xx_pll_mask[j]);
+	}
+
+	return 0;
+}
+
+/* write the bits in mask of the plan registers lo to hi, as one burst
+ * spanning the registers that change */
+static int r82xx_plan_write(struct r82xx_priv *priv,
+			    const struct r82xx_freq_plan *plan,
+			    const uint8_t *mask, uint8_t lo, uint8_t hi)
+{
+	int i, first = -1, last = -1;
+	uint8_t regs[NUM_REGS];
+
+	for (i = lo - REG_SHADOW_START; i <= hi - REG_SHADOW_START; i++) {
+		regs[i] = (priv->regs[i] & ~mask[i]) | (plan->img[i] & mask[i]);
+		if (regs[i] != priv->regs[i]) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+
+	if (first < 0)
+		return 0;
+
+	return r82xx_write(priv, first + REG_SHADOW_START, &regs[first],
+			   last - first + 1);
+}
+
+/*
+ * Tune to a precomputed frequency in the order of r82xx_set_freq(): the
+ * mux registers, the 128 kHz PLL autotune, the PLL registers in one burst,
+ * the lock check and the 8 kHz autotune. Only changed registers are
+ * written. Falls back to r82xx_set_freq() if the PLL did not lock.
+ */
+int r82xx_set_freq_plan(struct r82xx_priv *priv,
+			const struct r82xx_freq_plan *plan)
+{
+	uint8_t mask[NUM_REGS];
+	int rc;
+
+	if (!plan->valid)
+		return r82xx_set_freq(priv, plan->freq);
+
+	/* as r82xx_set_mux(), the PLL bits of 0x10 and 0x1a come later */
+	memcpy(mask, plan->mask, sizeof(mask));
+	mask[0x10 - REG_SHADOW_START] &= 0x0b;
+	mask[0x1a - REG_SHADOW_START] &= 0xc3;
+
+	rc = r82xx_plan_write(priv, plan, mask, 0x17, 0x1b);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_plan_write(priv, plan, mask, 0x10, 0x10);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_plan_write(priv, plan, mask, 0x08, 0x09);
+	if (rc < 0)
+		goto err;
+
+	/* set pll autotune = 128kHz */
+	rc = r82xx_write_reg_mask(priv, 0x1a, 0x00, 0x0c);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_plan_write(priv, plan, plan->mask, 0x10, 0x16);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_wait_lock(priv);
+	if (rc < 0)
+		goto err;
+
+	if (!priv->has_lock)
+		return r82xx_set_freq(priv, plan->freq);
+
+	/* set pll autotune = 8kHz */
+	rc = r82xx_write_reg_mask(priv, 0x1a, 0x08, 0x08);
+	if (rc < 0)
+		goto err;
+
+	rc = r82xx_set_input(priv, plan->freq);
+
 err:
 	if (rc < 0)
 		fprintf(stderr, "%s: failed=%d\n", __FUNCTION__, rc);
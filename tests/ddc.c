@@ -0,0 +1,185 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds tones through the down-converter for an even and an odd ratio and
+ * compares a tone in the band with one from the neighbouring band that
+ * aliases onto it, halfway out and at the edge of the usable band. Then
+ * checks that the output does not depend on how the input is split into
+ * buffers.
+ */
+
+#ifdef _MSC_VER
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rtl-sdr.h"
+
+#define RATE		2048000
+#define OFFSET		300000
+#define AMPL		0.5
+#define MID		0.2	/* of the output rate */
+#define EDGE		0.4	/* 80% of the band */
+#define SETTLE		256	/* output pairs skipped */
+#define MEASURE		4096	/* output pairs measured */
+
+/* limits of the alias rejection in dB, halfway out and at the edge */
+#define EVEN_DECIM	8
+#define EVEN_MID	-110.0
+#define EVEN_EDGE	-90.0
+#define ODD_DECIM	5
+#define ODD_MID		-40.0
+#define ODD_EDGE	-10.0
+
+#define CHUNK_DECIM	6
+#define CHUNK_PAIRS	50000
+
+static int failed;
+
+static void check(const char *what, double val, double expect, double tol)
+{
+	int bad = !(fabs(val - expect) <= tol);
+
+	printf("%-12s %10.6f, expected %10.6f %s\n", what, val, expect,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void check_below(const char *what, double val, double limit)
+{
+	int bad = !(val < limit);
+
+	printf("%-12s %10.1f dB, limit %6.1f dB %s\n", what, val, limit,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+/* complex tone at freq Hz off the center */
+static void fill(float *iq, uint32_t pairs, double freq)
+{
+	double w;
+	uint32_t i;
+
+	for (i = 0; i < pairs; i++) {
+		w = 2.0 * M_PI * freq * i / RATE;
+		iq[2 * i] = (float)(AMPL * cos(w));
+		iq[2 * i + 1] = (float)(AMPL * sin(w));
+	}
+}
+
+/* amplitude at freq Hz in the output of a down-converter fed with a tone,
+ * the output is measured at a single frequency, not windowed, so only the
+ * tone and whatever lands right on it count */
+static double level(uint32_t decim, double tone, double freq)
+{
+	uint32_t pairs = (SETTLE + MEASURE + 1) * decim, n, i;
+	double out_rate = (double)RATE / decim, re = 0.0, im = 0.0, w;
+	rtlsdr_ddc_t *ddc;
+	float *iq;
+
+	iq = malloc(2 * pairs * sizeof(float));
+	ddc = rtlsdr_ddc_create(RATE, OFFSET, decim);
+	if (!iq || !ddc) {
+		failed = 1;
+		free(iq);
+		rtlsdr_ddc_destroy(ddc);
+		return 0.0;
+	}
+
+	fill(iq, pairs, OFFSET + tone);
+	n = rtlsdr_ddc_process(ddc, iq, 2 * pairs, iq) / 2;
+
+	for (i = SETTLE; i < SETTLE + MEASURE && i < n; i++) {
+		w = 2.0 * M_PI * freq * i / out_rate;
+		re += iq[2 * i] * cos(w) + iq[2 * i + 1] * sin(w);
+		im += iq[2 * i + 1] * cos(w) - iq[2 * i] * sin(w);
+	}
+
+	rtlsdr_ddc_destroy(ddc);
+	free(iq);
+
+	return sqrt(re * re + im * im) / MEASURE;
+}
+
+/* a tone one output rate below f aliases onto f, the nearest alias */
+static double rejection(uint32_t decim, double f)
+{
+	double out_rate = (double)RATE / decim;
+
+	return 20.0 * log10(level(decim, (f - 1.0) * out_rate, f * out_rate) /
+			    level(decim, f * out_rate, f * out_rate));
+}
+
+static void alias(const char *what, uint32_t decim, double mid, double edge)
+{
+	check(what, level(decim, MID * RATE / decim, MID * RATE / decim),
+	      AMPL, 0.02 * AMPL);
+	check_below("  halfway", rejection(decim, MID), mid);
+	check_below("  at edge", rejection(decim, EDGE), edge);
+}
+
+static void chunks(void)
+{
+	static float iq[2 * CHUNK_PAIRS], whole[2 * CHUNK_PAIRS],
+		     parts[2 * CHUNK_PAIRS];
+	rtlsdr_ddc_t *ddc;
+	uint32_t n = 0, m = 0, len, i;
+	double diff = 0.0;
+
+	fill(iq, CHUNK_PAIRS, 12345.0);
+
+	ddc = rtlsdr_ddc_create(RATE, OFFSET, CHUNK_DECIM);
+	if (!ddc) {
+		failed = 1;
+		return;
+	}
+
+	n = rtlsdr_ddc_process(ddc, iq, 2 * CHUNK_PAIRS, whole);
+
+	/* odd sized pieces, from a single pair to a few thousand */
+	rtlsdr_ddc_reset(ddc);
+	srand(1);
+	for (i = 0; i < 2 * CHUNK_PAIRS; i += len) {
+		len = 2 * (1 + rand() % 3000);
+		if (len > 2 * CHUNK_PAIRS - i)
+			len = 2 * CHUNK_PAIRS - i;
+		m += rtlsdr_ddc_process(ddc, iq + i, len, parts + m);
+	}
+
+	rtlsdr_ddc_destroy(ddc);
+
+	for (i = 0; i < n && i < m; i++)
+		if (fabs(whole[i] - parts[i]) > diff)
+			diff = fabs(whole[i] - parts[i]);
+
+	check("chunk length", m, n, 0);
+	/* the NCO restarts its block of phasors at every call */
+	check("chunk diff", diff, 0.0, 1e-4);
+}
+
+int main(void)
+{
+	alias("even ratio", EVEN_DECIM, EVEN_MID, EVEN_EDGE);
+	alias("odd ratio", ODD_DECIM, ODD_MID, ODD_EDGE);
+	chunks();
+
+	return failed;
+}
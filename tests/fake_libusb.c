@@ -0,0 +1,493 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The subset of libusb the library uses, on top of the simulator. Bulk
+ * transfers are passed through to it, asynchronous control transfers are
+ * carried out on submission and completed from the event handler, like a
+ * real bus would.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libusb.h>
+
+#include "rtlsdr_transport.h"
+#include "fake_libusb.h"
+
+#define FAKE_VID		0x0bda
+#define FAKE_PID		0x2838
+#define FAKE_MAX_XFERS		64
+#define FAKE_TUNER_ADDR		0x34
+#define FAKE_IICB		6
+
+struct libusb_context {
+	int unused;
+};
+
+struct libusb_device {
+	int unused;
+};
+
+struct libusb_device_handle {
+	int unused;
+};
+
+/* a bulk transfer handed to the simulator, with the callback of its owner */
+struct fake_xfer {
+	struct libusb_transfer *xfer;
+	libusb_transfer_cb_fn cb;
+};
+
+static struct libusb_device fake_dev;
+static struct libusb_device_handle fake_devh;
+
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+static const rtlsdr_transport_t *tp = &rtlsdr_sim_transport;
+static void *sim;
+static int unplugged;
+static int replug_scans;
+static int replugs;
+static unsigned int round_trips;
+static struct fake_xfer bulk[FAKE_MAX_XFERS];
+static int bulk_num;
+static struct libusb_transfer *ctrl[FAKE_MAX_XFERS];
+static int ctrl_num;
+
+static void *fake_sim(void)
+{
+	pthread_mutex_lock(&fake_lock);
+	if (!sim)
+		sim = rtlsdr_sim_create(NULL);
+	pthread_mutex_unlock(&fake_lock);
+
+	return sim;
+}
+
+void fake_usb_unplug(int scans)
+{
+	pthread_mutex_lock(&fake_lock);
+	unplugged = 1;
+	replug_scans = scans;
+	pthread_mutex_unlock(&fake_lock);
+}
+
+int fake_usb_replugs(void)
+{
+	return replugs;
+}
+
+unsigned int fake_usb_round_trips(void)
+{
+	return round_trips;
+}
+
+static uint8_t fake_bitrev(uint8_t byte)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		r |= ((byte >> i) & 1) << (7 - i);
+
+	return r;
+}
+
+int fake_usb_read_regs(struct fake_usb_regs *regs)
+{
+	unsigned char rep, buf[5 + FAKE_USB_TUNER_REGS];
+	int i, r;
+
+	if (unplugged || !fake_sim())
+		return -1;
+
+	r = tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN,
+			0, 0x9f << 8, 1, regs->ratio, 4, 0);
+	if (r < 0)
+		return r;
+
+	/* the tuner is only reachable with the I2C repeater on */
+	tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN, 0,
+		    0x01 << 8, 1, &rep, 1, 0);
+	rep |= 0x08;
+	tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT, 0,
+		    0x01 << 8, 1, &rep, 1, 0);
+
+	/* read the tuner registers from the first one on */
+	buf[0] = 0;
+	r = tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT,
+			0, FAKE_TUNER_ADDR, FAKE_IICB << 8, buf, 1, 0);
+	if (r >= 0)
+		r = tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR |
+				LIBUSB_ENDPOINT_IN, 0, FAKE_TUNER_ADDR,
+				FAKE_IICB << 8, buf, sizeof(buf), 0);
+
+	rep &= ~0x08;
+	tp->control(sim, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT, 0,
+		    0x01 << 8, 1, &rep, 1, 0);
+
+	if (r < 0)
+		return r;
+
+	for (i = 0; i < FAKE_USB_TUNER_REGS; i++)
+		regs->tuner[i] = fake_bitrev(buf[5 + i]);
+
+	return 0;
+}
+
+int LIBUSB_CALL libusb_init(libusb_context **ctx)
+{
+	if (ctx) {
+		*ctx = calloc(1, sizeof(libusb_context));
+		if (!*ctx)
+			return LIBUSB_ERROR_NO_MEM;
+	}
+
+	return 0;
+}
+
+void LIBUSB_CALL libusb_exit(libusb_context *ctx)
+{
+	free(ctx);
+}
+
+ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context *ctx,
+					   libusb_device ***list)
+{
+	ssize_t num = 1;
+
+	*list = calloc(2, sizeof(libusb_device *));
+	if (!*list)
+		return LIBUSB_ERROR_NO_MEM;
+
+	pthread_mutex_lock(&fake_lock);
+	if (unplugged && replug_scans-- <= 0) {
+		/* back with the registers of a device just powered up */
+		if (sim)
+			tp->close(sim);
+		sim = rtlsdr_sim_create(NULL);
+		unplugged = 0;
+		replugs++;
+	}
+
+	if (unplugged)
+		num = 0;
+	else
+		(*list)[0] = &fake_dev;
+	pthread_mutex_unlock(&fake_lock);
+
+	return num;
+}
+
+void LIBUSB_CALL libusb_free_device_list(libusb_device **list,
+					 int unref_devices)
+{
+	free(list);
+}
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device *dev,
+				struct libusb_device_descriptor *desc)
+{
+	memset(desc, 0, sizeof(*desc));
+	desc->idVendor = FAKE_VID;
+	desc->idProduct = FAKE_PID;
+	desc->iManufacturer = 1;
+	desc->iProduct = 2;
+	desc->iSerialNumber = 3;
+
+	return 0;
+}
+
+uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device *dev)
+{
+	return 1;
+}
+
+uint8_t LIBUSB_CALL libusb_get_device_address(libusb_device *dev)
+{
+	return 2;
+}
+
+int LIBUSB_CALL libusb_get_port_numbers(libusb_device *dev,
+					uint8_t *port_numbers,
+					int port_numbers_len)
+{
+	if (port_numbers_len < 1)
+		return LIBUSB_ERROR_OVERFLOW;
+
+	port_numbers[0] = 1;
+
+	return 1;
+}
+
+libusb_device * LIBUSB_CALL libusb_ref_device(libusb_device *dev)
+{
+	return dev;
+}
+
+void LIBUSB_CALL libusb_unref_device(libusb_device *dev)
+{
+}
+
+int LIBUSB_CALL libusb_open(libusb_device *dev,
+			    libusb_device_handle **dev_handle)
+{
+	if (unplugged || !fake_sim())
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	*dev_handle = &fake_devh;
+
+	return 0;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle *dev_handle)
+{
+}
+
+libusb_device * LIBUSB_CALL libusb_get_device(libusb_device_handle *dev_handle)
+{
+	return &fake_dev;
+}
+
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle *dev_handle,
+				       int interface_number)
+{
+	return unplugged ? LIBUSB_ERROR_NO_DEVICE : 0;
+}
+
+int LIBUSB_CALL libusb_release_interface(libusb_device_handle *dev_handle,
+					 int interface_number)
+{
+	return unplugged ? LIBUSB_ERROR_NO_DEVICE : 0;
+}
+
+int LIBUSB_CALL libusb_reset_device(libusb_device_handle *dev_handle)
+{
+	return unplugged ? LIBUSB_ERROR_NO_DEVICE : 0;
+}
+
+int LIBUSB_CALL libusb_kernel_driver_active(libusb_device_handle *dev_handle,
+					    int interface_number)
+{
+	return 0;
+}
+
+int LIBUSB_CALL libusb_detach_kernel_driver(libusb_device_handle *dev_handle,
+					    int interface_number)
+{
+	return 0;
+}
+
+int LIBUSB_CALL libusb_attach_kernel_driver(libusb_device_handle *dev_handle,
+					    int interface_number)
+{
+	return 0;
+}
+
+int LIBUSB_CALL libusb_get_string_descriptor_ascii(
+	libusb_device_handle *dev_handle, uint8_t desc_index,
+	unsigned char *data, int length)
+{
+	char str[3][256];
+
+	if (unplugged || desc_index < 1 || desc_index > 3)
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	tp->get_strings(fake_sim(), str[0], str[1], str[2]);
+	strncpy((char *)data, str[desc_index - 1], length);
+	data[length - 1] = '\0';
+
+	return (int)strlen((char *)data);
+}
+
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle,
+	uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+	uint16_t wIndex, unsigned char *data, uint16_t wLength,
+	unsigned int timeout)
+{
+	if (unplugged)
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	round_trips++;
+
+	return tp->control(fake_sim(), request_type, bRequest, wValue, wIndex,
+			   data, wLength, timeout);
+}
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle *dev_handle,
+	unsigned char endpoint, unsigned char *data, int length,
+	int *actual_length, unsigned int timeout)
+{
+	if (unplugged)
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	return tp->bulk(fake_sim(), endpoint, data, length, actual_length,
+			timeout);
+}
+
+struct libusb_transfer * LIBUSB_CALL libusb_alloc_transfer(int iso_packets)
+{
+	return calloc(1, sizeof(struct libusb_transfer));
+}
+
+void LIBUSB_CALL libusb_free_transfer(struct libusb_transfer *transfer)
+{
+	free(transfer);
+}
+
+/* completion of a bulk transfer by the simulator, the data of a transfer
+ * that was in flight when the dongle went away is lost */
+static void LIBUSB_CALL fake_bulk_cb(struct libusb_transfer *xfer)
+{
+	libusb_transfer_cb_fn cb = NULL;
+	int i;
+
+	pthread_mutex_lock(&fake_lock);
+	for (i = 0; i < bulk_num; i++) {
+		if (bulk[i].xfer == xfer) {
+			cb = bulk[i].cb;
+			bulk[i] = bulk[--bulk_num];
+			break;
+		}
+	}
+
+	if (unplugged && xfer->status != LIBUSB_TRANSFER_CANCELLED) {
+		xfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+		xfer->actual_length = 0;
+	}
+	pthread_mutex_unlock(&fake_lock);
+
+	xfer->callback = cb;
+	if (cb)
+		cb(xfer);
+}
+
+/* carry out a control transfer right away, it completes from the event
+ * handler */
+static int fake_submit_ctrl(struct libusb_transfer *xfer)
+{
+	unsigned char *setup = xfer->buffer;
+	uint16_t value, index, len;
+	int r;
+
+	if (ctrl_num == FAKE_MAX_XFERS)
+		return LIBUSB_ERROR_BUSY;
+
+	value = setup[2] | (setup[3] << 8);
+	index = setup[4] | (setup[5] << 8);
+	len = setup[6] | (setup[7] << 8);
+
+	r = tp->control(sim, setup[0], setup[1], value, index,
+			setup + LIBUSB_CONTROL_SETUP_SIZE, len, xfer->timeout);
+
+	xfer->status = r < 0 ? LIBUSB_TRANSFER_STALL :
+			       LIBUSB_TRANSFER_COMPLETED;
+	xfer->actual_length = r < 0 ? 0 : r;
+
+	pthread_mutex_lock(&fake_lock);
+	/* transfers submitted back-to-back share a round trip */
+	if (!ctrl_num)
+		round_trips++;
+	ctrl[ctrl_num++] = xfer;
+	pthread_mutex_unlock(&fake_lock);
+
+	/* wake up an event handler waiting for samples */
+	tp->interrupt(sim);
+
+	return 0;
+}
+
+int LIBUSB_CALL libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+	int r;
+
+	if (unplugged || !fake_sim())
+		return LIBUSB_ERROR_NO_DEVICE;
+
+	if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+		return fake_submit_ctrl(transfer);
+
+	pthread_mutex_lock(&fake_lock);
+	if (bulk_num == FAKE_MAX_XFERS) {
+		pthread_mutex_unlock(&fake_lock);
+		return LIBUSB_ERROR_BUSY;
+	}
+	bulk[bulk_num].xfer = transfer;
+	bulk[bulk_num].cb = transfer->callback;
+	bulk_num++;
+	transfer->callback = fake_bulk_cb;
+	pthread_mutex_unlock(&fake_lock);
+
+	r = tp->submit(sim, transfer);
+	if (r < 0) {
+		pthread_mutex_lock(&fake_lock);
+		transfer->callback = bulk[--bulk_num].cb;
+		pthread_mutex_unlock(&fake_lock);
+	}
+
+	return r;
+}
+
+int LIBUSB_CALL libusb_cancel_transfer(struct libusb_transfer *transfer)
+{
+	/* control transfers are done as soon as they are submitted */
+	if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+		return LIBUSB_ERROR_NOT_FOUND;
+
+	return tp->cancel(fake_sim(), transfer);
+}
+
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context *ctx,
+	struct timeval *tv, int *completed)
+{
+	struct libusb_transfer *xfer = NULL;
+
+	pthread_mutex_lock(&fake_lock);
+	if (ctrl_num) {
+		xfer = ctrl[0];
+		memmove(ctrl, ctrl + 1, --ctrl_num * sizeof(ctrl[0]));
+	}
+	pthread_mutex_unlock(&fake_lock);
+
+	if (xfer) {
+		xfer->callback(xfer);
+		/* someone else may be waiting for it */
+		tp->interrupt(sim);
+		return 0;
+	}
+
+	return tp->handle_events(fake_sim(), tv, completed);
+}
+
+void LIBUSB_CALL libusb_interrupt_event_handler(libusb_context *ctx)
+{
+	tp->interrupt(fake_sim());
+}
+
+unsigned char * LIBUSB_CALL libusb_dev_mem_alloc(
+	libusb_device_handle *dev_handle, size_t length)
+{
+	return NULL;
+}
+
+int LIBUSB_CALL libusb_dev_mem_free(libusb_device_handle *dev_handle,
+				    unsigned char *buffer, size_t length)
+{
+	return 0;
+}
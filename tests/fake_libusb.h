@@ -0,0 +1,53 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FAKE_LIBUSB_H
+#define __FAKE_LIBUSB_H
+
+#include <stdint.h>
+
+/*
+ * A stand-in for libusb with a single dongle on the bus, the simulated
+ * RTL2832U and R820T of rtlsdr_sim.c behind it. Linked into a test
+ * together with the static library, it replaces the real libusb.
+ */
+
+/* unplug the dongle: transfers in flight fail with
+ * LIBUSB_TRANSFER_NO_DEVICE, and it is back as a freshly powered up device
+ * once the bus has been enumerated scans more times */
+void fake_usb_unplug(int scans);
+
+/* number of times the dongle was plugged in again */
+int fake_usb_replugs(void);
+
+/* number of control round trips, a synchronous transfer or a batch of
+ * asynchronous ones submitted back-to-back */
+unsigned int fake_usb_round_trips(void);
+
+/* register contents of the dongle: the resampler ratio of the demod,
+ * which sets the sample rate, and the R820T registers from 5 on, which
+ * hold the frequency and gain settings */
+#define FAKE_USB_TUNER_REGS	27
+
+struct fake_usb_regs {
+	uint8_t ratio[4];
+	uint8_t tuner[FAKE_USB_TUNER_REGS];
+};
+
+int fake_usb_read_regs(struct fake_usb_regs *regs);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds a tone with a known DC offset and I/Q imbalance through the
+ * correction stage, checks the estimates and that the corrected output
+ * is balanced again.
+ */
+
+#ifdef _MSC_VER
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+
+#include "rtl-sdr.h"
+
+#define BUF_PAIRS	8192
+#define BUFS		64
+
+#define TONE		0.0123	/* cycles per sample */
+#define AMPL		0.5
+#define DC_I		0.02
+#define DC_Q		-0.015
+#define GAIN		1.08	/* of Q relative to I */
+#define PHASE		0.07	/* radians */
+
+static int failed;
+
+static void check(const char *what, double val, double expect, double tol)
+{
+	int bad = !(fabs(val - expect) <= tol);
+
+	printf("%-12s %10.6f, expected %10.6f %s\n", what, val, expect,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void fill(float *iq, unsigned long start, double ampl)
+{
+	double w;
+	int i;
+
+	for (i = 0; i < BUF_PAIRS; i++) {
+		w = 2.0 * M_PI * TONE * (double)(start + i);
+		iq[2 * i] = (float)(ampl * cos(w) + DC_I);
+		iq[2 * i + 1] = (float)(GAIN * ampl * sin(w + PHASE) + DC_Q);
+	}
+}
+
+int main(void)
+{
+	static float iq[2 * BUF_PAIRS];
+	rtlsdr_iq_corr_t *corr;
+	float dc_i, dc_q, gain, phase;
+	double mi = 0, mq = 0, ii = 0, qq = 0, iq_sum = 0;
+	int i, r;
+
+	corr = rtlsdr_iq_corr_create(RTLSDR_CORR_DC | RTLSDR_CORR_IQ, 0);
+	if (!corr)
+		return 1;
+
+	for (i = 0; i < BUFS; i++) {
+		fill(iq, (unsigned long)i * BUF_PAIRS, AMPL);
+		rtlsdr_iq_corr_process(corr, iq, 2 * BUF_PAIRS);
+	}
+
+	r = rtlsdr_iq_corr_get_estimate(corr, &dc_i, &dc_q, &gain, &phase);
+	check("estimate", r, 0, 0);
+	check("dc i", dc_i, DC_I, 1e-3);
+	check("dc q", dc_q, DC_Q, 1e-3);
+	check("gain", gain, GAIN, 2e-3);
+	check("phase", phase, PHASE, 2e-3);
+
+	/* the last buffer has been corrected with the converged estimates */
+	for (i = 0; i < BUF_PAIRS; i++) {
+		mi += iq[2 * i];
+		mq += iq[2 * i + 1];
+	}
+	mi /= BUF_PAIRS;
+	mq /= BUF_PAIRS;
+	for (i = 0; i < BUF_PAIRS; i++) {
+		ii += (iq[2 * i] - mi) * (iq[2 * i] - mi);
+		qq += (iq[2 * i + 1] - mq) * (iq[2 * i + 1] - mq);
+		iq_sum += (iq[2 * i] - mi) * (iq[2 * i + 1] - mq);
+	}
+	check("out dc i", mi, 0.0, 2e-3);
+	check("out dc q", mq, 0.0, 2e-3);
+	check("out gain", sqrt(qq / ii), 1.0, 5e-3);
+	check("out phase", asin(iq_sum / sqrt(ii * qq)), 0.0, 5e-3);
+
+	/* without a signal there is nothing to estimate the imbalance from */
+	rtlsdr_iq_corr_reset(corr);
+	fill(iq, 0, 0.0);
+	rtlsdr_iq_corr_process(corr, iq, 2 * BUF_PAIRS);
+	gain = phase = 1234.0f;
+	r = rtlsdr_iq_corr_get_estimate(corr, &dc_i, &dc_q, &gain, &phase);
+	check("no signal", r, -2, 0);
+	check("untouched", gain + phase, 2468.0, 0);
+
+	rtlsdr_iq_corr_destroy(corr);
+
+	return failed;
+}
@@ -0,0 +1,119 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Puts a tone into one channel of the filter bank and checks that it comes
+ * out of that channel, and how much of it leaks into the channels next to
+ * it, above and below.
+ */
+
+#ifdef _MSC_VER
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rtl-sdr.h"
+
+#define CHANNELS	16
+#define CHANNEL		3
+#define TONE		0.1	/* off the channel center, of the spacing */
+#define AMPL		0.5
+#define BLOCKS		2048
+#define SETTLE		64	/* blocks skipped */
+
+#define ISOLATION	-85.0	/* dB */
+
+static int failed;
+
+static void check(const char *what, double val, double expect, double tol)
+{
+	int bad = !(fabs(val - expect) <= tol);
+
+	printf("%-12s %10.6f, expected %10.6f %s\n", what, val, expect,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void check_below(const char *what, double val, double limit)
+{
+	int bad = !(val < limit);
+
+	printf("%-12s %10.1f dB, limit %6.1f dB %s\n", what, val, limit,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+/* RMS amplitude of a channel once the filter has settled */
+static double level(rtlsdr_pfb_t *pfb, const float *branches,
+		    uint32_t blocks, int32_t channel, float *out)
+{
+	double sum = 0.0;
+	uint32_t i;
+
+	if (rtlsdr_pfb_extract(pfb, branches, blocks, channel, out) < 0) {
+		failed = 1;
+		return 0.0;
+	}
+
+	for (i = SETTLE; i < blocks; i++)
+		sum += out[2 * i] * out[2 * i] + out[2 * i + 1] * out[2 * i + 1];
+
+	return sqrt(sum / (blocks - SETTLE));
+}
+
+int main(void)
+{
+	uint32_t pairs = CHANNELS * BLOCKS, blocks, i;
+	float *iq, *branches, *out;
+	double w, own;
+	rtlsdr_pfb_t *pfb;
+
+	iq = malloc(2 * pairs * sizeof(float));
+	branches = malloc(2 * CHANNELS * (BLOCKS + 1) * sizeof(float));
+	out = malloc(2 * BLOCKS * sizeof(float));
+	pfb = rtlsdr_pfb_create(CHANNELS, 0);
+	if (!iq || !branches || !out || !pfb)
+		return 1;
+
+	for (i = 0; i < pairs; i++) {
+		w = 2.0 * M_PI * (CHANNEL + TONE) * i / CHANNELS;
+		iq[2 * i] = (float)(AMPL * cos(w));
+		iq[2 * i + 1] = (float)(AMPL * sin(w));
+	}
+
+	blocks = rtlsdr_pfb_process(pfb, iq, 2 * pairs, branches);
+	check("blocks", blocks, BLOCKS, 0);
+
+	own = level(pfb, branches, blocks, CHANNEL, out);
+	check("own channel", own, AMPL, 0.02 * AMPL);
+	check_below("above", 20.0 * log10(level(pfb, branches, blocks,
+						CHANNEL + 1, out) / own),
+		    ISOLATION);
+	check_below("below", 20.0 * log10(level(pfb, branches, blocks,
+						CHANNEL - 1, out) / own),
+		    ISOLATION);
+
+	rtlsdr_pfb_destroy(pfb);
+	free(iq);
+	free(branches);
+	free(out);
+
+	return failed;
+}
@@ -0,0 +1,130 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Unplugs the dongle behind a fake libusb in the middle of a stream and
+ * checks that the stream comes back flagged as recovered, that the sample
+ * index skips the time the dongle was gone, and that frequency, sample
+ * rate and gain were set up again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtl-sdr.h"
+#include "fake_libusb.h"
+
+#define FREQ		100000000
+#define RATE		1024000
+#define BUF_NUM		4
+#define BUF_LEN		16384
+#define UNPLUG_AT	8	/* buffers */
+#define UNPLUG_SCANS	1	/* enumerations that miss the dongle */
+#define MAX_BUFS	400
+
+static int failed;
+
+static rtlsdr_dev_t *dev;
+static int gain;
+static int bufs;
+static int recovered;
+static int contiguous = 1;
+static uint64_t next_index;
+static struct fake_usb_regs before;
+
+static void check(const char *what, int bad)
+{
+	printf("%-24s %s\n", what, bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void rtlsdr_callback(unsigned char *buf, uint32_t len,
+			    const rtlsdr_buffer_info_t *info, void *ctx)
+{
+	struct fake_usb_regs after;
+
+	if (++bufs > MAX_BUFS) {
+		rtlsdr_cancel_async(dev);
+		return;
+	}
+
+	if (!(info->flags & RTLSDR_BUF_RECOVERED)) {
+		if (bufs > 1 && info->sample_index != next_index)
+			contiguous = 0;
+		next_index = info->sample_index + len / 2;
+
+		if (bufs == UNPLUG_AT) {
+			check("registers read", fake_usb_read_regs(&before));
+			fake_usb_unplug(UNPLUG_SCANS);
+		}
+		return;
+	}
+
+	recovered = 1;
+	check("flags", !(info->flags & RTLSDR_BUF_GAP) ||
+		       !(info->flags & RTLSDR_BUF_RETUNE));
+	/* the dongle was gone for at least one rescan of the bus */
+	check("sample index gap", info->sample_index < next_index + RATE / 4);
+	check("info frequency", info->center_freq != FREQ);
+	check("info sample rate", info->sample_rate != RATE);
+	check("info gain", info->gain != gain);
+
+	check("registers read", fake_usb_read_regs(&after));
+	check("resampler ratio", memcmp(before.ratio, after.ratio,
+					sizeof(before.ratio)));
+	check("tuner registers", memcmp(before.tuner, after.tuner,
+					sizeof(before.tuner)));
+
+	rtlsdr_cancel_async(dev);
+}
+
+int main(void)
+{
+	int gains[100];
+	int num;
+
+	if (rtlsdr_open(&dev, 0) < 0) {
+		printf("no device behind the fake libusb\n");
+		return 1;
+	}
+
+	num = rtlsdr_get_tuner_gains(dev, gains);
+	if (num <= 0) {
+		printf("no tuner gains\n");
+		rtlsdr_close(dev);
+		return 1;
+	}
+	gain = gains[num / 2];
+
+	rtlsdr_set_sample_rate(dev, RATE);
+	rtlsdr_set_center_freq(dev, FREQ);
+	rtlsdr_set_tuner_gain_mode(dev, 1);
+	rtlsdr_set_tuner_gain(dev, gain);
+	rtlsdr_set_auto_recovery(dev, 1);
+	rtlsdr_reset_buffer(dev);
+
+	rtlsdr_read_async_ex(dev, rtlsdr_callback, NULL, BUF_NUM, BUF_LEN);
+
+	check("contiguous before", !contiguous);
+	check("recovered", !recovered);
+	check("plugged in again", fake_usb_replugs() != 1);
+
+	rtlsdr_close(dev);
+
+	return failed;
+}
@@ -0,0 +1,150 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streams from the simulated dongle and checks that the samples arrive at
+ * the programmed rate. Then counts the control round trips of the common
+ * settings on the same dongle behind a fake libusb, so that the batching
+ * of register writes does not quietly fall apart.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "rtl-sdr.h"
+#include "fake_libusb.h"
+
+#define RATE		1024000
+#define RATE_TOL	0.02	/* relative */
+#define MEASURE_NS	1000000000ULL
+#define BUF_NUM		8
+#define BUF_LEN		16384
+
+/* round trips as of the write batching, any more is a regression */
+#define RT_RATE		5
+#define RT_TUNE		13
+#define RT_GAIN		8
+
+static int failed;
+
+static rtlsdr_dev_t *dev;
+static uint64_t start_ns, last_ns;
+static uint64_t samples;
+
+static void check(const char *what, double val, double expect, double tol)
+{
+	int bad = !(fabs(val - expect) <= tol);
+
+	printf("%-12s %10.0f, expected %10.0f %s\n", what, val, expect,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void check_max(const char *what, unsigned int val, unsigned int max)
+{
+	int bad = val > max;
+
+	printf("%-12s %10u, at most   %10u %s\n", what, val, max,
+	       bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
+{
+	last_ns = now_ns();
+
+	/* the first buffer only starts the clock */
+	if (!start_ns) {
+		start_ns = last_ns;
+		return;
+	}
+
+	samples += len / 2;
+	if (last_ns - start_ns >= MEASURE_NS)
+		rtlsdr_cancel_async(dev);
+}
+
+static void test_rate(void)
+{
+	if (rtlsdr_open_sim(&dev, NULL) < 0) {
+		printf("can't open the simulator\n");
+		failed = 1;
+		return;
+	}
+
+	rtlsdr_set_sample_rate(dev, RATE);
+	rtlsdr_reset_buffer(dev);
+	rtlsdr_read_async(dev, rtlsdr_callback, NULL, BUF_NUM, BUF_LEN);
+	rtlsdr_close(dev);
+
+	check("sample rate", samples * 1e9 / (last_ns - start_ns), RATE,
+	      RATE * RATE_TOL);
+}
+
+static void test_round_trips(void)
+{
+	unsigned int rt;
+	int gains[100];
+	int num;
+
+	if (rtlsdr_open(&dev, 0) < 0) {
+		printf("no device behind the fake libusb\n");
+		failed = 1;
+		return;
+	}
+
+	num = rtlsdr_get_tuner_gains(dev, gains);
+	if (num <= 0) {
+		printf("no tuner gains\n");
+		failed = 1;
+		rtlsdr_close(dev);
+		return;
+	}
+	rtlsdr_set_tuner_gain_mode(dev, 1);
+
+	rt = fake_usb_round_trips();
+	rtlsdr_set_sample_rate(dev, RATE);
+	check_max("set rate", fake_usb_round_trips() - rt, RT_RATE);
+
+	rt = fake_usb_round_trips();
+	rtlsdr_set_center_freq(dev, 100000000);
+	check_max("tune", fake_usb_round_trips() - rt, RT_TUNE);
+
+	rt = fake_usb_round_trips();
+	rtlsdr_set_tuner_gain(dev, gains[num / 2]);
+	check_max("set gain", fake_usb_round_trips() - rt, RT_GAIN);
+
+	rtlsdr_close(dev);
+}
+
+int main(void)
+{
+	test_rate();
+	test_round_trips();
+
+	return failed;
+}
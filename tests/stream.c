@@ -0,0 +1,151 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streams a byte counter from the simulated dongle into the stream ring,
+ * stalls the consumer until the ring overflows, and checks that the
+ * overflows are counted, that every delivered buffer holds the samples
+ * its index says, and that the skipped samples are flagged as a gap.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "rtl-sdr.h"
+
+#define FILE_NAME	"test_stream.u8"
+#define FILE_LEN	65536	/* a multiple of the counter period */
+#define RATE		1024000
+#define BUF_NUM		4
+#define BUF_LEN		16384	/* 8 ms at RATE */
+#define RING_LEN	4
+#define STALL_MS	200
+#define BUFS		64
+
+static int failed;
+
+static void check(const char *what, int bad)
+{
+	printf("%-24s %s\n", what, bad ? "FAILED" : "ok");
+	failed |= bad;
+}
+
+static void sleep_ms(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+static int write_counter(void)
+{
+	unsigned char buf[FILE_LEN];
+	FILE *f;
+	int i;
+
+	for (i = 0; i < FILE_LEN; i++)
+		buf[i] = i & 0xff;
+
+	f = fopen(FILE_NAME, "wb");
+	if (!f)
+		return -1;
+
+	i = fwrite(buf, 1, FILE_LEN, f) != FILE_LEN;
+
+	return fclose(f) || i ? -1 : 0;
+}
+
+/* a buffer holds the counter from twice its sample index on */
+static int counter_ok(const rtlsdr_buffer_t *b)
+{
+	uint32_t i;
+
+	for (i = 0; i < b->len; i++)
+		if (b->buf[i] != ((2 * b->info.sample_index + i) & 0xff))
+			return 0;
+
+	return 1;
+}
+
+int main(void)
+{
+	rtlsdr_dev_t *dev;
+	rtlsdr_buffer_t *b;
+	uint64_t next = 0;
+	int i, r, bufs = 0, gaps = 0;
+	int continuous = 1, flagged = 1;
+
+	if (write_counter() < 0) {
+		printf("can't write %s\n", FILE_NAME);
+		return 1;
+	}
+
+	if (rtlsdr_open_sim(&dev, "file=" FILE_NAME) < 0) {
+		printf("can't open the simulator\n");
+		remove(FILE_NAME);
+		return 1;
+	}
+
+	rtlsdr_set_sample_rate(dev, RATE);
+	rtlsdr_reset_buffer(dev);
+
+	r = rtlsdr_stream_start(dev, BUF_NUM, BUF_LEN, RING_LEN);
+	check("stream start", r < 0);
+
+	for (i = 0; !r && i < BUFS; i++) {
+		/* fall behind once, the ring fills up while nobody reads */
+		if (i == BUFS / 4)
+			sleep_ms(STALL_MS);
+
+		r = rtlsdr_stream_acquire(dev, &b, 1000);
+		if (r < 0)
+			break;
+
+		if (!counter_ok(b))
+			continuous = 0;
+
+		if (bufs && b->info.sample_index != next) {
+			gaps++;
+			if (b->info.sample_index < next ||
+			    !(b->info.flags & RTLSDR_BUF_GAP))
+				flagged = 0;
+		}
+		next = b->info.sample_index + b->len / 2;
+		bufs++;
+
+		rtlsdr_stream_release(dev, b);
+	}
+
+	check("buffers acquired", bufs != BUFS);
+	check("overflows counted", !rtlsdr_stream_get_overflows(dev));
+	check("samples in sequence", !continuous);
+	check("gap after the stall", !gaps);
+	check("gaps flagged", !flagged);
+
+	rtlsdr_stream_stop(dev);
+	rtlsdr_close(dev);
+	remove(FILE_NAME);
+
+	return failed;
+}